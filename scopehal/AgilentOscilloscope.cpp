@@ -505,25 +505,23 @@ bool AgilentOscilloscope::AcquireData()
 		cap->m_startFemtoseconds = (t - floor(t)) * FS_PER_SECOND;
 
 		//Ask for the data
-		m_transport->SendCommand(":WAV:DATA?");
-
-		//Read the length header
-		char tmp[16] = {0};
-		m_transport->ReadRawData(2, (unsigned char*)tmp);
-		int num_digits = atoi(tmp+1);
-		//LogDebug("num_digits = %d", num_digits);
-		m_transport->ReadRawData(num_digits, (unsigned char*)tmp);
-		int actual_len = atoi(tmp);
-		//LogDebug("actual_len = %d", actual_len);
-
-		uint8_t* temp_buf = new uint8_t[actual_len / sizeof(uint8_t)];
-
-		//Read the actual data
-		m_transport->ReadRawData(actual_len, (unsigned char*)temp_buf);
-		//Discard trailing newline
-		m_transport->ReadRawData(1, (unsigned char*)tmp);
+		size_t actual_len;
+		auto block = m_transport->SendCommandImmediateWithBinaryBlockReply(":WAV:DATA?", actual_len);
+		if(!block)
+		{
+			delete cap;
+			for(auto it : pending_waveforms)
+			{
+				for(auto w : it.second)
+					delete w;
+			}
+			return false;
+		}
+		uint8_t* temp_buf = block->data();
+		//LogDebug("actual_len = %zu", actual_len);
 
 		//Format the capture
+		length = min(length, actual_len);
 		cap->Resize(length);
 		for(size_t j=0; j<length; j++)
 		{
@@ -534,13 +532,9 @@ bool AgilentOscilloscope::AcquireData()
 
 		//Done, update the data
 		pending_waveforms[i].push_back(cap);
-
-		//Clean up
-		delete[] temp_buf;
 	}
 
 	//Now that we have all of the pending waveforms, save them in sets across all channels
-	m_pendingWaveformsMutex.lock();
 	size_t num_pending = 1;	//TODO: segmented capture mode
 	for(size_t i=0; i<num_pending; i++)
 	{
@@ -550,9 +544,8 @@ bool AgilentOscilloscope::AcquireData()
 			if(IsChannelEnabled(j))
 				s[m_channels[j]] = pending_waveforms[j][i];
 		}
-		m_pendingWaveforms.push_back(s);
+		PushPendingWaveform(s);
 	}
-	m_pendingWaveformsMutex.unlock();
 
 	//TODO: support digital channels
 
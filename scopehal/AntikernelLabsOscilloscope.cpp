@@ -399,7 +399,6 @@ bool AntikernelLabsOscilloscope::AcquireData()
 	pending_waveforms[0].push_back(cap);
 
 	//Now that we have all of the pending waveforms, save them in sets across all channels
-	m_pendingWaveformsMutex.lock();
 	size_t num_pending = 1;	//single segment only for now
 	for(size_t i=0; i<num_pending; i++)
 	{
@@ -409,9 +408,8 @@ bool AntikernelLabsOscilloscope::AcquireData()
 			if(IsChannelEnabled(j))
 				s[m_channels[j]] = pending_waveforms[j][i];
 		}
-		m_pendingWaveforms.push_back(s);
+		PushPendingWaveform(s);
 	}
-	m_pendingWaveformsMutex.unlock();
 
 	return true;
 }
@@ -384,38 +384,36 @@ bool AntikernelLogicAnalyzer::AcquireData()
 		else
 		{
 			//Create the channel
-			DigitalBusWaveform* cap = new DigitalBusWaveform;
+			DigitalBusWaveform* cap = new DigitalBusWaveform(cwidth);
 			cap->m_timescale = m_samplePeriod;
 			cap->m_triggerPhase = 0;
 			cap->m_startTimestamp = time;
 			cap->m_startFemtoseconds = fs;
-			cap->m_samples.resize(m_memoryDepth);
+			cap->ResizeImplicit(m_memoryDepth);
 
+			//DigitalBusWaveform only stores the low 64 lines of wider buses
+			size_t nbits = min(cwidth, cap->GetWidth());
 			for(size_t j=0; j<m_memoryDepth; j++)
 			{
-				cap->m_offsets[j] = j;
-				cap->m_durations[j] = 1;
-
-				vector<bool> bits;
-				for(size_t k=0; k<cwidth; k++)
+				uint64_t value = 0;
+				for(size_t k=0; k<nbits; k++)
 				{
 					size_t off = nlow + k;
 					size_t nbyte = off / 8;
 					size_t nbit = off % 8;
 					uint8_t s = data[j*bytewidth + nbyte];
-					bits.push_back((s >> nbit) & 1 ? true : false);
+					if((s >> nbit) & 1)
+						value |= (1ULL << k);
 				}
 
-				cap->m_samples[j] = bits;
+				cap->SetSample(j, value);
 			}
 
 			//Done, update the data
 			pending_waveforms[chan] = cap;
 		}
 	}
-	m_pendingWaveformsMutex.lock();
-	m_pendingWaveforms.push_back(pending_waveforms);
-	m_pendingWaveformsMutex.unlock();
+	PushPendingWaveform(pending_waveforms);
 
 	//Re-arm the trigger if not in one-shot mode
 	if(!m_triggerOneShot)
@@ -0,0 +1,214 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of BufferPool
+ */
+#ifndef BufferPool_h
+#define BufferPool_h
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "AlignedAllocator.h"
+
+/**
+	@brief Pool of recycled, 64-byte aligned buffers for large temporaries
+
+	Buffers are handed out as shared_ptrs which return them to the pool when the last reference goes away. Get()
+	reuses the smallest idle buffer that's big enough, so a recycled buffer may be larger than requested. If no idle
+	buffer is big enough, a new one is allocated rather than growing an idle one in place, since resize() would copy
+	the old (meaningless) contents across.
+
+	Idle buffers are capped both by count and by total size. Anything released once the pool is full is freed, so a
+	single unusually deep capture doesn't leave hundreds of megabytes pinned for the life of the process.
+
+	Pools are meant to be static objects, so that buffers can outlive whatever requested them.
+ */
+template<class T>
+class BufferPool
+{
+public:
+	typedef std::vector<T, AlignedAllocator<T, 64> > Buffer;
+
+	///@brief Reference to a pooled Buffer, which goes back to the pool when the last reference goes away
+	typedef std::shared_ptr<Buffer> BufferPtr;
+
+	/**
+		@param maxCount	Maximum number of idle buffers
+		@param maxBytes	Maximum total size of the idle buffers
+	 */
+	BufferPool(size_t maxCount, size_t maxBytes)
+		: m_idleBytes(0)
+		, m_lentBytes(0)
+		, m_maxCount(maxCount)
+		, m_maxBytes(maxBytes)
+	{
+	}
+
+	~BufferPool()
+	{ Clear(); }
+
+	/**
+		@brief Borrows a buffer of at least len elements
+
+		Contents are undefined.
+	 */
+	BufferPtr Get(size_t len)
+	{
+		Buffer* buf = NULL;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			//Use the smallest idle buffer that's big enough
+			size_t best = m_idle.size();
+			for(size_t i=0; i<m_idle.size(); i++)
+			{
+				size_t cur = m_idle[i]->size();
+				if( (cur >= len) && ( (best == m_idle.size()) || (cur < m_idle[best]->size()) ) )
+					best = i;
+			}
+
+			if(best < m_idle.size())
+			{
+				buf = m_idle[best];
+				m_idle.erase(m_idle.begin() + best);
+				m_idleBytes -= GetBytes(buf);
+				m_lentBytes += GetBytes(buf);
+			}
+			else
+				m_lentBytes += len * sizeof(T);
+		}
+
+		if(!buf)
+			buf = new Buffer(len);
+
+		return BufferPtr(buf, [this](Buffer* b) { Release(b); });
+	}
+
+	///@brief Sets the maximum number of idle buffers, freeing any over the limit
+	void SetMaxCount(size_t count)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_maxCount = count;
+		Trim();
+	}
+
+	///@brief Sets the maximum total size of the idle buffers, freeing idle buffers (largest first) until it fits
+	void SetMaxMemory(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_maxBytes = bytes;
+		Trim();
+	}
+
+	///@brief Gets the maximum total size of the idle buffers
+	size_t GetMaxMemory()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_maxBytes;
+	}
+
+	///@brief Gets the total size, in bytes, of all buffers belonging to the pool (idle or currently lent out)
+	size_t GetMemoryUsage()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_idleBytes + m_lentBytes;
+	}
+
+	///@brief Frees all idle buffers
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for(auto b : m_idle)
+			delete b;
+		m_idle.clear();
+		m_idleBytes = 0;
+	}
+
+protected:
+
+	static size_t GetBytes(Buffer* buf)
+	{ return buf->size() * sizeof(T); }
+
+	///@brief Returns a buffer to the pool, or frees it if the pool is full
+	void Release(Buffer* buf)
+	{
+		size_t bytes = GetBytes(buf);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_lentBytes -= bytes;
+			if( (m_idle.size() < m_maxCount) && (m_idleBytes + bytes <= m_maxBytes) )
+			{
+				m_idle.push_back(buf);
+				m_idleBytes += bytes;
+				return;
+			}
+		}
+
+		delete buf;
+	}
+
+	///@brief Frees the largest idle buffers until the pool is within its limits (call with m_mutex held)
+	void Trim()
+	{
+		while( !m_idle.empty() && ( (m_idle.size() > m_maxCount) || (m_idleBytes > m_maxBytes) ) )
+		{
+			size_t biggest = 0;
+			for(size_t i=1; i<m_idle.size(); i++)
+			{
+				if(m_idle[i]->size() > m_idle[biggest]->size())
+					biggest = i;
+			}
+
+			m_idleBytes -= GetBytes(m_idle[biggest]);
+			delete m_idle[biggest];
+			m_idle.erase(m_idle.begin() + biggest);
+		}
+	}
+
+	std::mutex m_mutex;
+
+	///@brief Buffers not currently lent out
+	std::vector<Buffer*> m_idle;
+
+	///@brief Total size of the buffers in m_idle
+	size_t m_idleBytes;
+
+	///@brief Total size of the buffers currently lent out
+	size_t m_lentBytes;
+
+	size_t m_maxCount;
+	size_t m_maxBytes;
+};
+
+#endif
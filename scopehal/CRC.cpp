@@ -0,0 +1,244 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of CRC
+ */
+#include "scopehal.h"
+#include "CRC.h"
+#include <immintrin.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates a calculator for a CRC
+
+	@param poly		Generator polynomial in bit-reversed form, without the leading x^n term
+					(e.g. 0xedb88320 for CRC-32, 0xa001 for CRC-16/USB)
+ */
+CRC::CRC(uint32_t poly)
+	: m_poly(poly)
+{
+	for(uint32_t b=0; b<256; b++)
+	{
+		uint32_t crc = b;
+		for(int i=0; i<8; i++)
+			crc = (crc >> 1) ^ ( (crc & 1) ? poly : 0 );
+		m_table[0][b] = crc;
+	}
+
+	for(int k=1; k<8; k++)
+	{
+		for(int b=0; b<256; b++)
+			m_table[k][b] = (m_table[k-1][b] >> 8) ^ m_table[0][m_table[k-1][b] & 0xff];
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Standard polynomials
+
+///@brief CRC-32 as used by Ethernet, PCIe TLPs, etc (x^32 + x^26 + x^23 + ... + x + 1)
+const CRC& CRC::GetCRC32()
+{
+	static CRC crc(0xedb88320);
+	return crc;
+}
+
+///@brief CRC-16 as used by USB data packets (x^16 + x^15 + x^2 + 1)
+const CRC& CRC::GetCRC16()
+{
+	static CRC crc(0xa001);
+	return crc;
+}
+
+///@brief CRC-16-CCITT as used by MIPI DSI, SD, etc (x^16 + x^12 + x^5 + 1)
+const CRC& CRC::GetCRC16CCITT()
+{
+	static CRC crc(0x8408);
+	return crc;
+}
+
+///@brief CRC-16 as used by PCIe DLLPs (x^16 + x^15 + x^13 + x^12 + x^11 + x^10 + x^8 + x^5 + x^3 + x^2 + x + 1)
+const CRC& CRC::GetCRC16PCIe()
+{
+	static CRC crc(0xd008);
+	return crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Calculation
+
+/**
+	@brief Folds a block of bytes into the CRC register
+
+	@param crc		Current register value (the protocol's initial value for a new packet)
+	@param data		Bytes to process, in transmission order
+	@param len		Number of bytes
+
+	@return The updated register value, before any output inversion or byte swapping
+ */
+uint32_t CRC::Update(uint32_t crc, const uint8_t* data, size_t len) const
+{
+	if( (m_poly == 0xedb88320) && g_hasPclmul && (len >= 64) )
+	{
+		size_t blocklen = len & ~(size_t)15;
+		crc = UpdateCRC32PCLMUL(crc, data, blocklen);
+		data += blocklen;
+		len -= blocklen;
+	}
+
+	return UpdateSliceBy8(crc, data, len);
+}
+
+uint32_t CRC::UpdateSliceBy8(uint32_t crc, const uint8_t* data, size_t len) const
+{
+	//Fold eight bytes at a time. Since the register is reflected, the CRC lines up with the first four bytes
+	//(in little endian order) no matter how wide it is.
+	while(len >= 8)
+	{
+		uint32_t lo;
+		uint32_t hi;
+		memcpy(&lo, data, 4);
+		memcpy(&hi, data+4, 4);
+		lo ^= crc;
+
+		crc =	m_table[7][lo & 0xff] ^
+				m_table[6][(lo >> 8) & 0xff] ^
+				m_table[5][(lo >> 16) & 0xff] ^
+				m_table[4][lo >> 24] ^
+				m_table[3][hi & 0xff] ^
+				m_table[2][(hi >> 8) & 0xff] ^
+				m_table[1][(hi >> 16) & 0xff] ^
+				m_table[0][hi >> 24];
+
+		data += 8;
+		len -= 8;
+	}
+
+	for(size_t i=0; i<len; i++)
+		crc = Update(crc, data[i]);
+
+	return crc;
+}
+
+/**
+	@brief CRC-32 using carry-less multiplication
+
+	Folds four 128-bit lanes in parallel, then reduces to 32 bits with a Barrett reduction. Constants are the
+	bit-reflected x^n mod P(x) values from Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+	Instruction" white paper.
+
+	@param len		Number of bytes. Must be a multiple of 16 and at least 64.
+ */
+__attribute__((target("pclmul,sse4.1")))
+uint32_t CRC::UpdateCRC32PCLMUL(uint32_t crc, const uint8_t* data, size_t len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_setr_epi32(-1, 0, -1, 0);
+
+	__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+	__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+	__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	data += 64;
+	len -= 64;
+
+	//Fold 64 bytes at a time
+	while(len >= 64)
+	{
+		__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		__m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		__m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)));
+
+		data += 64;
+		len -= 64;
+	}
+
+	//Fold the four lanes into one
+	__m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	//Fold any remaining 16-byte blocks
+	while(len >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data))), x5);
+
+		data += 16;
+		len -= 16;
+	}
+
+	//Fold 128 bits down to 64
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	//Barrett reduction to 32 bits
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
@@ -0,0 +1,88 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of CRC
+ */
+#ifndef CRC_h
+#define CRC_h
+
+/**
+	@brief Table-driven calculator for reflected (LSB-first) CRCs up to 32 bits wide
+
+	Protocol decoders used to each carry their own bit-at-a-time CRC loop, which costs eight shift/XOR steps per byte
+	and dominates decode time for long packets. This class precomputes slice-by-8 tables for a polynomial so eight
+	bytes are folded into the CRC with eight table lookups. For the standard CRC-32 polynomial, buffers of 64 bytes or
+	more are folded with carry-less multiplication (PCLMULQDQ) when the CPU supports it.
+
+	Only the raw register update is provided. Initial values, output inversion, and byte ordering differ between
+	protocols and are left to the caller, so e.g. a decoder which previously did
+
+		crc = 0xffff;
+		for(each byte) for(each bit) ...;
+		return ~crc;
+
+	becomes ~CRC::GetCRC16().Update(0xffff, data, len).
+
+	Instances are immutable after construction and may be shared between threads.
+ */
+class CRC
+{
+public:
+	CRC(uint32_t poly);
+
+	///@brief Gets the bit-reversed polynomial this calculator was built for
+	uint32_t GetPolynomial() const
+	{ return m_poly; }
+
+	///@brief Folds a single byte into the CRC register
+	uint32_t Update(uint32_t crc, uint8_t data) const
+	{ return m_table[0][(crc ^ data) & 0xff] ^ (crc >> 8); }
+
+	uint32_t Update(uint32_t crc, const uint8_t* data, size_t len) const;
+
+	static const CRC& GetCRC32();
+	static const CRC& GetCRC16();
+	static const CRC& GetCRC16CCITT();
+	static const CRC& GetCRC16PCIe();
+
+protected:
+	uint32_t UpdateSliceBy8(uint32_t crc, const uint8_t* data, size_t len) const;
+	static uint32_t UpdateCRC32PCLMUL(uint32_t crc, const uint8_t* data, size_t len);
+
+	///@brief Bit-reversed polynomial
+	uint32_t m_poly;
+
+	///@brief Slice-by-8 tables. m_table[k][b] is the CRC of byte b followed by k zero bytes
+	uint32_t m_table[8][256];
+};
+
+#endif
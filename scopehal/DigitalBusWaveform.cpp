@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of DigitalBusWaveform
+ */
+
+#include "scopehal.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates an empty bus waveform
+
+	@param width	Number of bits in the bus
+ */
+DigitalBusWaveform::DigitalBusWaveform(size_t width)
+	: m_size(0)
+	, m_width(0)
+	, m_stride(1)
+	, m_mask(0)
+{
+	SetWidth(width);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Changes the width of the bus.
+
+	If the storage size per sample changes, any existing samples are discarded. Widths above 64 bits are clamped.
+ */
+void DigitalBusWaveform::SetWidth(size_t width)
+{
+	if(width > 64)
+	{
+		LogError("DigitalBusWaveform: bus width %zu is too large, clamping to 64 bits\n", width);
+		width = 64;
+	}
+
+	m_width = width;
+	if(width == 64)
+		m_mask = ~0ULL;
+	else
+		m_mask = (1ULL << width) - 1;
+
+	size_t stride;
+	if(width <= 8)
+		stride = 1;
+	else if(width <= 16)
+		stride = 2;
+	else if(width <= 32)
+		stride = 4;
+	else
+		stride = 8;
+
+	if(stride != m_stride)
+	{
+		m_stride = stride;
+		clear();
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Conversion to/from vector<bool>
+
+/**
+	@brief Unpacks one sample into a vector with one element per bus line (line 0 first)
+ */
+void DigitalBusWaveform::GetBits(size_t i, vector<bool>& bits)
+{
+	uint64_t value = GetSample(i);
+	bits.resize(m_width);
+	for(size_t j=0; j<m_width; j++)
+		bits[j] = (value >> j) & 1;
+}
+
+/**
+	@brief Packs a vector with one element per bus line (line 0 first) into one sample
+
+	Elements past the bus width are ignored.
+ */
+void DigitalBusWaveform::SetBits(size_t i, const vector<bool>& bits)
+{
+	uint64_t value = 0;
+	size_t n = min(bits.size(), m_width);
+	for(size_t j=0; j<n; j++)
+	{
+		if(bits[j])
+			value |= (1ULL << j);
+	}
+	SetSample(i, value);
+}
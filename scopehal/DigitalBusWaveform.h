@@ -0,0 +1,179 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of DigitalBusWaveform
+ */
+
+#ifndef DigitalBusWaveform_h
+#define DigitalBusWaveform_h
+
+#include "Waveform.h"
+
+/**
+	@brief A parallel bus waveform with a fixed bit width, stored as one packed integer per sample
+
+	Each sample is stored little endian in the smallest of 1, 2, 4 or 8 bytes which can hold the bus (see GetStride()),
+	contiguously in m_data, so a 32-bit bus costs four bytes per sample rather than a heap allocated vector. Bit j of a
+	sample is bus line j. Buses wider than 64 bits are not supported.
+
+	Hot loops which know the stride can use GetSampleBuffer<T>() to access the samples as a plain array of T.
+	GetBits() and SetBits() convert individual samples to and from vector<bool> for legacy code.
+
+	Timestamps work as for any other waveform, including implicit timestamps when dense packed.
+ */
+class DigitalBusWaveform : public WaveformBase
+{
+public:
+	DigitalBusWaveform(size_t width = 8);
+
+	typedef std::vector< uint8_t, AlignedAllocator<uint8_t, 64> > ByteVector;
+
+	///@brief Packed sample data, GetStride() bytes per sample
+	ByteVector m_data;
+
+	///@brief Gets the number of samples in the waveform
+	virtual size_t size()
+	{ return m_size; }
+
+	virtual size_t capacity()
+	{ return m_data.capacity() / m_stride; }
+
+	virtual size_t GetAllocatedSize()
+	{ return WaveformBase::GetAllocatedSize() + m_data.capacity(); }
+
+	void SetWidth(size_t width);
+
+	///@brief Gets the number of bits in the bus
+	size_t GetWidth()
+	{ return m_width; }
+
+	///@brief Gets the number of bytes used to store each sample
+	size_t GetStride()
+	{ return m_stride; }
+
+	///@brief Gets a pointer to the samples as an array of T, which must be exactly GetStride() bytes in size
+	template<class T>
+	T* GetSampleBuffer()
+	{ return reinterpret_cast<T*>(&m_data[0]); }
+
+	///@brief Gets the value of the bus at one sample
+	uint64_t GetSample(size_t i)
+	{
+		uint8_t* p = &m_data[i * m_stride];
+		switch(m_stride)
+		{
+			case 1:		return *p;
+			case 2:		return *reinterpret_cast<uint16_t*>(p);
+			case 4:		return *reinterpret_cast<uint32_t*>(p);
+			default:	return *reinterpret_cast<uint64_t*>(p);
+		}
+	}
+
+	///@brief Sets the value of the bus at one sample (bits past the bus width are discarded)
+	void SetSample(size_t i, uint64_t value)
+	{
+		value &= m_mask;
+		uint8_t* p = &m_data[i * m_stride];
+		switch(m_stride)
+		{
+			case 1:		*p = value;									break;
+			case 2:		*reinterpret_cast<uint16_t*>(p) = value;	break;
+			case 4:		*reinterpret_cast<uint32_t*>(p) = value;	break;
+			default:	*reinterpret_cast<uint64_t*>(p) = value;	break;
+		}
+	}
+
+	///@brief Gets a single bus line at one sample
+	bool GetBit(size_t i, size_t bit)
+	{ return (GetSample(i) >> bit) & 1; }
+
+	void GetBits(size_t i, std::vector<bool>& bits);
+	void SetBits(size_t i, const std::vector<bool>& bits);
+
+	/**
+		@brief Appends a sample to the end of the waveform.
+
+		Only the sample data is appended. Callers building a waveform with explicit timestamps must push the offset
+		and duration themselves, as with other waveform types.
+	 */
+	void AppendSample(uint64_t value)
+	{
+		m_data.resize(m_data.size() + m_stride);
+		m_size ++;
+		SetSample(m_size - 1, value);
+	}
+
+	/**
+		@brief Resizes the waveform.
+
+		Newly added samples are zero. If the waveform previously had implicit timestamps, they're filled in so that
+		m_offsets and m_durations are valid afterwards.
+	 */
+	virtual void Resize(size_t size)
+	{
+		ResizeTimestamps(size, false);
+		m_size = size;
+		m_data.resize(size * m_stride, 0);
+	}
+
+	///@brief Resizes the waveform, marks it as dense packed, and makes the timestamps implicit
+	void ResizeImplicit(size_t size)
+	{
+		ResizeTimestamps(size, true);
+		m_size = size;
+		m_data.resize(size * m_stride, 0);
+	}
+
+	virtual void clear()
+	{
+		m_size = 0;
+		m_offsets.clear();
+		m_durations.clear();
+		m_data.clear();
+		MarkModified();
+	}
+
+protected:
+	///@brief Number of samples
+	size_t m_size;
+
+	///@brief Number of bits in the bus
+	size_t m_width;
+
+	///@brief Number of bytes per sample
+	size_t m_stride;
+
+	///@brief Mask of the valid bits in a sample
+	uint64_t m_mask;
+};
+
+#endif
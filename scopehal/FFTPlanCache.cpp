@@ -0,0 +1,235 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FFTPlanCache
+ */
+#include "scopehal.h"
+#include "FFTPlanCache.h"
+#include <omp.h>
+
+using namespace std;
+
+/**
+	@brief Approximate memory used by an ffts plan, in bytes per point
+
+	ffts doesn't report plan sizes. Its twiddle tables and working buffers come to roughly one complex float (plus
+	lookup tables) per point, so this is an estimate only.
+ */
+static const size_t g_planBytesPerPoint = 16;
+
+/**
+	@brief Default maximum total size of idle scratch buffers
+
+	Enough for the input and output of a 32M point FFT to stay around between refreshes. Anything deeper is
+	allocated fresh each time rather than pinned for the life of the process.
+ */
+static const size_t g_defaultMaxScratchBytes = 512LL * 1024 * 1024;
+
+mutex FFTPlanCache::m_mutex;
+multimap<FFTPlanCache::KeyType, ffts_plan_t*> FFTPlanCache::m_idlePlans;
+BufferPool<float> FFTPlanCache::m_scratchPool(GetDefaultScratchBufferCount(), g_defaultMaxScratchBytes);
+size_t FFTPlanCache::m_maxIdlePlansPerKey = 0;
+atomic<uint64_t> FFTPlanCache::m_planPoints(0);
+atomic<uint64_t> FFTPlanCache::m_planHits(0);
+atomic<uint64_t> FFTPlanCache::m_planMisses(0);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Limits
+
+/**
+	@brief Sets how many unused plans and scratch buffers are kept around for reuse
+
+	Every OpenMP thread may be running an FFT at once, so limits below omp_get_max_threads() make the cache free and
+	recreate plans on every refresh.
+
+	@param plansPerKey		Maximum number of idle plans of any one size and direction, or 0 for the default
+							(one per OpenMP thread, and at least 8)
+	@param scratchBuffers	Maximum number of idle scratch buffers, or 0 for the default (two per OpenMP thread,
+							and at least 16)
+ */
+void FFTPlanCache::SetIdleLimits(size_t plansPerKey, size_t scratchBuffers)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_maxIdlePlansPerKey = plansPerKey;
+	}
+
+	m_scratchPool.SetMaxCount(scratchBuffers ? scratchBuffers : GetDefaultScratchBufferCount());
+}
+
+/**
+	@brief Gets the maximum number of idle plans of any one size and direction (call with m_mutex held)
+ */
+size_t FFTPlanCache::GetMaxIdlePlansPerKey()
+{
+	if(m_maxIdlePlansPerKey)
+		return m_maxIdlePlansPerKey;
+	return max<size_t>(8, omp_get_max_threads());
+}
+
+/**
+	@brief Gets the default maximum number of idle scratch buffers
+
+	Filters typically borrow an input and an output buffer at once, hence two per thread.
+ */
+size_t FFTPlanCache::GetDefaultScratchBufferCount()
+{
+	return max<size_t>(16, 2 * omp_get_max_threads());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Plans
+
+/**
+	@brief Borrows a plan for a 1D FFT of real data
+
+	@param npoints		Number of points
+	@param direction	FFTS_FORWARD or FFTS_BACKWARD
+ */
+FFTPlanCache::PlanPtr FFTPlanCache::GetRealPlan(size_t npoints, int direction)
+{
+	return GetPlan(KeyType(npoints, direction, true));
+}
+
+/**
+	@brief Borrows a plan for a 1D FFT of complex data
+
+	@param npoints		Number of points
+	@param direction	FFTS_FORWARD or FFTS_BACKWARD
+ */
+FFTPlanCache::PlanPtr FFTPlanCache::GetComplexPlan(size_t npoints, int direction)
+{
+	return GetPlan(KeyType(npoints, direction, false));
+}
+
+FFTPlanCache::PlanPtr FFTPlanCache::GetPlan(KeyType key)
+{
+	ffts_plan_t* plan = NULL;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto it = m_idlePlans.find(key);
+		if(it != m_idlePlans.end())
+		{
+			plan = it->second;
+			m_idlePlans.erase(it);
+		}
+	}
+
+	if(plan)
+		m_planHits ++;
+	else
+	{
+		m_planMisses ++;
+		if(get<2>(key))
+			plan = ffts_init_1d_real(get<0>(key), get<1>(key));
+		else
+			plan = ffts_init_1d(get<0>(key), get<1>(key));
+		if(plan)
+			m_planPoints += get<0>(key);
+	}
+
+	return PlanPtr(plan, [key](ffts_plan_t* p) { ReleasePlan(key, p); });
+}
+
+/**
+	@brief Returns a plan to the cache, or frees it if we already have plenty of that size
+ */
+void FFTPlanCache::ReleasePlan(KeyType key, ffts_plan_t* plan)
+{
+	if(plan == NULL)
+		return;
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if(m_idlePlans.count(key) < GetMaxIdlePlansPerKey())
+		{
+			m_idlePlans.insert(make_pair(key, plan));
+			return;
+		}
+	}
+
+	m_planPoints -= get<0>(key);
+	ffts_free(plan);
+}
+
+/**
+	@brief Gets the number of plans not currently in use
+ */
+size_t FFTPlanCache::GetIdlePlanCount()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_idlePlans.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scratch buffers
+
+/**
+	@brief Borrows a scratch buffer of at least len floats
+
+	Contents are undefined, and the buffer may be bigger than requested.
+ */
+FFTPlanCache::ScratchBufferPtr FFTPlanCache::GetScratchBuffer(size_t len)
+{
+	return m_scratchPool.Get(len);
+}
+
+/**
+	@brief Gets the approximate memory, in bytes, used by the cache
+
+	This counts every scratch buffer and plan the cache has handed out and not freed, whether idle or currently lent
+	out. Plan sizes are estimated (see g_planBytesPerPoint).
+ */
+size_t FFTPlanCache::GetScratchMemoryUsage()
+{
+	return m_scratchPool.GetMemoryUsage() + m_planPoints * g_planBytesPerPoint;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache management
+
+/**
+	@brief Frees all idle plans and scratch buffers
+ */
+void FFTPlanCache::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	for(auto it : m_idlePlans)
+	{
+		m_planPoints -= get<0>(it.first);
+		ffts_free(it.second);
+	}
+	m_idlePlans.clear();
+
+	m_scratchPool.Clear();
+}
@@ -0,0 +1,122 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FFTPlanCache
+ */
+#ifndef FFTPlanCache_h
+#define FFTPlanCache_h
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+#include <ffts.h>
+#include "BufferPool.h"
+
+/**
+	@brief Process-wide cache of FFT plans and scratch buffers, shared by all filters
+
+	Creating an ffts plan computes twiddle factors and allocates working memory, which isn't cheap for large sizes.
+	Rather than each filter keeping its own plans (and recreating them whenever the point count changes), filters
+	borrow a plan for the duration of a refresh and hand it back when done. Since a plan holds scratch space, a plan is
+	only ever lent to one thread at a time; if several threads want the same size at once, extra plans are created.
+
+	Scratch buffers for zero padded FFT inputs and outputs are pooled the same way (see BufferPool), so a dozen
+	spectral filters share a few large buffers rather than each holding their own.
+
+	Both are handed out as shared_ptrs which return the object to the cache when the last reference goes away.
+ */
+class FFTPlanCache
+{
+public:
+
+	///@brief Reference to a borrowed FFT plan
+	typedef std::shared_ptr<ffts_plan_t> PlanPtr;
+
+	typedef BufferPool<float>::Buffer ScratchBuffer;
+
+	///@brief Reference to a borrowed scratch buffer
+	typedef BufferPool<float>::BufferPtr ScratchBufferPtr;
+
+	static PlanPtr GetRealPlan(size_t npoints, int direction);
+	static PlanPtr GetComplexPlan(size_t npoints, int direction);
+
+	static ScratchBufferPtr GetScratchBuffer(size_t len);
+
+	static void Clear();
+	static void SetIdleLimits(size_t plansPerKey, size_t scratchBuffers);
+
+	///@brief Sets the maximum total size, in bytes, of idle scratch buffers
+	static void SetMaxScratchMemory(size_t bytes)
+	{ m_scratchPool.SetMaxMemory(bytes); }
+
+	///@brief Gets the number of plan requests satisfied by an existing plan
+	static uint64_t GetPlanHitCount()
+	{ return m_planHits; }
+
+	///@brief Gets the number of plan requests which had to create a new plan
+	static uint64_t GetPlanMissCount()
+	{ return m_planMisses; }
+
+	static size_t GetIdlePlanCount();
+	static size_t GetScratchMemoryUsage();
+
+protected:
+	///@brief Plan size, direction, and true for real input
+	typedef std::tuple<size_t, int, bool> KeyType;
+
+	static PlanPtr GetPlan(KeyType key);
+	static void ReleasePlan(KeyType key, ffts_plan_t* plan);
+	static size_t GetMaxIdlePlansPerKey();
+	static size_t GetDefaultScratchBufferCount();
+
+	static std::mutex m_mutex;
+
+	///@brief Plans not currently lent out
+	static std::multimap<KeyType, ffts_plan_t*> m_idlePlans;
+
+	///@brief Scratch buffers, idle or lent out
+	static BufferPool<float> m_scratchPool;
+
+	///@brief Idle plan limit set by SetIdleLimits(), or 0 for the default
+	static size_t m_maxIdlePlansPerKey;
+
+	///@brief Total point count of all plans in existence (idle or lent out), for memory usage estimates
+	static std::atomic<uint64_t> m_planPoints;
+
+	static std::atomic<uint64_t> m_planHits;
+	static std::atomic<uint64_t> m_planMisses;
+};
+
+#endif
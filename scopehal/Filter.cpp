@@ -35,14 +35,16 @@
 
 #include "scopehal.h"
 #include "Filter.h"
+#include <immintrin.h>
+#include <omp.h>
 
 using namespace std;
 
 Filter::CreateMapType Filter::m_createprocs;
 set<Filter*> Filter::m_filters;
 
-mutex Filter::m_cacheMutex;
-map<pair<WaveformBase*, float>, vector<int64_t> > Filter::m_zeroCrossingCache;
+ZeroCrossingCache Filter::m_zeroCrossingCache;
+SampledBitstreamCache Filter::m_sampledBitstreamCache;
 
 Gdk::Color Filter::m_standardColors[STANDARD_COLOR_COUNT] =
 {
@@ -234,13 +236,13 @@ bool Filter::VerifyInputOK(size_t i, bool allowEmpty)
 
 	if(p.m_channel == NULL)
 		return false;
-	auto data = p.GetData();
+	auto data = p.GetDataImplicit();
 	if(data == NULL)
 		return false;
 
 	if(!allowEmpty)
 	{
-		if(data->m_offsets.size() == 0)
+		if(data->size() == 0)
 			return false;
 	}
 
@@ -271,10 +273,10 @@ bool Filter::VerifyAllInputsOKAndAnalog()
 		if(p.m_channel == NULL)
 			return false;
 
-		auto data = p.m_channel->GetData(p.m_stream);
+		auto data = p.m_channel->GetDataImplicit(p.m_stream);
 		if(data == NULL)
 			return false;
-		if(data->m_offsets.size() == 0)
+		if(data->size() == 0)
 			return false;
 
 		auto adata = dynamic_cast<AnalogWaveform*>(data);
@@ -347,11 +349,12 @@ void Filter::SampleOnRisingEdges(DigitalWaveform* data, DigitalWaveform* clock,
  */
 void Filter::SampleOnRisingEdges(DigitalBusWaveform* data, DigitalWaveform* clock, DigitalBusWaveform& samples)
 {
+	samples.SetWidth(data->GetWidth());
 	samples.clear();
 
 	size_t ndata = 0;
 	size_t len = clock->m_offsets.size();
-	size_t dlen = data->m_samples.size();
+	size_t dlen = data->size();
 	for(size_t i=1; i<len; i++)
 	{
 		//Throw away clock samples until we find a rising edge
@@ -366,7 +369,7 @@ void Filter::SampleOnRisingEdges(DigitalBusWaveform* data, DigitalWaveform* cloc
 			break;
 
 		//Extend the previous sample's duration (if any) to our start
-		size_t ssize = samples.m_samples.size();
+		size_t ssize = samples.size();
 		if(ssize)
 		{
 			size_t last = ssize - 1;
@@ -376,7 +379,7 @@ void Filter::SampleOnRisingEdges(DigitalBusWaveform* data, DigitalWaveform* cloc
 		//Add the new sample
 		samples.m_offsets.push_back(clkstart);
 		samples.m_durations.push_back(1);
-		samples.m_samples.push_back(data->m_samples[ndata]);
+		samples.AppendSample(data->GetSample(ndata));
 	}
 }
 
@@ -485,11 +488,12 @@ void Filter::SampleOnAnyEdges(DigitalWaveform* data, DigitalWaveform* clock, Dig
  */
 void Filter::SampleOnAnyEdges(DigitalBusWaveform* data, DigitalWaveform* clock, DigitalBusWaveform& samples)
 {
+	samples.SetWidth(data->GetWidth());
 	samples.clear();
 
 	size_t ndata = 0;
 	size_t len = clock->m_offsets.size();
-	size_t dlen = data->m_samples.size();
+	size_t dlen = data->size();
 	for(size_t i=1; i<len; i++)
 	{
 		//Throw away clock samples until we find an edge
@@ -504,7 +508,7 @@ void Filter::SampleOnAnyEdges(DigitalBusWaveform* data, DigitalWaveform* clock,
 			break;
 
 		//Extend the previous sample's duration (if any) to our start
-		size_t ssize = samples.m_samples.size();
+		size_t ssize = samples.size();
 		if(ssize)
 		{
 			size_t last = ssize - 1;
@@ -514,182 +518,682 @@ void Filter::SampleOnAnyEdges(DigitalBusWaveform* data, DigitalWaveform* clock,
 		//Add the new sample
 		samples.m_offsets.push_back(clkstart);
 		samples.m_durations.push_back(1);
-		samples.m_samples.push_back(data->m_samples[ndata]);
+		samples.AppendSample(data->GetSample(ndata));
 	}
 }
 
 /**
-	@brief Find zero crossings in a waveform, interpolating as necessary
+	@brief Samples a packed digital waveform on the edges of a packed clock
+
+	Same semantics as the DigitalWaveform versions, but the clock edge search runs a word at a time and dense packed
+	data is indexed directly rather than walked sample by sample.
+
+	@param data		The data signal to sample
+	@param clock	The clock signal to use
+	@param type		Clock edge polarity to sample on
+	@param samples	Output waveform
  */
-void Filter::FindZeroCrossings(AnalogWaveform* data, float threshold, vector<int64_t>& edges)
+void Filter::SampleOnPackedEdges(
+	PackedDigitalWaveform* data,
+	PackedDigitalWaveform* clock,
+	EdgeType type,
+	DigitalWaveform& samples)
 {
-	pair<WaveformBase*, float> cachekey(data, threshold);
+	samples.clear();
 
-	//Check cache
+	size_t dlen = data->size();
+	if(dlen == 0)
+		return;
+
+	size_t ndata = 0;
+	ForEachPackedEdge(clock, type, 1, clock->size(),
+		[&](size_t i)
+		{
+			//Throw away data samples until the data is synced with us
+			int64_t clkstart = clock->GetOffset(i) * clock->m_timescale;
+			if(data->m_densePacked)
+			{
+				//Last data sample starting before the clock edge
+				if(clkstart > 0)
+				{
+					size_t n = (clkstart - 1) / data->m_timescale;
+					ndata = max(ndata, min(n, dlen-1));
+				}
+			}
+			else
+			{
+				while( (ndata+1 < dlen) && (data->GetOffset(ndata+1) * data->m_timescale < clkstart) )
+					ndata ++;
+			}
+
+			//Extend the previous sample's duration (if any) to our start
+			size_t ssize = samples.m_samples.size();
+			if(ssize)
+			{
+				size_t last = ssize - 1;
+				samples.m_durations[last] = clkstart - samples.m_offsets[last];
+			}
+
+			//Add the new sample
+			samples.m_offsets.push_back(clkstart);
+			samples.m_durations.push_back(1);
+			samples.m_samples.push_back(data->GetSample(ndata));
+		});
+}
+
+/**
+	@brief Samples a packed digital waveform on the rising edges of a packed clock
+ */
+void Filter::SampleOnRisingEdges(PackedDigitalWaveform* data, PackedDigitalWaveform* clock, DigitalWaveform& samples)
+{
+	SampleOnPackedEdges(data, clock, EDGE_RISING, samples);
+}
+
+/**
+	@brief Samples a packed digital waveform on the falling edges of a packed clock
+ */
+void Filter::SampleOnFallingEdges(PackedDigitalWaveform* data, PackedDigitalWaveform* clock, DigitalWaveform& samples)
+{
+	SampleOnPackedEdges(data, clock, EDGE_FALLING, samples);
+}
+
+/**
+	@brief Samples a packed digital waveform on all edges of a packed clock
+ */
+void Filter::SampleOnAnyEdges(PackedDigitalWaveform* data, PackedDigitalWaveform* clock, DigitalWaveform& samples)
+{
+	SampleOnPackedEdges(data, clock, EDGE_ANY, samples);
+}
+
+/**
+	@brief Samples a digital waveform on the edges of a clock, sharing the result with other callers
+
+	Same semantics as SampleOnAnyEdges() / SampleOnRisingEdges() / SampleOnFallingEdges(), but the result is bit
+	packed with explicit per-UI timestamps (in femtoseconds) and cached by data revision, clock revision and edge
+	type. Filters such as DDJMeasurement and RjBUjFilter which sample the same signals only pay for it once per
+	waveform. The returned waveform is shared with the cache and must not be modified.
+
+	@param data		The data signal to sample
+	@param clock	The clock signal to use
+	@param type		Clock edge polarity to sample on
+ */
+SampledBitstreamCache::BitstreamPtr Filter::SampleBitstream(DigitalWaveform* data, DigitalWaveform* clock, EdgeType type)
+{
+	auto cached = m_sampledBitstreamCache.Find(data->m_revision, clock->m_revision, type);
+	if(cached)
+		return cached;
+
+	auto bits = make_shared<PackedDigitalWaveform>();
+	bits->m_densePacked = false;
+	bits->m_timescale = 1;
+	bits->m_startTimestamp = clock->m_startTimestamp;
+	bits->m_startFemtoseconds = clock->m_startFemtoseconds;
+
+	//Worst case is one UI per clock sample
+	size_t len = clock->m_offsets.size();
+	bits->m_offsets.reserve(len);
+	bits->m_durations.reserve(len);
+	bits->m_words.reserve(PackedDigitalWaveform::GetWordCount(len));
+
+	size_t ndata = 0;
+	size_t dlen = data->m_samples.size();
+	size_t nbits = 0;
+	uint64_t word = 0;
+	for(size_t i=1; i<len; i++)
 	{
-		lock_guard<mutex> lock(m_cacheMutex);
-		auto it = m_zeroCrossingCache.find(cachekey);
-		if(it != m_zeroCrossingCache.end())
+		//Throw away clock samples until we find an edge of the right polarity
+		bool cur = clock->m_samples[i];
+		if(cur == clock->m_samples[i-1])
+			continue;
+		if( (type == EDGE_RISING) && !cur )
+			continue;
+		if( (type == EDGE_FALLING) && cur )
+			continue;
+
+		//Throw away data samples until the data is synced with us
+		int64_t clkstart = clock->m_offsets[i] * clock->m_timescale;
+		while( (ndata+1 < dlen) && (data->m_offsets[ndata+1] * data->m_timescale < clkstart) )
+			ndata ++;
+		if(ndata >= dlen)
+			break;
+
+		//Extend the previous sample's duration (if any) to our start
+		if(nbits)
+			bits->m_durations[nbits-1] = clkstart - bits->m_offsets[nbits-1];
+
+		//Add the new sample, flushing each word as it fills
+		bits->m_offsets.push_back(clkstart);
+		bits->m_durations.push_back(1);
+		if(data->m_samples[ndata])
+			word |= 1ULL << (nbits % 64);
+		nbits ++;
+		if( (nbits % 64) == 0)
 		{
-			edges = it->second;
-			return;
+			bits->m_words.push_back(word);
+			word = 0;
 		}
 	}
+	if(nbits % 64)
+		bits->m_words.push_back(word);
 
-	//Find times of the zero crossings
-	bool first = true;
-	bool last = false;
-	int64_t phoff = data->m_triggerPhase;
-	size_t len = data->m_samples.size();
-	float fscale = data->m_timescale;
+	//Timestamps and words are already the right size, this just records the sample count
+	bits->Resize(nbits);
 
-	if(data->m_densePacked)
+	m_sampledBitstreamCache.Insert(data->m_revision, clock->m_revision, type, bits);
+	return bits;
+}
+
+/**
+	@brief Finds the symbol alignment of a 10-bit line code (8b/10b, TMDS, etc) from the positions of its sync symbols
+
+	Every bit position is checked against a lookup table of sync symbols, counting hits separately for each of the
+	ten possible phases, so all phases are searched in one pass. Rather than scanning the whole capture, the search
+	stops once one phase has clearly won: at least 32 sync symbols, and eight times as many as any other phase.
+
+	@param bits			Sampled data (see SampleBitstream())
+	@param syncTable	1024 entries, nonzero if the 10-bit value (with the earliest bit in the LSB) is a sync symbol
+
+	@return The bit offset (0-9) of the first symbol boundary
+ */
+size_t Filter::FindSymbolAlignment(PackedDigitalWaveform* bits, const uint8_t* syncTable)
+{
+	const size_t minSyncs = 32;
+	const size_t minRatio = 8;
+	const size_t chunkSize = 40960;
+
+	size_t counts[10] = {0};
+	size_t len = bits->size();
+	if(len < 10)
+		return 0;
+	size_t end = len - 10;
+
+	size_t best = 0;
+	for(size_t chunk = 0; chunk < end; chunk += chunkSize)
 	{
-		for(size_t i=1; i<len; i++)
+		size_t cend = min(end, chunk + chunkSize);
+		size_t phase = chunk % 10;
+		for(size_t i=chunk; i<cend; i++)
 		{
-			bool value = data->m_samples[i] > threshold;
-
-			//Save the last value
-			if(first)
-			{
-				last = value;
-				first = false;
-				continue;
-			}
+			if(syncTable[bits->ExtractBits(i, 10)])
+				counts[phase] ++;
 
-			//Skip samples with no transition
-			if(last == value)
-				continue;
+			phase ++;
+			if(phase == 10)
+				phase = 0;
+		}
 
-			//Midpoint of the sample, plus the zero crossing
-			int64_t tfrac = fscale * InterpolateTime(data, i-1, threshold);
-			int64_t t = phoff + data->m_timescale*(i-1) + tfrac;
-			edges.push_back(t);
-			last = value;
+		//Find the best and runner-up phases (ties go to the lowest offset)
+		best = 0;
+		for(size_t j=1; j<10; j++)
+		{
+			if(counts[j] > counts[best])
+				best = j;
 		}
-	}
-	else
-	{
-		for(size_t i=1; i<len; i++)
+		size_t second = 0;
+		for(size_t j=0; j<10; j++)
 		{
-			bool value = data->m_samples[i] > threshold;
+			if(j != best)
+				second = max(second, counts[j]);
+		}
 
-			//Save the last value
-			if(first)
-			{
-				last = value;
-				first = false;
-				continue;
-			}
+		//Stop once the winner is unambiguous
+		if( (counts[best] >= minSyncs) && (counts[best] >= minRatio * second) )
+			break;
+	}
 
-			//Skip samples with no transition
-			if(last == value)
-				continue;
+	return best;
+}
 
-			//Midpoint of the sample, plus the zero crossing
-			int64_t tfrac = fscale * InterpolateTime(data, i-1, threshold);
-			int64_t t = phoff + data->m_timescale * data->m_offsets[i-1] + tfrac;
-			edges.push_back(t);
-			last = value;
-		}
+/**
+	@brief Find zero crossings in a waveform, interpolating as necessary
+
+	Results are cached by waveform revision and threshold, so multiple filters looking at the same signal only pay
+	for the search once. The returned buffer is shared with the cache and must not be modified.
+ */
+ZeroCrossingCache::EdgeBuffer Filter::FindZeroCrossings(AnalogWaveform* data, float threshold)
+{
+	//Check cache
+	auto cached = m_zeroCrossingCache.Find(data->m_revision, threshold);
+	if(cached)
+		return cached;
+
+	//Find times of the zero crossings.
+	//The first sample is only used as the left side of an interpolation, never to detect a transition.
+	auto pedges = make_shared< vector<int64_t> >();
+	size_t len = data->m_samples.size();
+	if(len > 2)
+	{
+		FindEdgesParallel(2, len, *pedges,
+			[data, threshold](size_t start, size_t end, vector<int64_t>& edges)
+			{
+				if(g_hasAvx512F)
+					FindZeroCrossingsInnerAVX512F(data, threshold, start, end, edges);
+				else if(g_hasAvx2)
+					FindZeroCrossingsInnerAVX2(data, threshold, start, end, edges);
+				else
+					FindZeroCrossingsInner(data, threshold, start, end, edges);
+			});
 	}
 
 	//Add to cache
-	lock_guard<mutex> lock(m_cacheMutex);
-	m_zeroCrossingCache[cachekey] = edges;
+	m_zeroCrossingCache.Insert(data->m_revision, threshold, pedges);
+	return pedges;
 }
 
 /**
-	@brief Find edges in a waveform, discarding repeated samples
+	@brief Find zero crossings in a waveform, interpolating as necessary
+
+	Copies the edges into the caller's vector. Prefer the overload returning a shared buffer for large waveforms.
  */
-void Filter::FindZeroCrossings(DigitalWaveform* data, vector<int64_t>& edges)
+void Filter::FindZeroCrossings(AnalogWaveform* data, float threshold, vector<int64_t>& edges)
 {
-	//Find times of the zero crossings
-	bool first = true;
-	bool last = data->m_samples[0];
-	int64_t phoff = data->m_timescale/2 + data->m_triggerPhase;
-	size_t len = data->m_samples.size();
-	for(size_t i=1; i<len; i++)
+	edges = *FindZeroCrossings(data, threshold);
+}
+
+/**
+	@brief Gets the number of blocks to split a per-sample loop over len samples into for multithreading.
+
+	Normally one block per OpenMP thread, but fewer for short waveforms so that no block is smaller than
+	MIN_PARALLEL_BLOCK_SIZE. Returns 1 if the loop isn't worth multithreading at all.
+ */
+size_t Filter::GetParallelBlockCount(size_t len)
+{
+	size_t numblocks = min<size_t>(omp_get_max_threads(), len / MIN_PARALLEL_BLOCK_SIZE);
+	return max<size_t>(numblocks, 1);
+}
+
+/**
+	@brief Splits an edge search over [start, end) into blocks (see GetParallelBlockCount()), then appends each
+	block's edges to the output in order.
+
+	@param start	First sample index to search
+	@param end		One past the last sample index to search
+	@param edges	Output edge list
+	@param kernel	Function(start, end, edges) which appends edges found in [start, end) to edges
+ */
+template<class T>
+void Filter::FindEdgesParallel(size_t start, size_t end, vector<int64_t>& edges, T kernel)
+{
+	size_t len = end - start;
+	size_t numblocks = GetParallelBlockCount(len);
+	if(numblocks < 2)
 	{
-		bool value = data->m_samples[i];
+		kernel(start, end, edges);
+		return;
+	}
 
-		//Save the last value
-		if(first)
-		{
-			last = value;
-			first = false;
-			continue;
-		}
+	//Round blocks to multiples of 64 samples for clean vectorization
+	size_t lastblock = numblocks - 1;
+	size_t blocksize = len / numblocks;
+	blocksize = blocksize - (blocksize % 64);
+
+	vector< vector<int64_t> > blockEdges(numblocks);
+
+	#pragma omp parallel for
+	for(size_t i=0; i<numblocks; i++)
+	{
+		//Last block gets any extra that didn't divide evenly
+		size_t bstart = start + i*blocksize;
+		size_t bend = bstart + blocksize;
+		if(i == lastblock)
+			bend = end;
+
+		kernel(bstart, bend, blockEdges[i]);
+	}
+
+	//Merge the blocks in order
+	size_t total = edges.size();
+	for(auto& b : blockEdges)
+		total += b.size();
+	edges.reserve(total);
+	for(auto& b : blockEdges)
+		edges.insert(edges.end(), b.begin(), b.end());
+}
+
+/**
+	@brief Gets the interpolated time of a threshold crossing between samples i-1 and i
+ */
+int64_t Filter::GetZeroCrossingTime(AnalogWaveform* data, size_t i, float threshold)
+{
+	int64_t tfrac = data->m_timescale * InterpolateTime(data, i-1, threshold);
+	if(data->m_densePacked)
+		return data->m_triggerPhase + data->m_timescale*(i-1) + tfrac;
+	else
+		return data->m_triggerPhase + data->m_timescale * data->m_offsets[i-1] + tfrac;
+}
 
+/**
+	@brief Finds threshold crossings between samples i-1 and i, for i in [start, end). Requires start >= 1.
+ */
+void Filter::FindZeroCrossingsInner(AnalogWaveform* data, float threshold, size_t start, size_t end, vector<int64_t>& edges)
+{
+	float* samples = (float*)&data->m_samples[0];
+
+	bool last = samples[start-1] > threshold;
+	for(size_t i=start; i<end; i++)
+	{
 		//Skip samples with no transition
+		bool value = samples[i] > threshold;
 		if(last == value)
 			continue;
 
-		edges.push_back(phoff + data->m_timescale * data->m_offsets[i]);
+		edges.push_back(GetZeroCrossingTime(data, i, threshold));
 		last = value;
 	}
 }
 
+__attribute__((target("avx2")))
+void Filter::FindZeroCrossingsInnerAVX2(
+	AnalogWaveform* data,
+	float threshold,
+	size_t start,
+	size_t end,
+	vector<int64_t>& edges)
+{
+	float* samples = (float*)&data->m_samples[0];
+	size_t len = end - start;
+	size_t vend = start + len - (len % 8);
+
+	//Compare each block of 8 samples, and the same block shifted back by one, against the threshold.
+	//XORing the two masks gives a bit for every sample that differs from the previous one.
+	__m256 vthresh = _mm256_set1_ps(threshold);
+	for(size_t i=start; i<vend; i+=8)
+	{
+		__m256 cur = _mm256_loadu_ps(samples + i);
+		__m256 prev = _mm256_loadu_ps(samples + i - 1);
+		unsigned int mcur = _mm256_movemask_ps(_mm256_cmp_ps(cur, vthresh, _CMP_GT_OQ));
+		unsigned int mprev = _mm256_movemask_ps(_mm256_cmp_ps(prev, vthresh, _CMP_GT_OQ));
+
+		unsigned int transitions = mcur ^ mprev;
+		while(transitions)
+		{
+			size_t j = __builtin_ctz(transitions);
+			edges.push_back(GetZeroCrossingTime(data, i+j, threshold));
+			transitions &= (transitions - 1);
+		}
+	}
+
+	//Get any extras
+	if(vend < end)
+		FindZeroCrossingsInner(data, threshold, vend, end, edges);
+}
+
+__attribute__((target("avx512f")))
+void Filter::FindZeroCrossingsInnerAVX512F(
+	AnalogWaveform* data,
+	float threshold,
+	size_t start,
+	size_t end,
+	vector<int64_t>& edges)
+{
+	float* samples = (float*)&data->m_samples[0];
+	size_t len = end - start;
+	size_t vend = start + len - (len % 16);
+
+	//Same as the AVX2 version, but the compare produces a mask directly
+	__m512 vthresh = _mm512_set1_ps(threshold);
+	for(size_t i=start; i<vend; i+=16)
+	{
+		__m512 cur = _mm512_loadu_ps(samples + i);
+		__m512 prev = _mm512_loadu_ps(samples + i - 1);
+		unsigned int mcur = _mm512_cmp_ps_mask(cur, vthresh, _CMP_GT_OQ);
+		unsigned int mprev = _mm512_cmp_ps_mask(prev, vthresh, _CMP_GT_OQ);
+
+		unsigned int transitions = mcur ^ mprev;
+		while(transitions)
+		{
+			size_t j = __builtin_ctz(transitions);
+			edges.push_back(GetZeroCrossingTime(data, i+j, threshold));
+			transitions &= (transitions - 1);
+		}
+	}
+
+	//Get any extras
+	if(vend < end)
+		FindZeroCrossingsInner(data, threshold, vend, end, edges);
+}
+
+/**
+	@brief Find edges in a waveform, discarding repeated samples
+ */
+void Filter::FindZeroCrossings(DigitalWaveform* data, vector<int64_t>& edges)
+{
+	FindDigitalEdges(data, EDGE_ANY, edges);
+}
+
 /**
 	@brief Find rising edges in a waveform
  */
 void Filter::FindRisingEdges(DigitalWaveform* data, vector<int64_t>& edges)
 {
-	//Find times of the zero crossings
-	bool first = true;
-	bool last = data->m_samples[0];
-	int64_t phoff = data->m_timescale/2 + data->m_triggerPhase;
+	FindDigitalEdges(data, EDGE_RISING, edges);
+}
+
+/**
+	@brief Find falling edges in a waveform
+ */
+void Filter::FindFallingEdges(DigitalWaveform* data, vector<int64_t>& edges)
+{
+	FindDigitalEdges(data, EDGE_FALLING, edges);
+}
+
+/**
+	@brief Find edges of the requested polarity in a digital waveform
+
+	As with the analog version, the first sample is never considered to be an edge.
+ */
+void Filter::FindDigitalEdges(DigitalWaveform* data, EdgeType type, vector<int64_t>& edges)
+{
 	size_t len = data->m_samples.size();
-	for(size_t i=1; i<len; i++)
-	{
-		bool value = data->m_samples[i];
+	if(len <= 2)
+		return;
 
-		//Save the last value
-		if(first)
+	FindEdgesParallel(2, len, edges,
+		[data, type](size_t start, size_t end, vector<int64_t>& blockEdges)
 		{
-			last = value;
-			first = false;
-			continue;
-		}
+			if(g_hasAvx2)
+				FindDigitalEdgesInnerAVX2(data, type, start, end, blockEdges);
+			else
+				FindDigitalEdgesInner(data, type, start, end, blockEdges);
+		});
+}
+
+/**
+	@brief Finds edges between samples i-1 and i, for i in [start, end). Requires start >= 1.
+ */
+void Filter::FindDigitalEdgesInner(DigitalWaveform* data, EdgeType type, size_t start, size_t end, vector<int64_t>& edges)
+{
+	int64_t phoff = data->m_timescale/2 + data->m_triggerPhase;
+	bool* samples = (bool*)&data->m_samples[0];
+
+	bool last = samples[start-1];
+	for(size_t i=start; i<end; i++)
+	{
+		bool value = samples[i];
 
 		//Save samples with an edge
-		if(value && !last)
-			edges.push_back(phoff + data->m_timescale * data->m_offsets[i]);
+		bool hit;
+		switch(type)
+		{
+			case EDGE_RISING:
+				hit = value && !last;
+				break;
+
+			case EDGE_FALLING:
+				hit = !value && last;
+				break;
+
+			case EDGE_ANY:
+			default:
+				hit = (value != last);
+				break;
+		}
+		if(hit)
+			edges.push_back(phoff + data->m_timescale * data->GetOffset(i));
 
 		last = value;
 	}
 }
 
+__attribute__((target("avx2")))
+void Filter::FindDigitalEdgesInnerAVX2(
+	DigitalWaveform* data,
+	EdgeType type,
+	size_t start,
+	size_t end,
+	vector<int64_t>& edges)
+{
+	int64_t phoff = data->m_timescale/2 + data->m_triggerPhase;
+	uint8_t* samples = (uint8_t*)&data->m_samples[0];
+	size_t len = end - start;
+	size_t vend = start + len - (len % 32);
+
+	//Compare 32 samples at a time, and the same block shifted back by one, against zero.
+	//This gives one bit per sample for the current and previous value, which we combine to find edges.
+	__m256i zero = _mm256_setzero_si256();
+	for(size_t i=start; i<vend; i+=32)
+	{
+		__m256i cur = _mm256_loadu_si256((__m256i*)(samples + i));
+		__m256i prev = _mm256_loadu_si256((__m256i*)(samples + i - 1));
+		uint32_t mcur = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(cur, zero));
+		uint32_t mprev = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(prev, zero));
+
+		uint32_t hits;
+		switch(type)
+		{
+			case EDGE_RISING:
+				hits = mcur & ~mprev;
+				break;
+
+			case EDGE_FALLING:
+				hits = ~mcur & mprev;
+				break;
+
+			case EDGE_ANY:
+			default:
+				hits = mcur ^ mprev;
+				break;
+		}
+
+		while(hits)
+		{
+			size_t j = __builtin_ctz(hits);
+			edges.push_back(phoff + data->m_timescale * data->GetOffset(i+j));
+			hits &= (hits - 1);
+		}
+	}
+
+	//Get any extras
+	if(vend < end)
+		FindDigitalEdgesInner(data, type, vend, end, edges);
+}
+
 /**
-	@brief Find falling edges in a waveform
+	@brief Calls a function for every edge of the requested polarity between samples i-1 and i, for i in [start, end).
+
+	Scans 64 samples at a time: shifting each word left by one (carrying in the last bit of the previous word) lines
+	up every sample with its predecessor, so the edges in a word fall out of a couple of bitwise operations.
+
+	@param data		The waveform to search
+	@param type		Edge polarity
+	@param start	First sample index to check. Must be at least 1.
+	@param end		One past the last sample index to check
+	@param callback	Function(i) called with the index of the sample following each edge, in order
  */
-void Filter::FindFallingEdges(DigitalWaveform* data, vector<int64_t>& edges)
+template<class T>
+void Filter::ForEachPackedEdge(PackedDigitalWaveform* data, EdgeType type, size_t start, size_t end, T callback)
 {
-	//Find times of the zero crossings
-	bool first = true;
-	bool last = data->m_samples[0];
-	int64_t phoff = data->m_timescale/2 + data->m_triggerPhase;
-	size_t len = data->m_samples.size();
-	for(size_t i=1; i<len; i++)
+	if(end <= start)
+		return;
+
+	size_t wstart = start / 64;
+	size_t wend = PackedDigitalWaveform::GetWordCount(end);
+	uint64_t* words = &data->m_words[0];
+	uint64_t prevword = (wstart > 0) ? words[wstart-1] : 0;
+
+	for(size_t w=wstart; w<wend; w++)
 	{
-		bool value = data->m_samples[i];
+		uint64_t cur = words[w];
+		uint64_t prev = (cur << 1) | (prevword >> 63);
+		prevword = cur;
 
-		//Save the last value
-		if(first)
+		uint64_t hits;
+		switch(type)
 		{
-			last = value;
-			first = false;
-			continue;
+			case EDGE_RISING:
+				hits = cur & ~prev;
+				break;
+
+			case EDGE_FALLING:
+				hits = ~cur & prev;
+				break;
+
+			case EDGE_ANY:
+			default:
+				hits = cur ^ prev;
+				break;
 		}
 
-		//Save samples with an edge
-		if(!value && last)
-			edges.push_back(phoff + data->m_timescale * data->m_offsets[i]);
+		//Mask off anything outside the requested range
+		if(w == wstart)
+			hits &= ~((1ULL << (start % 64)) - 1);
+		if( (w == wend-1) && (end % 64) )
+			hits &= (1ULL << (end % 64)) - 1;
 
-		last = value;
+		while(hits)
+		{
+			callback(w*64 + __builtin_ctzll(hits));
+			hits &= (hits - 1);
+		}
 	}
 }
 
+/**
+	@brief Find edges of the requested polarity in a packed digital waveform
+
+	As with the unpacked version, the first sample is never considered to be an edge.
+ */
+void Filter::FindPackedEdges(PackedDigitalWaveform* data, EdgeType type, vector<int64_t>& edges)
+{
+	size_t len = data->size();
+	if(len <= 2)
+		return;
+
+	FindEdgesParallel(2, len, edges,
+		[data, type](size_t start, size_t end, vector<int64_t>& blockEdges)
+		{
+			int64_t phoff = data->m_timescale/2 + data->m_triggerPhase;
+			ForEachPackedEdge(data, type, start, end,
+				[&](size_t i)
+				{ blockEdges.push_back(phoff + data->m_timescale * data->GetOffset(i)); }
+				);
+		});
+}
+
+/**
+	@brief Find edges in a packed waveform, discarding repeated samples
+ */
+void Filter::FindZeroCrossings(PackedDigitalWaveform* data, vector<int64_t>& edges)
+{
+	FindPackedEdges(data, EDGE_ANY, edges);
+}
+
+/**
+	@brief Find rising edges in a packed waveform
+ */
+void Filter::FindRisingEdges(PackedDigitalWaveform* data, vector<int64_t>& edges)
+{
+	FindPackedEdges(data, EDGE_RISING, edges);
+}
+
+/**
+	@brief Find falling edges in a packed waveform
+ */
+void Filter::FindFallingEdges(PackedDigitalWaveform* data, vector<int64_t>& edges)
+{
+	FindPackedEdges(data, EDGE_FALLING, edges);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Serialization
 
@@ -904,17 +1408,12 @@ float Filter::InterpolateValue(AnalogWaveform* cap, size_t index, float frac_tic
 
 /**
 	@brief Gets the lowest voltage of a waveform
+
+	This and the other voltage helpers below share one cached WaveformStatistics computation per waveform revision.
  */
 float Filter::GetMinVoltage(AnalogWaveform* cap)
 {
-	//Loop over samples and find the minimum
-	float tmp = FLT_MAX;
-	for(float f : cap->m_samples)
-	{
-		if(f < tmp)
-			tmp = f;
-	}
-	return tmp;
+	return WaveformStatistics::Get(cap)->m_min;
 }
 
 /**
@@ -922,14 +1421,7 @@ float Filter::GetMinVoltage(AnalogWaveform* cap)
  */
 float Filter::GetMaxVoltage(AnalogWaveform* cap)
 {
-	//Loop over samples and find the maximum
-	float tmp = -FLT_MAX;
-	for(float f : cap->m_samples)
-	{
-		if(f > tmp)
-			tmp = f;
-	}
-	return tmp;
+	return WaveformStatistics::Get(cap)->m_max;
 }
 
 /**
@@ -937,12 +1429,7 @@ float Filter::GetMaxVoltage(AnalogWaveform* cap)
  */
 float Filter::GetAvgVoltage(AnalogWaveform* cap)
 {
-	//Loop over samples and find the average
-	//TODO: more numerically stable summation algorithm for deep captures
-	double sum = 0;
-	for(float f : cap->m_samples)
-		sum += f;
-	return sum / cap->m_samples.size();
+	return WaveformStatistics::Get(cap)->m_mean;
 }
 
 /**
@@ -957,24 +1444,7 @@ float Filter::GetAvgVoltage(AnalogWaveform* cap)
 vector<size_t> Filter::MakeHistogram(AnalogWaveform* cap, float low, float high, size_t bins)
 {
 	vector<size_t> ret;
-	for(size_t i=0; i<bins; i++)
-		ret.push_back(0);
-
-	//Early out if we have zero span
-	if(bins == 0)
-		return ret;
-
-	float delta = high-low;
-
-	for(float v : cap->m_samples)
-	{
-		float fbin = (v-low) / delta;
-		size_t bin = floor(fbin * bins);
-		bin = max(bin, (size_t)0);
-		bin = min(bin, bins-1);
-		ret[bin] ++;
-	}
-
+	WaveformStatistics::MakeHistogram(cap, low, high, bins, ret);
 	return ret;
 }
 
@@ -983,26 +1453,9 @@ vector<size_t> Filter::MakeHistogram(AnalogWaveform* cap, float low, float high,
  */
 float Filter::GetBaseVoltage(AnalogWaveform* cap)
 {
-	float vmin = GetMinVoltage(cap);
-	float vmax = GetMaxVoltage(cap);
-	float delta = vmax - vmin;
-	const int nbins = 100;
-	auto hist = MakeHistogram(cap, vmin, vmax, nbins);
-
 	//Find the highest peak in the first quarter of the histogram
-	size_t binval = 0;
-	int idx = 0;
-	for(int i=0; i<(nbins/4); i++)
-	{
-		if(hist[i] > binval)
-		{
-			binval = hist[i];
-			idx = i;
-		}
-	}
-
-	float fbin = (idx + 0.5f)/nbins;
-	return fbin*delta + vmin;
+	const size_t nbins = 100;
+	return WaveformStatistics::Get(cap, nbins)->GetMostProbableVoltage(0, nbins/4);
 }
 
 /**
@@ -1010,32 +1463,16 @@ float Filter::GetBaseVoltage(AnalogWaveform* cap)
  */
 float Filter::GetTopVoltage(AnalogWaveform* cap)
 {
-	float vmin = GetMinVoltage(cap);
-	float vmax = GetMaxVoltage(cap);
-	float delta = vmax - vmin;
-	const int nbins = 100;
-	auto hist = MakeHistogram(cap, vmin, vmax, nbins);
-
-	//Find the highest peak in the third quarter of the histogram
-	size_t binval = 0;
-	int idx = 0;
-	for(int i=(nbins*3)/4; i<nbins; i++)
-	{
-		if(hist[i] > binval)
-		{
-			binval = hist[i];
-			idx = i;
-		}
-	}
-
-	float fbin = (idx + 0.5f)/nbins;
-	return fbin*delta + vmin;
+	//Find the highest peak in the last quarter of the histogram
+	const size_t nbins = 100;
+	return WaveformStatistics::Get(cap, nbins)->GetMostProbableVoltage((nbins*3)/4, nbins);
 }
 
 void Filter::ClearAnalysisCache()
 {
-	lock_guard<mutex> lock(m_cacheMutex);
-	m_zeroCrossingCache.clear();
+	m_zeroCrossingCache.Clear();
+	m_sampledBitstreamCache.Clear();
+	WaveformStatistics::ClearCache();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1045,7 +1482,8 @@ void Filter::ClearAnalysisCache()
 	@brief Sets up an analog output waveform and copies timebase configuration from the input.
 
 	A new output waveform is created if necessary, but when possible the existing one is reused.
-	Timestamps are copied from the input to the output.
+	Timestamps are copied from the input to the output, unless the input is dense packed in which case the output
+	has implicit timestamps.
 
 	@param din			Input waveform
 	@param stream		Stream index
@@ -1057,10 +1495,10 @@ void Filter::ClearAnalysisCache()
 AnalogWaveform* Filter::SetupOutputWaveform(WaveformBase* din, size_t stream, size_t skipstart, size_t skipend)
 {
 	//Create the waveform, but only if necessary
-	AnalogWaveform* cap = dynamic_cast<AnalogWaveform*>(GetData(stream));
+	AnalogWaveform* cap = dynamic_cast<AnalogWaveform*>(GetDataImplicit(stream));
 	if(cap == NULL)
 	{
-		cap = new AnalogWaveform;
+		cap = WaveformPool::Allocate<AnalogWaveform>(din->size());
 		SetData(cap, stream);
 	}
 
@@ -1070,42 +1508,20 @@ AnalogWaveform* Filter::SetupOutputWaveform(WaveformBase* din, size_t stream, si
 	cap->m_startFemtoseconds	= din->m_startFemtoseconds;
 	cap->m_triggerPhase			= din->m_triggerPhase;
 
-	size_t len = din->m_offsets.size() - (skipstart + skipend);
-	size_t curlen = cap->m_offsets.size();
+	size_t len = din->size() - (skipstart + skipend);
 
-	cap->Resize(len);
+	//If the input waveform is dense packed, the output is too (we discard skipstart to keep it that way).
+	//No need to touch the timestamps at all.
+	if(din->m_densePacked)
+		cap->ResizeImplicit(len);
 
 	//If the input waveform is NOT dense packed, no optimizations possible.
-	if(!din->m_densePacked)
+	else
 	{
+		cap->m_densePacked = false;
+		cap->Resize(len);
 		memcpy(&cap->m_offsets[0], &din->m_offsets[skipstart], len*sizeof(int64_t));
 		memcpy(&cap->m_durations[0], &din->m_durations[skipstart], len*sizeof(int64_t));
-		cap->m_densePacked = false;
-	}
-
-	//Input waveform is dense packed, but output is not.
-	//Need to clear some old stuff but we can produce a dense packed output.
-	//Note that we copy from zero regardless of skipstart to produce a dense packed output.
-	//TODO: AVX2 optimizations here so we don't need to read data we already know the value of
-	else if(!cap->m_densePacked)
-	{
-		memcpy(&cap->m_offsets[0], &din->m_offsets[0], len*sizeof(int64_t));
-		memcpy(&cap->m_durations[0], &din->m_durations[0], len*sizeof(int64_t));
-		cap->m_densePacked = true;
-	}
-
-	//Both waveforms are dense packed, but new size is bigger. Need to copy the additional data.
-	else if(len > curlen)
-	{
-		size_t increase = len - curlen;
-		memcpy(&cap->m_offsets[curlen], &din->m_offsets[curlen], increase*sizeof(int64_t));
-		memcpy(&cap->m_durations[curlen], &din->m_durations[curlen], increase*sizeof(int64_t));
-	}
-
-	//Both waveforms are dense packed, new size is smaller or the same.
-	//This is what we want: no work needed at all!
-	else
-	{
 	}
 
 	return cap;
@@ -1115,7 +1531,8 @@ AnalogWaveform* Filter::SetupOutputWaveform(WaveformBase* din, size_t stream, si
 	@brief Sets up a digital output waveform and copies timebase configuration from the input.
 
 	A new output waveform is created if necessary, but when possible the existing one is reused.
-	Timestamps are copied from the input to the output.
+	Timestamps are copied from the input to the output, unless the input is dense packed in which case the output
+	has implicit timestamps.
 
 	@param din			Input waveform
 	@param stream		Stream index
@@ -1127,10 +1544,10 @@ AnalogWaveform* Filter::SetupOutputWaveform(WaveformBase* din, size_t stream, si
 DigitalWaveform* Filter::SetupDigitalOutputWaveform(WaveformBase* din, size_t stream, size_t skipstart, size_t skipend)
 {
 	//Create the waveform, but only if necessary
-	DigitalWaveform* cap = dynamic_cast<DigitalWaveform*>(GetData(stream));
+	DigitalWaveform* cap = dynamic_cast<DigitalWaveform*>(GetDataImplicit(stream));
 	if(cap == NULL)
 	{
-		cap = new DigitalWaveform;
+		cap = WaveformPool::Allocate<DigitalWaveform>(din->size());
 		SetData(cap, stream);
 	}
 
@@ -1140,42 +1557,20 @@ DigitalWaveform* Filter::SetupDigitalOutputWaveform(WaveformBase* din, size_t st
 	cap->m_startFemtoseconds	= din->m_startFemtoseconds;
 	cap->m_triggerPhase			= din->m_triggerPhase;
 
-	size_t len = din->m_offsets.size() - (skipstart + skipend);
-	size_t curlen = cap->m_offsets.size();
+	size_t len = din->size() - (skipstart + skipend);
 
-	cap->Resize(len);
+	//If the input waveform is dense packed, the output is too (we discard skipstart to keep it that way).
+	//No need to touch the timestamps at all.
+	if(din->m_densePacked)
+		cap->ResizeImplicit(len);
 
 	//If the input waveform is NOT dense packed, no optimizations possible.
-	if(!din->m_densePacked)
+	else
 	{
+		cap->m_densePacked = false;
+		cap->Resize(len);
 		memcpy(&cap->m_offsets[0], &din->m_offsets[skipstart], len*sizeof(int64_t));
 		memcpy(&cap->m_durations[0], &din->m_durations[skipstart], len*sizeof(int64_t));
-		cap->m_densePacked = false;
-	}
-
-	//Input waveform is dense packed, but output is not.
-	//Need to clear some old stuff but we can produce a dense packed output.
-	//Note that we copy from zero regardless of skipstart to produce a dense packed output.
-	//TODO: AVX2 optimizations here so we don't need to read data we already know the value of
-	else if(!cap->m_densePacked)
-	{
-		memcpy(&cap->m_offsets[0], &din->m_offsets[0], len*sizeof(int64_t));
-		memcpy(&cap->m_durations[0], &din->m_durations[0], len*sizeof(int64_t));
-		cap->m_densePacked = true;
-	}
-
-	//Both waveforms are dense packed, but new size is bigger. Need to copy the additional data.
-	else if(len > curlen)
-	{
-		size_t increase = len - curlen;
-		memcpy(&cap->m_offsets[curlen], &din->m_offsets[curlen], increase*sizeof(int64_t));
-		memcpy(&cap->m_durations[curlen], &din->m_durations[curlen], increase*sizeof(int64_t));
-	}
-
-	//Both waveforms are dense packed, new size is smaller or the same.
-	//This is what we want: no work needed at all!
-	else
-	{
 	}
 
 	return cap;
@@ -38,6 +38,8 @@
 
 #include "OscilloscopeChannel.h"
 #include "FlowGraphNode.h"
+#include "ZeroCrossingCache.h"
+#include "SampledBitstreamCache.h"
 
 /**
 	@brief Abstract base class for all filters and protocol decoders
@@ -131,6 +133,9 @@ public:
 	void SetDirty()
 	{ m_dirty = true; }
 
+	bool IsDirty()
+	{ return m_dirty; }
+
 	/**
 		@brief Gets the display name of this protocol (for use in menus, save files, etc). Must be unique.
 	 */
@@ -219,8 +224,7 @@ public:
 	static float InterpolateTime(AnalogWaveform* p, AnalogWaveform* n, size_t a, float voltage);
 	static float InterpolateValue(AnalogWaveform* cap, size_t index, float frac_ticks);
 
-	//Helpers for more complex measurements
-	//TODO: create some process for caching this so we don't waste CPU time
+	//Helpers for more complex measurements (cached, see WaveformStatistics)
 	static float GetMinVoltage(AnalogWaveform* cap);
 	static float GetMaxVoltage(AnalogWaveform* cap);
 	static float GetBaseVoltage(AnalogWaveform* cap);
@@ -228,6 +232,45 @@ public:
 	static float GetAvgVoltage(AnalogWaveform* cap);
 	static std::vector<size_t> MakeHistogram(AnalogWaveform* cap, float low, float high, size_t bins);
 
+	/**
+		@brief Smallest number of samples worth handing to its own OpenMP thread in a per-sample loop.
+
+		Waking the thread pool costs on the order of 10-20 us, and the vectorized per-sample kernels process very
+		roughly one sample per ns, so blocks this big keep the fork/join overhead to around 10%.
+	 */
+	static const size_t MIN_PARALLEL_BLOCK_SIZE = 262144;
+
+	static size_t GetParallelBlockCount(size_t len);
+
+	/**
+		@brief Splits [0, len) into numblocks blocks and calls kernel(block, start, end) for each on an OpenMP thread
+
+		Blocks are a multiple of align samples long, except for the last one which also covers whatever didn't divide
+		evenly. numblocks is normally GetParallelBlockCount(len), passed in so callers can size per-block results.
+	 */
+	template<class T>
+	static void ForEachParallelBlock(size_t len, size_t numblocks, size_t align, T kernel)
+	{
+		size_t blocksize = len / numblocks;
+		blocksize -= blocksize % align;
+
+		#pragma omp parallel for if(numblocks > 1)
+		for(size_t i=0; i<numblocks; i++)
+		{
+			size_t start = i*blocksize;
+			size_t end = (i == numblocks - 1) ? len : start + blocksize;
+			kernel(i, start, end);
+		}
+	}
+
+	///@brief Clock edge polarity
+	enum EdgeType
+	{
+		EDGE_ANY,
+		EDGE_RISING,
+		EDGE_FALLING
+	};
+
 	//Samples a digital channel on the edges of another channel.
 	//The two channels need not be the same sample rate.
 	static void SampleOnAnyEdges(DigitalWaveform* data, DigitalWaveform* clock, DigitalWaveform& samples);
@@ -235,17 +278,65 @@ public:
 	static void SampleOnRisingEdges(DigitalWaveform* data, DigitalWaveform* clock, DigitalWaveform& samples);
 	static void SampleOnRisingEdges(DigitalBusWaveform* data, DigitalWaveform* clock, DigitalBusWaveform& samples);
 	static void SampleOnFallingEdges(DigitalWaveform* data, DigitalWaveform* clock, DigitalWaveform& samples);
+	static void SampleOnAnyEdges(PackedDigitalWaveform* data, PackedDigitalWaveform* clock, DigitalWaveform& samples);
+	static void SampleOnRisingEdges(PackedDigitalWaveform* data, PackedDigitalWaveform* clock, DigitalWaveform& samples);
+	static void SampleOnFallingEdges(PackedDigitalWaveform* data, PackedDigitalWaveform* clock, DigitalWaveform& samples);
+
+	//Cached clock sampling for filters sharing the same data and clock
+	static SampledBitstreamCache::BitstreamPtr SampleBitstream(
+		DigitalWaveform* data, DigitalWaveform* clock, EdgeType type = EDGE_ANY);
+
+	//Symbol alignment for 10-bit line codes
+	static size_t FindSymbolAlignment(PackedDigitalWaveform* bits, const uint8_t* syncTable);
 
 	//Find interpolated zero crossings of a signal
+	static ZeroCrossingCache::EdgeBuffer FindZeroCrossings(AnalogWaveform* data, float threshold);
 	static void FindZeroCrossings(AnalogWaveform* data, float threshold, std::vector<int64_t>& edges);
 
 	//Find edges in a signal (discarding repeated samples)
 	static void FindZeroCrossings(DigitalWaveform* data, std::vector<int64_t>& edges);
 	static void FindRisingEdges(DigitalWaveform* data, std::vector<int64_t>& edges);
 	static void FindFallingEdges(DigitalWaveform* data, std::vector<int64_t>& edges);
+	static void FindZeroCrossings(PackedDigitalWaveform* data, std::vector<int64_t>& edges);
+	static void FindRisingEdges(PackedDigitalWaveform* data, std::vector<int64_t>& edges);
+	static void FindFallingEdges(PackedDigitalWaveform* data, std::vector<int64_t>& edges);
+
+protected:
+	template<class T>
+	static void FindEdgesParallel(size_t start, size_t end, std::vector<int64_t>& edges, T kernel);
+
+	static int64_t GetZeroCrossingTime(AnalogWaveform* data, size_t i, float threshold);
+	static void FindZeroCrossingsInner(
+		AnalogWaveform* data, float threshold, size_t start, size_t end, std::vector<int64_t>& edges);
+	static void FindZeroCrossingsInnerAVX2(
+		AnalogWaveform* data, float threshold, size_t start, size_t end, std::vector<int64_t>& edges);
+	static void FindZeroCrossingsInnerAVX512F(
+		AnalogWaveform* data, float threshold, size_t start, size_t end, std::vector<int64_t>& edges);
+
+	static void FindDigitalEdges(DigitalWaveform* data, EdgeType type, std::vector<int64_t>& edges);
+	static void FindDigitalEdgesInner(
+		DigitalWaveform* data, EdgeType type, size_t start, size_t end, std::vector<int64_t>& edges);
+	static void FindDigitalEdgesInnerAVX2(
+		DigitalWaveform* data, EdgeType type, size_t start, size_t end, std::vector<int64_t>& edges);
+
+	template<class T>
+	static void ForEachPackedEdge(PackedDigitalWaveform* data, EdgeType type, size_t start, size_t end, T callback);
+	static void FindPackedEdges(PackedDigitalWaveform* data, EdgeType type, std::vector<int64_t>& edges);
+	static void SampleOnPackedEdges(
+		PackedDigitalWaveform* data, PackedDigitalWaveform* clock, EdgeType type, DigitalWaveform& samples);
+
+public:
 
 	static void ClearAnalysisCache();
 
+	///@brief Gets the cache used by FindZeroCrossings() (for statistics and memory limit configuration)
+	static ZeroCrossingCache& GetZeroCrossingCache()
+	{ return m_zeroCrossingCache; }
+
+	///@brief Gets the cache used by SampleBitstream() (for statistics and memory limit configuration)
+	static SampledBitstreamCache& GetSampledBitstreamCache()
+	{ return m_sampledBitstreamCache; }
+
 protected:
 	//Common text formatting
 	virtual std::string GetTextForAsciiChannel(int i, size_t stream);
@@ -274,8 +365,8 @@ protected:
 	static std::set<Filter*> m_filters;
 
 	//Caching
-	static std::mutex m_cacheMutex;
-	static std::map<std::pair<WaveformBase*, float>, std::vector<int64_t> > m_zeroCrossingCache;
+	static ZeroCrossingCache m_zeroCrossingCache;
+	static SampledBitstreamCache m_sampledBitstreamCache;
 };
 
 #define PROTOCOL_DECODER_INITPROC(T) \
@@ -0,0 +1,339 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of FilterGraphExecutor
+ */
+#include "scopehal.h"
+#include "FilterGraphExecutor.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates the executor and spins up the worker pool
+
+	@param numThreads	Number of worker threads. Zero selects one per hardware thread.
+						If one thread is requested, filters are refreshed in topological order on the calling thread
+						and no pool is created.
+ */
+FilterGraphExecutor::FilterGraphExecutor(size_t numThreads)
+	: m_queuedCount(0)
+	, m_remainingCount(0)
+	, m_terminating(false)
+{
+	if(numThreads == 0)
+		numThreads = thread::hardware_concurrency();
+	if(numThreads <= 1)
+		return;
+
+	for(size_t i=0; i<numThreads; i++)
+		m_queues.push_back(unique_ptr<WorkQueue>(new WorkQueue));
+	for(size_t i=0; i<numThreads; i++)
+		m_threads.push_back(thread(&FilterGraphExecutor::WorkerThread, this, i));
+}
+
+FilterGraphExecutor::~FilterGraphExecutor()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_terminating = true;
+	}
+	m_workAvailable.notify_all();
+
+	for(auto& t : m_threads)
+		t.join();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Graph construction
+
+/**
+	@brief Gets the set of dirty filters directly connected to the inputs of a filter
+ */
+void FilterGraphExecutor::GetDirtyInputs(Filter* f, set<Filter*>& inputs)
+{
+	for(size_t i=0; i<f->GetInputCount(); i++)
+	{
+		auto in = dynamic_cast<Filter*>(f->GetInput(i).m_channel);
+		if(in && in->IsDirty())
+			inputs.emplace(in);
+	}
+}
+
+/**
+	@brief Sorts the dirty filters in a set, plus any dirty filters upstream of them, such that every filter comes
+	after all of its inputs.
+
+	Clean filters are not included in the output since they do not need to be refreshed.
+
+	@param filters	The filters to sort
+	@param order	Output list of filters in dependency order
+ */
+void FilterGraphExecutor::TopologicalSort(const set<Filter*>& filters, vector<Filter*>& order)
+{
+	order.clear();
+
+	//Find every dirty filter in the set, then pull in anything dirty they depend on
+	set<Filter*> pending;
+	vector<Filter*> work;
+	for(auto f : filters)
+	{
+		if(f->IsDirty())
+			work.push_back(f);
+	}
+	while(!work.empty())
+	{
+		auto f = work.back();
+		work.pop_back();
+		if(!pending.emplace(f).second)
+			continue;
+
+		set<Filter*> inputs;
+		GetDirtyInputs(f, inputs);
+		for(auto in : inputs)
+			work.push_back(in);
+	}
+
+	//Repeatedly move every filter whose inputs are all sorted to the output
+	while(!pending.empty())
+	{
+		vector<Filter*> ready;
+		for(auto f : pending)
+		{
+			set<Filter*> inputs;
+			GetDirtyInputs(f, inputs);
+
+			bool ok = true;
+			for(auto in : inputs)
+			{
+				if(pending.find(in) != pending.end())
+				{
+					ok = false;
+					break;
+				}
+			}
+
+			if(ok)
+				ready.push_back(f);
+		}
+
+		//Should never happen, but don't hang if someone managed to connect a filter to itself
+		if(ready.empty())
+		{
+			LogError("FilterGraphExecutor: cycle detected in filter graph, refreshing remaining filters in arbitrary order\n");
+			for(auto f : pending)
+				order.push_back(f);
+			break;
+		}
+
+		for(auto f : ready)
+		{
+			order.push_back(f);
+			pending.erase(f);
+		}
+	}
+}
+
+/**
+	@brief Sorts the filters and computes the dependency edges for a run
+ */
+void FilterGraphExecutor::BuildGraph(const set<Filter*>& filters)
+{
+	TopologicalSort(filters, m_nodes);
+
+	size_t len = m_nodes.size();
+	map<Filter*, size_t> indexes;
+	for(size_t i=0; i<len; i++)
+		indexes[m_nodes[i]] = i;
+
+	m_consumers.clear();
+	m_consumers.resize(len);
+	m_pendingInputs.reset(new atomic<size_t>[len]);
+
+	for(size_t i=0; i<len; i++)
+	{
+		set<Filter*> inputs;
+		GetDirtyInputs(m_nodes[i], inputs);
+
+		//Only count edges from earlier nodes. In a sane (acyclic) graph this is all of them,
+		//but if there was a cycle this ensures we can't deadlock waiting on it.
+		size_t count = 0;
+		for(auto in : inputs)
+		{
+			size_t j = indexes[in];
+			if(j < i)
+			{
+				m_consumers[j].push_back(i);
+				count ++;
+			}
+		}
+		m_pendingInputs[i] = count;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+/**
+	@brief Refreshes all dirty filters in a set (and anything dirty upstream of them), returning when all are done
+
+	Typically called with Filter::GetAllInstances() after a new waveform has been acquired and
+	Filter::SetAllFiltersDirty() was called.
+ */
+void FilterGraphExecutor::RunBlocking(const set<Filter*>& filters)
+{
+	lock_guard<mutex> runlock(m_runMutex);
+
+	BuildGraph(filters);
+	size_t len = m_nodes.size();
+	if(len == 0)
+		return;
+
+	//No pool? Just run everything in order on this thread
+	if(m_threads.empty())
+	{
+		for(auto f : m_nodes)
+			f->RefreshIfDirty();
+		return;
+	}
+
+	//Distribute the initially runnable filters round-robin across the workers
+	m_remainingCount = len;
+	size_t nthreads = m_queues.size();
+	size_t next = 0;
+	for(size_t i=0; i<len; i++)
+	{
+		if(m_pendingInputs[i] == 0)
+		{
+			PushRunnableNode(next, i);
+			next = (next + 1) % nthreads;
+		}
+	}
+
+	unique_lock<mutex> lock(m_mutex);
+	m_runComplete.wait(lock, [&]{ return m_remainingCount == 0; });
+}
+
+/**
+	@brief Adds a filter to the tail of a worker's queue and wakes an idle worker
+ */
+void FilterGraphExecutor::PushRunnableNode(size_t id, size_t node)
+{
+	//Count the node before it becomes visible, so a worker popping it right away can't take the count below zero
+	{
+		lock_guard<mutex> lock(m_queues[id]->m_mutex);
+		m_queuedCount ++;
+		m_queues[id]->m_nodes.push_back(node);
+	}
+
+	//Take the lock before notifying so a worker can't miss the wakeup between checking the count and sleeping
+	{
+		lock_guard<mutex> lock(m_mutex);
+	}
+	m_workAvailable.notify_one();
+}
+
+/**
+	@brief Gets the next filter for a worker to run.
+
+	Takes the newest entry from the worker's own queue (most likely to have its inputs still in cache),
+	or steals the oldest entry from another worker's queue if our own is empty.
+
+	@return True if a filter was found
+ */
+bool FilterGraphExecutor::PopRunnableNode(size_t id, size_t& node)
+{
+	size_t nthreads = m_queues.size();
+	for(size_t i=0; i<nthreads; i++)
+	{
+		auto& q = *m_queues[(id + i) % nthreads];
+		lock_guard<mutex> lock(q.m_mutex);
+		if(q.m_nodes.empty())
+			continue;
+
+		if(i == 0)
+		{
+			node = q.m_nodes.back();
+			q.m_nodes.pop_back();
+		}
+		else
+		{
+			node = q.m_nodes.front();
+			q.m_nodes.pop_front();
+		}
+
+		m_queuedCount --;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+	@brief Releases any consumers of a filter that were waiting only on it
+ */
+void FilterGraphExecutor::OnNodeComplete(size_t id, size_t node)
+{
+	for(auto c : m_consumers[node])
+	{
+		if(--m_pendingInputs[c] == 0)
+			PushRunnableNode(id, c);
+	}
+
+	if(--m_remainingCount == 0)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_runComplete.notify_all();
+	}
+}
+
+void FilterGraphExecutor::WorkerThread(size_t id)
+{
+	while(true)
+	{
+		size_t node;
+		if(PopRunnableNode(id, node))
+		{
+			//All dirty inputs are already refreshed, so this only refreshes the filter itself
+			m_nodes[node]->RefreshIfDirty();
+			OnNodeComplete(id, node);
+			continue;
+		}
+
+		unique_lock<mutex> lock(m_mutex);
+		m_workAvailable.wait(lock, [&]{ return m_terminating || (m_queuedCount > 0); });
+		if(m_terminating)
+			return;
+	}
+}
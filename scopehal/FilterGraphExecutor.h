@@ -0,0 +1,127 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of FilterGraphExecutor
+ */
+#ifndef FilterGraphExecutor_h
+#define FilterGraphExecutor_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+
+class Filter;
+
+/**
+	@brief Refreshes a set of filters in dependency order, running independent filters in parallel
+
+	The executor topologically sorts the dirty filters in the requested set (plus any dirty filters upstream of them)
+	along their m_inputs edges. Each filter is refreshed once all of its dirty inputs have been refreshed. Filters with
+	no outstanding inputs are distributed over a pool of worker threads, each of which owns a deque of runnable
+	filters. Workers run their own newest work first and steal the oldest work from other workers when idle.
+
+	This replaces the recursive, single threaded walk done by Filter::RefreshIfDirty() when refreshing the whole graph
+	after a new waveform arrives. Filter::RefreshIfDirty() is still fine for refreshing a single filter on demand.
+
+	Filters may themselves use OpenMP internally. Each worker gets its own OpenMP team, so with many heavy filters
+	running concurrently the machine may be oversubscribed; use a smaller thread count if this becomes a problem.
+ */
+class FilterGraphExecutor
+{
+public:
+	FilterGraphExecutor(size_t numThreads = 0);
+	virtual ~FilterGraphExecutor();
+
+	void RunBlocking(const std::set<Filter*>& filters);
+
+	///@brief Returns the number of worker threads in the pool (zero if refreshing on the calling thread)
+	size_t GetThreadCount()
+	{ return m_threads.size(); }
+
+	static void TopologicalSort(const std::set<Filter*>& filters, std::vector<Filter*>& order);
+
+protected:
+	void BuildGraph(const std::set<Filter*>& filters);
+	void WorkerThread(size_t id);
+	bool PopRunnableNode(size_t id, size_t& node);
+	void PushRunnableNode(size_t id, size_t node);
+	void OnNodeComplete(size_t id, size_t node);
+
+	static void GetDirtyInputs(Filter* f, std::set<Filter*>& inputs);
+
+	///@brief Deque of runnable filters (indexes into m_nodes) owned by one worker
+	class WorkQueue
+	{
+	public:
+		std::mutex m_mutex;
+		std::deque<size_t> m_nodes;
+	};
+
+	///@brief Worker threads
+	std::vector<std::thread> m_threads;
+
+	///@brief Per-worker work queues
+	std::vector<std::unique_ptr<WorkQueue>> m_queues;
+
+	///@brief Serializes calls to RunBlocking()
+	std::mutex m_runMutex;
+
+	///@brief Mutex for the wakeup and completion condition variables
+	std::mutex m_mutex;
+
+	///@brief Signaled when new work is queued or the pool is shutting down
+	std::condition_variable m_workAvailable;
+
+	///@brief Signaled when the last filter of a run finishes
+	std::condition_variable m_runComplete;
+
+	///@brief Number of nodes sitting in any work queue
+	std::atomic<size_t> m_queuedCount;
+
+	///@brief Number of nodes in the current run that have not yet finished refreshing
+	std::atomic<size_t> m_remainingCount;
+
+	///@brief Set when the pool is shutting down
+	bool m_terminating;
+
+	///@brief Filters in the current run, in topological order
+	std::vector<Filter*> m_nodes;
+
+	///@brief Downstream nodes of each node (indexes into m_nodes)
+	std::vector< std::vector<size_t> > m_consumers;
+
+	///@brief Number of inputs of each node that have not yet been refreshed
+	std::unique_ptr< std::atomic<size_t>[] > m_pendingInputs;
+};
+
+#endif
@@ -64,6 +64,9 @@ public:
 	WaveformBase* GetData()
 	{ return m_channel->GetData(m_stream); }
 
+	WaveformBase* GetDataImplicit()
+	{ return m_channel->GetDataImplicit(m_stream); }
+
 	bool operator==(const StreamDescriptor& rhs) const
 	{ return (m_channel == rhs.m_channel) && (m_stream == rhs.m_stream); }
 
@@ -864,7 +864,8 @@ void LeCroyOscilloscope::DetectAnalogChannels()
 
 LeCroyOscilloscope::~LeCroyOscilloscope()
 {
-
+	//Conversion jobs reference us, so make sure they're done before we go away
+	StopConversionThreads();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -2079,6 +2080,12 @@ time_t LeCroyOscilloscope::ExtractTimestamp(unsigned char* wavedesc, double& bas
 	return mktime(&tstruc);
 }
 
+/**
+	@brief Converts one channel's raw waveform data to one or more waveforms (one per sequence segment)
+
+	Called on the conversion threads, possibly for several acquisitions at once. This is a const method and only reads
+	configuration fixed at construction time (m_highDefinition), so it needs no locking.
+ */
 vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 	const char* data,
 	size_t datalen,
@@ -2086,7 +2093,7 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 	uint32_t num_sequences,
 	time_t ttime,
 	double basetime,
-	double* wavetime)
+	double* wavetime) const
 {
 	vector<WaveformBase*> ret;
 
@@ -2124,7 +2131,7 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 	for(size_t j=0; j<num_sequences; j++)
 	{
 		//Set up the capture we're going to store our data into
-		AnalogWaveform* cap = new AnalogWaveform;
+		AnalogWaveform* cap = WaveformPool::Allocate<AnalogWaveform>(num_per_segment);
 		cap->m_timescale = round(interval);
 
 		cap->m_triggerPhase = h_off_frac;
@@ -2137,7 +2144,7 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 		else
 			cap->m_startFemtoseconds = static_cast<int64_t>(basetime * FS_PER_SECOND);
 
-		cap->Resize(num_per_segment);
+		cap->ResizeImplicit(num_per_segment);
 
 		//Convert raw ADC samples to volts
 		//TODO: Optimized AVX conversion for 16-bit samples
@@ -2147,11 +2154,7 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 			int16_t* base = wdata + j*num_per_segment;
 
 			for(unsigned int k=0; k<num_per_segment; k++)
-			{
-				cap->m_offsets[k] = k;
-				cap->m_durations[k] = 1;
 				samps[k] = base[k] * v_gain - v_off;
-			}
 		}
 		else
 		{
@@ -2176,14 +2179,11 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 							nsamp = num_per_segment - i*blocksize;
 
 						Convert8BitSamplesAVX2(
-							(int64_t*)&cap->m_offsets[i*blocksize],
-							(int64_t*)&cap->m_durations[i*blocksize],
 							samps + i*blocksize,
 							bdata + j*num_per_segment + i*blocksize,
 							v_gain,
 							v_off,
-							nsamp,
-							i*blocksize);
+							nsamp);
 					}
 				}
 
@@ -2191,27 +2191,21 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 				else
 				{
 					Convert8BitSamplesAVX2(
-						(int64_t*)&cap->m_offsets[0],
-						(int64_t*)&cap->m_durations[0],
 						samps,
 						bdata + j*num_per_segment,
 						v_gain,
 						v_off,
-						num_per_segment,
-						0);
+						num_per_segment);
 				}
 			}
 			else
 			{
 				Convert8BitSamples(
-					(int64_t*)&cap->m_offsets[0],
-					(int64_t*)&cap->m_durations[0],
 					samps,
 					bdata + j*num_per_segment,
 					v_gain,
 					v_off,
-					num_per_segment,
-					0);
+					num_per_segment);
 			}
 		}
 
@@ -2223,16 +2217,14 @@ vector<WaveformBase*> LeCroyOscilloscope::ProcessAnalogWaveform(
 
 /**
 	@brief Converts 8-bit ADC samples to floating point
+
+	Timestamps are implicit (the output waveform is dense packed) so only the sample values are written.
  */
 void LeCroyOscilloscope::Convert8BitSamples(
-	int64_t* offs, int64_t* durs, float* pout, int8_t* pin, float gain, float offset, size_t count, int64_t ibase)
+	float* pout, int8_t* pin, float gain, float offset, size_t count)
 {
 	for(unsigned int k=0; k<count; k++)
-	{
-		offs[k] = ibase + k;
-		durs[k] = 1;
 		pout[k] = pin[k] * gain - offset;
-	}
 }
 
 /**
@@ -2240,24 +2232,10 @@ void LeCroyOscilloscope::Convert8BitSamples(
  */
 __attribute__((target("avx2")))
 void LeCroyOscilloscope::Convert8BitSamplesAVX2(
-	int64_t* offs, int64_t* durs, float* pout, int8_t* pin, float gain, float offset, size_t count, int64_t ibase)
+	float* pout, int8_t* pin, float gain, float offset, size_t count)
 {
 	unsigned int end = count - (count % 32);
 
-	int64_t __attribute__ ((aligned(32))) ones_x4[] = {1, 1, 1, 1};
-	int64_t __attribute__ ((aligned(32))) fours_x4[] = {4, 4, 4, 4};
-	int64_t __attribute__ ((aligned(32))) count_x4[] =
-	{
-		ibase + 0,
-		ibase + 1,
-		ibase + 2,
-		ibase + 3
-	};
-
-	__m256i all_ones = _mm256_load_si256(reinterpret_cast<__m256i*>(ones_x4));
-	__m256i all_fours = _mm256_load_si256(reinterpret_cast<__m256i*>(fours_x4));
-	__m256i counts = _mm256_load_si256(reinterpret_cast<__m256i*>(count_x4));
-
 	__m256 gains = { gain, gain, gain, gain, gain, gain, gain, gain };
 	__m256 offsets = { offset, offset, offset, offset, offset, offset, offset, offset };
 
@@ -2267,16 +2245,6 @@ void LeCroyOscilloscope::Convert8BitSamplesAVX2(
 		//(on most modern Intel processors, load and loadu have same latency/throughput)
 		__m256i raw_samples = _mm256_loadu_si256(reinterpret_cast<__m256i*>(pin + k));
 
-		//Fill duration
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 4), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 8), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 12), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 16), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 20), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 24), all_ones);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(durs + k + 28), all_ones);
-
 		//Extract the low and high 16 samples from the block
 		__m128i block01_x8 = _mm256_extracti128_si256(raw_samples, 0);
 		__m128i block23_x8 = _mm256_extracti128_si256(raw_samples, 1);
@@ -2292,24 +2260,6 @@ void LeCroyOscilloscope::Convert8BitSamplesAVX2(
 		__m256i block2_int = _mm256_cvtepi8_epi32(block23_x8);
 		__m256i block3_int = _mm256_cvtepi8_epi32(block32_x8);
 
-		//Fill offset
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 4), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 8), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 12), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 16), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 20), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 24), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-		_mm256_store_si256(reinterpret_cast<__m256i*>(offs + k + 28), counts);
-		counts = _mm256_add_epi64(counts, all_fours);
-
 		//Convert the 32-bit int blocks to float.
 		//Apparently there's no direct epi8 to ps conversion instruction.
 		__m256 block0_float = _mm256_cvtepi32_ps(block0_int);
@@ -2337,14 +2287,16 @@ void LeCroyOscilloscope::Convert8BitSamplesAVX2(
 
 	//Get any extras we didn't get in the SIMD loop
 	for(unsigned int k=end; k<count; k++)
-	{
-		offs[k] = ibase + k;
-		durs[k] = 1;
 		pout[k] = pin[k] * gain - offset;
-	}
 }
 
-map<int, DigitalWaveform*> LeCroyOscilloscope::ProcessDigitalWaveform(string& data)
+/**
+	@brief Converts the XML digital waveform block to one waveform per enabled line
+
+	Called on the conversion threads like ProcessAnalogWaveform(), and likewise only reads configuration fixed at
+	construction time (the digital channel list).
+ */
+map<int, DigitalWaveform*> LeCroyOscilloscope::ProcessDigitalWaveform(string& data) const
 {
 	map<int, DigitalWaveform*> ret;
 
@@ -2420,9 +2372,11 @@ map<int, DigitalWaveform*> LeCroyOscilloscope::ProcessDigitalWaveform(string& da
 	{
 		if(enabledChannels[i])
 		{
-			DigitalWaveform* cap = new DigitalWaveform;
+			DigitalWaveform* cap = WaveformPool::Allocate<DigitalWaveform>(num_samples);
 			cap->m_timescale = interval;
-			cap->m_densePacked = true;
+
+			//Not dense packed: runs of identical samples are merged into one below
+			cap->m_densePacked = false;
 
 			//Capture timestamp
 			cap->m_startTimestamp = start_time;
@@ -2463,11 +2417,9 @@ map<int, DigitalWaveform*> LeCroyOscilloscope::ProcessDigitalWaveform(string& da
 
 			}
 
-			//Done, shrink any unused space
+			//Done, trim to the deduplicated length.
+			//Keep the unused space, the buffers get recycled for the next capture.
 			cap->Resize(k);
-			cap->m_offsets.shrink_to_fit();
-			cap->m_durations.shrink_to_fit();
-			cap->m_samples.shrink_to_fit();
 
 			//See how much space we saved
 			/*
@@ -2495,16 +2447,15 @@ bool LeCroyOscilloscope::AcquireData()
 {
 	//State for this acquisition (may be more than one waveform)
 	uint32_t num_sequences = 1;
-	map<int, vector<WaveformBase*> > pending_waveforms;
 	double start = GetTime();
 	time_t ttime = 0;
 	double basetime = 0;
 	bool denabled = false;
-	map<int, string> analogWaveformData;
+	map<int, SCPITransport::BlockBufferPtr> analogWaveformData;
+	map<int, size_t> analogWaveformLen;
 	string wavetime;
 	bool enabled[8] = {false};
 	vector<string> wavedescs;
-	double* pwtime = NULL;
 	string digitalWaveformData;
 
 	//Acquire the data (but don't parse it)
@@ -2574,13 +2525,19 @@ bool LeCroyOscilloscope::AcquireData()
 			ttime = ExtractTimestamp(pdesc, basetime);
 			if(num_sequences > 1)
 				wavetime = m_transport->ReadReply();
-			pwtime = reinterpret_cast<double*>(&wavetime[16]);	//skip 16-byte SCPI header
 
 			//Read the data from each analog waveform
 			for(unsigned int i=0; i<m_analogChannelCount; i++)
 			{
 				if(enabled[i])
-					analogWaveformData[i] = m_transport->ReadReply();
+				{
+					analogWaveformData[i] = m_transport->ReadBinaryBlock(analogWaveformLen[i]);
+					if(!analogWaveformData[i])
+					{
+						LogDebug("failed to download analog waveform\n");
+						return false;
+					}
+				}
 			}
 		}
 
@@ -2604,63 +2561,82 @@ bool LeCroyOscilloscope::AcquireData()
 		m_triggerArmed = true;
 	}
 
-	//Process analog waveforms
-	vector< vector<WaveformBase*> > waveforms;
-	waveforms.resize(m_analogChannelCount);
-	for(unsigned int i=0; i<m_analogChannelCount; i++)
-	{
-		if(enabled[i])
+	//Convert the raw data on the conversion stage, so we can get started on the next download right away.
+	//Conversions may overlap with each other and with the next download, so the job only uses the const/static
+	//helpers and channel configuration that doesn't change after construction.
+	double dt = GetTime() - start;
+	LogTrace("Waveform download took %.3f ms\n", dt * 1000);
+
+	vector<bool> venabled(enabled, enabled + m_analogChannelCount);
+	QueueConversion([=,
+		analogWaveformData = move(analogWaveformData),
+		wavedescs = move(wavedescs),
+		wavetime = move(wavetime),
+		digitalWaveformData = move(digitalWaveformData)]() mutable
 		{
-			waveforms[i] = ProcessAnalogWaveform(
-				&analogWaveformData[i][16],			//skip 16-byte SCPI header DATA,\n#9xxxxxxxx
-				analogWaveformData[i].size() - 16,
-				wavedescs[i],
-				num_sequences,
-				ttime,
-				basetime,
-				pwtime);
-		}
-	}
+			double tstart = GetTime();
+			map<int, vector<WaveformBase*> > pending_waveforms;
+			double* pwtime = reinterpret_cast<double*>(&wavetime[16]);	//skip 16-byte SCPI header
 
-	//Save analog waveform data
-	for(unsigned int i=0; i<m_analogChannelCount; i++)
-	{
-		if(!enabled[i])
-			continue;
+			//Process analog waveforms
+			vector< vector<WaveformBase*> > waveforms;
+			waveforms.resize(m_analogChannelCount);
+			for(unsigned int i=0; i<m_analogChannelCount; i++)
+			{
+				if(venabled[i])
+				{
+					waveforms[i] = ProcessAnalogWaveform(
+						(const char*)analogWaveformData[i]->data(),
+						analogWaveformLen.at(i),
+						wavedescs[i],
+						num_sequences,
+						ttime,
+						basetime,
+						pwtime);
+				}
+			}
 
-		//Done, update the data
-		for(size_t j=0; j<num_sequences; j++)
-			pending_waveforms[i].push_back(waveforms[i][j]);
-	}
+			//Save analog waveform data
+			for(unsigned int i=0; i<m_analogChannelCount; i++)
+			{
+				if(!venabled[i])
+					continue;
 
-	//TODO: proper support for sequenced capture when digital channels are active
-	//(seems like this doesn't work right on at least wavesurfer 3000 series)
-	if(denabled)
-	{
-		//This is a weird XML-y format but I can't find any other way to get it :(
-		map<int, DigitalWaveform*> digwaves = ProcessDigitalWaveform(digitalWaveformData);
+				//Done, update the data
+				for(size_t j=0; j<num_sequences; j++)
+					pending_waveforms[i].push_back(waveforms[i][j]);
+			}
 
-		//Done, update the data
-		for(auto it : digwaves)
-			pending_waveforms[it.first].push_back(it.second);
-	}
+			//TODO: proper support for sequenced capture when digital channels are active
+			//(seems like this doesn't work right on at least wavesurfer 3000 series)
+			if(denabled)
+			{
+				//This is a weird XML-y format but I can't find any other way to get it :(
+				map<int, DigitalWaveform*> digwaves = ProcessDigitalWaveform(digitalWaveformData);
 
-	//Now that we have all of the pending waveforms, save them in sets across all channels
-	m_pendingWaveformsMutex.lock();
-	for(size_t i=0; i<num_sequences; i++)
-	{
-		SequenceSet s;
-		for(size_t j=0; j<m_channels.size(); j++)
-		{
-			if(pending_waveforms.find(j) != pending_waveforms.end())
-				s[m_channels[j]] = pending_waveforms[j][i];
-		}
-		m_pendingWaveforms.push_back(s);
-	}
-	m_pendingWaveformsMutex.unlock();
+				//Done, update the data
+				for(auto it : digwaves)
+					pending_waveforms[it.first].push_back(it.second);
+			}
 
-	double dt = GetTime() - start;
-	LogTrace("Waveform download and processing took %.3f ms\n", dt * 1000);
+			//Now that we have all of the pending waveforms, save them in sets across all channels
+			vector<SequenceSet> sets;
+			for(size_t i=0; i<num_sequences; i++)
+			{
+				SequenceSet s;
+				for(size_t j=0; j<m_channels.size(); j++)
+				{
+					if(pending_waveforms.find(j) != pending_waveforms.end())
+						s[m_channels[j]] = pending_waveforms[j][i];
+				}
+				sets.push_back(s);
+			}
+
+			double tconv = GetTime() - tstart;
+			LogTrace("Waveform processing took %.3f ms\n", tconv * 1000);
+
+			return sets;
+		});
 
 	return true;
 }
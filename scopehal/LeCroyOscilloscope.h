@@ -267,13 +267,11 @@ protected:
 		time_t ttime,
 		double basetime,
 		double* wavetime
-		);
-	std::map<int, DigitalWaveform*> ProcessDigitalWaveform(std::string& data);
+		) const;
+	std::map<int, DigitalWaveform*> ProcessDigitalWaveform(std::string& data) const;
 
-	void Convert8BitSamples(
-		int64_t* offs, int64_t* durs, float* pout, int8_t* pin, float gain, float offset, size_t count, int64_t ibase);
-	void Convert8BitSamplesAVX2(
-		int64_t* offs, int64_t* durs, float* pout, int8_t* pin, float gain, float offset, size_t count, int64_t ibase);
+	static void Convert8BitSamples(float* pout, int8_t* pin, float gain, float offset, size_t count);
+	static void Convert8BitSamplesAVX2(float* pout, int8_t* pin, float gain, float offset, size_t count);
 
 	//hardware analog channel count, independent of LA option etc
 	unsigned int m_analogChannelCount;
@@ -48,16 +48,40 @@ using namespace std;
 
 Oscilloscope::CreateMapType Oscilloscope::m_createprocs;
 
+//Depth of the pending waveform queue (segmented captures push one set per segment, so this needs to be fairly deep)
+static const size_t g_pendingWaveformQueueDepth = 16384;
+
+//How long to wait for the consumer to make room in the pending waveform queue before discarding a waveform
+static const int g_pendingWaveformTimeoutMs = 100;
+
+//Number of threads in the conversion stage, and how many jobs can be queued before AcquireData() has to wait
+static const size_t g_conversionThreadCount = 2;
+static const size_t g_maxQueuedConversions = 4;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
 Oscilloscope::Oscilloscope()
+	: m_pendingWaveforms(g_pendingWaveformQueueDepth)
+	, m_pendingWaveformStalls(0)
+	, m_pendingWaveformDrops(0)
+	, m_pendingWaveformHighWater(0)
+	, m_nextConversionSequence(0)
+	, m_nextCommitSequence(0)
+	, m_conversionGeneration(0)
+	, m_conversionShuttingDown(false)
+	, m_conversionCommitting(false)
+	, m_conversionStalls(0)
 {
 	m_trigger = NULL;
 }
 
 Oscilloscope::~Oscilloscope()
 {
+	//Drivers using the conversion stage should stop it in their own destructor, since jobs may reference them.
+	//This is just a backstop.
+	StopConversionThreads();
+
 	if(m_trigger)
 	{
 		delete m_trigger;
@@ -68,12 +92,7 @@ Oscilloscope::~Oscilloscope()
 		delete m_channels[i];
 	m_channels.clear();
 
-	for(auto set : m_pendingWaveforms)
-	{
-		for(auto it : set)
-			delete it.second;
-	}
-	m_pendingWaveforms.clear();
+	ClearPendingWaveforms();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -165,28 +184,29 @@ bool Oscilloscope::WaitForTrigger(int timeout)
 
 size_t Oscilloscope::GetPendingWaveformCount()
 {
-	lock_guard<mutex> lock(m_pendingWaveformsMutex);
 	return m_pendingWaveforms.size();
 }
 
 bool Oscilloscope::HasPendingWaveforms()
 {
-	lock_guard<mutex> lock(m_pendingWaveformsMutex);
-	return (m_pendingWaveforms.size() != 0);
+	return !m_pendingWaveforms.empty();
 }
 
 /**
 	@brief Discard any pending waveforms that haven't yet been processed
+
+	Waveforms from conversion jobs that are still in progress are discarded as well, once they finish.
  */
 void Oscilloscope::ClearPendingWaveforms()
 {
+	m_conversionGeneration ++;
+
 	lock_guard<mutex> lock(m_pendingWaveformsMutex);
-	while(!m_pendingWaveforms.empty())
+	SequenceSet set;
+	while(m_pendingWaveforms.Pop(set))
 	{
-		SequenceSet set = *m_pendingWaveforms.begin();
 		for(auto it : set)
-			delete it.second;
-		m_pendingWaveforms.pop_front();
+			WaveformPool::Release(it.second);
 	}
 }
 
@@ -196,17 +216,197 @@ void Oscilloscope::ClearPendingWaveforms()
 bool Oscilloscope::PopPendingWaveform()
 {
 	lock_guard<mutex> lock(m_pendingWaveformsMutex);
-	if(m_pendingWaveforms.size())
+	SequenceSet set;
+	if(m_pendingWaveforms.Pop(set))
 	{
-		SequenceSet set = *m_pendingWaveforms.begin();
 		for(auto it : set)
 			it.first->SetData(it.second, 0);	//assume stream 0
-		m_pendingWaveforms.pop_front();
 		return true;
 	}
 	return false;
 }
 
+/**
+	@brief Adds a set of waveforms to the pending queue. Drivers call this once per trigger.
+
+	If the queue is full, waits a little while for the consumer to catch up. If it still hasn't, the waveforms are
+	discarded rather than blocking acquisition indefinitely (the consumer may be waiting on a lock we hold).
+ */
+void Oscilloscope::PushPendingWaveform(SequenceSet& set)
+{
+	lock_guard<mutex> lock(m_pendingWaveformsPushMutex);
+
+	if(!m_pendingWaveforms.Push(set))
+	{
+		m_pendingWaveformStalls ++;
+
+		bool ok = false;
+		for(int i=0; i<g_pendingWaveformTimeoutMs && !ok; i++)
+		{
+			this_thread::sleep_for(chrono::milliseconds(1));
+			ok = m_pendingWaveforms.Push(set);
+		}
+
+		if(!ok)
+		{
+			m_pendingWaveformDrops ++;
+			LogWarning("Pending waveform queue full, dropping waveform\n");
+			for(auto it : set)
+				WaveformPool::Release(it.second);
+			return;
+		}
+	}
+
+	m_pendingWaveformHighWater = max(m_pendingWaveformHighWater, m_pendingWaveforms.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Acquisition pipeline
+
+/**
+	@brief Queues a conversion job to run on the conversion stage, then returns immediately.
+
+	This lets AcquireData() return as soon as the raw data has been downloaded (and the trigger re-armed), so the next
+	download overlaps with conversion of the current one. Jobs may run in parallel, but their waveforms are pushed to
+	the pending queue in the order the jobs were queued.
+
+	If too many jobs are already waiting, blocks until the conversion stage catches up.
+ */
+void Oscilloscope::QueueConversion(ConversionJob job)
+{
+	unique_lock<mutex> lock(m_conversionMutex);
+
+	//Spin up the worker threads the first time we're used
+	if(m_conversionThreads.empty())
+	{
+		m_conversionShuttingDown = false;
+		for(size_t i=0; i<g_conversionThreadCount; i++)
+			m_conversionThreads.push_back(thread(&Oscilloscope::ConversionThread, this));
+	}
+
+	//Backpressure
+	if(m_nextConversionSequence - m_nextCommitSequence >= g_maxQueuedConversions)
+	{
+		m_conversionStalls ++;
+		m_conversionJobDone.wait(lock, [&]
+			{ return m_nextConversionSequence - m_nextCommitSequence < g_maxQueuedConversions; });
+	}
+
+	PendingConversion pending;
+	pending.m_job = job;
+	pending.m_sequence = m_nextConversionSequence ++;
+	pending.m_generation = m_conversionGeneration;
+	m_conversionJobs.push_back(pending);
+	m_conversionJobReady.notify_one();
+}
+
+/**
+	@brief Gets the number of conversion jobs which have been queued but whose waveforms aren't available yet
+ */
+size_t Oscilloscope::GetPendingConversionCount()
+{
+	lock_guard<mutex> lock(m_conversionMutex);
+	return m_nextConversionSequence - m_nextCommitSequence;
+}
+
+/**
+	@brief Blocks until every queued conversion job has finished and its waveforms are in the pending queue
+ */
+void Oscilloscope::FlushConversions()
+{
+	unique_lock<mutex> lock(m_conversionMutex);
+	m_conversionJobDone.wait(lock, [&]
+		{ return m_nextCommitSequence == m_nextConversionSequence; });
+}
+
+/**
+	@brief Shuts down the conversion stage. Jobs which haven't started yet are discarded.
+ */
+void Oscilloscope::StopConversionThreads()
+{
+	{
+		lock_guard<mutex> lock(m_conversionMutex);
+		m_conversionShuttingDown = true;
+		m_conversionJobs.clear();
+		m_conversionJobReady.notify_all();
+	}
+
+	for(auto& t : m_conversionThreads)
+		t.join();
+	m_conversionThreads.clear();
+
+	//Free anything that finished but never got committed
+	lock_guard<mutex> lock(m_conversionMutex);
+	for(auto& it : m_conversionResults)
+	{
+		for(auto& set : it.second.second)
+		{
+			for(auto w : set)
+				WaveformPool::Release(w.second);
+		}
+	}
+	m_conversionResults.clear();
+	m_nextCommitSequence = m_nextConversionSequence;
+	m_conversionJobDone.notify_all();
+}
+
+void Oscilloscope::ConversionThread()
+{
+	unique_lock<mutex> lock(m_conversionMutex);
+	while(true)
+	{
+		m_conversionJobReady.wait(lock, [&]
+			{ return m_conversionShuttingDown || !m_conversionJobs.empty(); });
+		if(m_conversionShuttingDown)
+			break;
+
+		PendingConversion pending = m_conversionJobs.front();
+		m_conversionJobs.pop_front();
+
+		//Do the actual conversion without holding the lock
+		lock.unlock();
+		auto sets = pending.m_job();
+		lock.lock();
+
+		m_conversionResults[pending.m_sequence] = make_pair(pending.m_generation, move(sets));
+
+		//Only one thread commits at a time, so results stay in order.
+		//If another thread is already committing, it'll pick ours up when it gets to it.
+		if(m_conversionCommitting)
+			continue;
+		m_conversionCommitting = true;
+
+		//Commit any results that are now in order.
+		//PushPendingWaveform() may block on a full queue, so don't hold the lock while doing it.
+		while(true)
+		{
+			auto it = m_conversionResults.find(m_nextCommitSequence);
+			if(it == m_conversionResults.end())
+				break;
+			auto result = move(it->second);
+			m_conversionResults.erase(it);
+			lock.unlock();
+
+			//Throw away stale data from before the last ClearPendingWaveforms()
+			bool stale = (result.first != m_conversionGeneration);
+			for(auto& set : result.second)
+			{
+				if(stale)
+				{
+					for(auto w : set)
+						WaveformPool::Release(w.second);
+				}
+				else
+					PushPendingWaveform(set);
+			}
+
+			lock.lock();
+			m_nextCommitSequence ++;
+			m_conversionJobDone.notify_all();
+		}
+		m_conversionCommitting = false;
+	}
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Serialization
@@ -39,6 +39,9 @@
 class Instrument;
 
 #include "SCPITransport.h"
+#include "SPSCQueue.h"
+#include <condition_variable>
+#include <functional>
 
 /**
 	@brief Generic representation of an oscilloscope, logic analyzer, or spectrum analyzer.
@@ -714,12 +717,101 @@ public:
 	size_t GetPendingWaveformCount();
 	virtual bool PopPendingWaveform();
 
+	///@brief Number of times a waveform couldn't be pushed right away because the pending queue was full
+	uint64_t GetPendingWaveformStallCount()
+	{ return m_pendingWaveformStalls; }
+
+	///@brief Number of waveforms discarded because the pending queue stayed full
+	uint64_t GetPendingWaveformDropCount()
+	{ return m_pendingWaveformDrops; }
+
+	///@brief Largest number of waveforms that have been waiting in the pending queue at once
+	size_t GetPendingWaveformHighWaterMark()
+	{ return m_pendingWaveformHighWater; }
+
+	///@brief Number of times AcquireData() had to wait for the conversion stage to catch up
+	uint64_t GetConversionStallCount()
+	{ return m_conversionStalls; }
+
+	size_t GetPendingConversionCount();
+	void FlushConversions();
+
 protected:
 	typedef std::map<OscilloscopeChannel*, WaveformBase*> SequenceSet;
-	std::list<SequenceSet> m_pendingWaveforms;
+
+	void PushPendingWaveform(SequenceSet& set);
+
+	/**
+		@brief Queue of acquired waveforms waiting to be displayed.
+
+		The acquisition thread (or conversion stage) is the only producer and PopPendingWaveform() is the only
+		consumer, so the hand-off between them is lock-free.
+	 */
+	SPSCQueue<SequenceSet> m_pendingWaveforms;
+
+	///@brief Serializes consumers of m_pendingWaveforms (PopPendingWaveform, ClearPendingWaveforms)
 	std::mutex m_pendingWaveformsMutex;
+
+	///@brief Serializes producers of m_pendingWaveforms (the acquisition thread and the conversion stage)
+	std::mutex m_pendingWaveformsPushMutex;
+
+	std::atomic<uint64_t> m_pendingWaveformStalls;
+	std::atomic<uint64_t> m_pendingWaveformDrops;
+	size_t m_pendingWaveformHighWater;
+
 	std::recursive_mutex m_mutex;
 
+protected:
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Acquisition pipeline
+
+	/**
+		@brief A conversion job: turns raw data downloaded from the instrument into waveforms.
+
+		Returns one SequenceSet per trigger (more than one for segmented captures).
+	 */
+	typedef std::function<std::vector<SequenceSet>()> ConversionJob;
+
+	void QueueConversion(ConversionJob job);
+	void StopConversionThreads();
+	void ConversionThread();
+
+	///@brief A conversion job waiting to be run
+	struct PendingConversion
+	{
+		ConversionJob m_job;
+		uint64_t m_sequence;
+		uint64_t m_generation;
+	};
+
+	///@brief Guards all of the conversion state below
+	std::mutex m_conversionMutex;
+
+	///@brief Signaled when there's a new job, or when we're shutting down
+	std::condition_variable m_conversionJobReady;
+
+	///@brief Signaled when a job has been committed to m_pendingWaveforms
+	std::condition_variable m_conversionJobDone;
+
+	std::vector<std::thread> m_conversionThreads;
+	std::list<PendingConversion> m_conversionJobs;
+
+	///@brief Finished jobs which can't be committed yet because an earlier one is still running
+	std::map<uint64_t, std::pair<uint64_t, std::vector<SequenceSet> > > m_conversionResults;
+
+	uint64_t m_nextConversionSequence;
+	uint64_t m_nextCommitSequence;
+
+	///@brief Incremented by ClearPendingWaveforms() so results of jobs queued before then are thrown away
+	std::atomic<uint64_t> m_conversionGeneration;
+
+	bool m_conversionShuttingDown;
+
+	///@brief True while a conversion thread is pushing results to m_pendingWaveforms (with the lock released)
+	bool m_conversionCommitting;
+
+	std::atomic<uint64_t> m_conversionStalls;
+
 protected:
 
 	///The channels
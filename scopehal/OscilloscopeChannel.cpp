@@ -118,7 +118,7 @@ void OscilloscopeChannel::SetDefaultDisplayName()
 OscilloscopeChannel::~OscilloscopeChannel()
 {
 	for(auto p : m_streamData)
-		delete p;
+		WaveformPool::Release(p);
 	m_streamData.clear();
 	m_streamNames.clear();
 }
@@ -304,10 +304,15 @@ bool OscilloscopeChannel::IsInverted()
 
 void OscilloscopeChannel::SetData(WaveformBase* pNew, size_t stream)
 {
+	//Re-publishing the same waveform means its contents changed in place
 	if(m_streamData[stream] == pNew)
+	{
+		if(pNew)
+			pNew->MarkModified();
 		return;
+	}
 
-	if(m_streamData[stream] != NULL)
-		delete m_streamData[stream];
+	//Recycle the old waveform's buffers rather than freeing them
+	WaveformPool::Release(m_streamData[stream]);
 	m_streamData[stream] = pNew;
 }
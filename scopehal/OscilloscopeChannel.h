@@ -98,8 +98,29 @@ public:
 	std::string GetStreamName(size_t stream)
 	{ return m_streamNames[stream]; }
 
-	///Get the contents of a data stream
+	/**
+		@brief Get the contents of a data stream
+
+		If the waveform has implicit timestamps, they're filled in before returning so that m_offsets and
+		m_durations can be accessed directly.
+	 */
 	WaveformBase* GetData(size_t stream)
+	{
+		if(stream >= m_streamData.size())
+			return NULL;
+		auto data = m_streamData[stream];
+		if(data)
+			data->MaterializeTimestamps();
+		return data;
+	}
+
+	/**
+		@brief Get the contents of a data stream without filling in implicit timestamps
+
+		Callers must use WaveformBase::GetOffset() / GetDuration() rather than accessing m_offsets and m_durations
+		directly, unless the waveform is known not to have implicit timestamps.
+	 */
+	WaveformBase* GetDataImplicit(size_t stream)
 	{
 		if(stream >= m_streamData.size())
 			return NULL;
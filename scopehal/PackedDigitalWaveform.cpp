@@ -0,0 +1,134 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of PackedDigitalWaveform
+ */
+
+#include "scopehal.h"
+#include <immintrin.h>
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Conversion to/from DigitalWaveform
+
+/**
+	@brief Replaces the contents of this waveform with a bit-packed copy of a DigitalWaveform
+
+	Timestamps are dropped if the input is dense packed, and copied otherwise.
+ */
+void PackedDigitalWaveform::Pack(DigitalWaveform* in)
+{
+	m_timescale			= in->m_timescale;
+	m_startTimestamp	= in->m_startTimestamp;
+	m_startFemtoseconds	= in->m_startFemtoseconds;
+	m_triggerPhase		= in->m_triggerPhase;
+	m_densePacked		= in->m_densePacked;
+
+	size_t len = in->m_samples.size();
+	Resize(len);
+	if(len == 0)
+		return;
+
+	if(!m_densePacked)
+		CopyTimestamps(in);
+
+	uint8_t* samples = (uint8_t*)&in->m_samples[0];
+	if(g_hasAvx2)
+		PackInnerAVX2(&m_words[0], samples, len);
+	else
+		PackInner(&m_words[0], samples, len);
+}
+
+void PackedDigitalWaveform::PackInner(uint64_t* words, const uint8_t* samples, size_t len)
+{
+	size_t nwords = GetWordCount(len);
+	for(size_t w=0; w<nwords; w++)
+	{
+		size_t base = w*64;
+		size_t n = min((size_t)64, len - base);
+
+		uint64_t word = 0;
+		for(size_t j=0; j<n; j++)
+		{
+			if(samples[base + j])
+				word |= (1ULL << j);
+		}
+		words[w] = word;
+	}
+}
+
+__attribute__((target("avx2")))
+void PackedDigitalWaveform::PackInnerAVX2(uint64_t* words, const uint8_t* samples, size_t len)
+{
+	size_t nfull = len / 64;
+	__m256i zero = _mm256_setzero_si256();
+
+	//Each movemask of a compare against zero gives us 32 packed samples (inverted)
+	for(size_t w=0; w<nfull; w++)
+	{
+		__m256i lo = _mm256_loadu_si256((__m256i*)(samples + w*64));
+		__m256i hi = _mm256_loadu_si256((__m256i*)(samples + w*64 + 32));
+		uint32_t mlo = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, zero));
+		uint32_t mhi = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, zero));
+		words[w] = (static_cast<uint64_t>(mhi) << 32) | mlo;
+	}
+
+	//Get any extras
+	if(len % 64)
+		PackInner(words + nfull, samples + nfull*64, len % 64);
+}
+
+/**
+	@brief Converts this waveform to a DigitalWaveform, for use by code which doesn't understand packed waveforms
+ */
+void PackedDigitalWaveform::Unpack(DigitalWaveform* out)
+{
+	out->m_timescale			= m_timescale;
+	out->m_startTimestamp		= m_startTimestamp;
+	out->m_startFemtoseconds	= m_startFemtoseconds;
+	out->m_triggerPhase			= m_triggerPhase;
+	out->m_densePacked			= m_densePacked;
+
+	size_t len = m_size;
+	if(m_densePacked)
+		out->ResizeImplicit(len);
+	else
+	{
+		out->Resize(len);
+		if(len)
+			out->CopyTimestamps(this);
+	}
+
+	for(size_t i=0; i<len; i++)
+		out->m_samples[i] = GetSample(i);
+}
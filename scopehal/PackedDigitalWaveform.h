@@ -0,0 +1,158 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of PackedDigitalWaveform
+ */
+
+#ifndef PackedDigitalWaveform_h
+#define PackedDigitalWaveform_h
+
+#include "Waveform.h"
+
+/**
+	@brief A digital waveform storing one bit per sample, 64 samples per word
+
+	A DigitalWaveform costs one byte per sample plus 16 bytes of timestamps. For deep logic analyzer captures this
+	is far more than the data itself, so drivers and filters working with large dense captures can use this instead.
+
+	Sample i is stored in bit (i % 64) of m_words[i / 64]. Any bits past the end of the waveform are zero.
+
+	If m_densePacked is set, m_offsets and m_durations are left empty: sample i implicitly starts at timestep i and
+	lasts one timestep (see WaveformBase::HasImplicitTimestamps()). Use GetOffset() / GetDuration() rather than
+	accessing the vectors directly.
+	If m_densePacked is clear, m_offsets and m_durations hold one entry per sample as usual.
+
+	Legacy code expecting a DigitalWaveform can use Unpack(), and Pack() converts the other way.
+ */
+class PackedDigitalWaveform : public WaveformBase
+{
+public:
+	PackedDigitalWaveform()
+	: m_size(0)
+	{ m_densePacked = true; }
+
+	typedef std::vector< uint64_t, AlignedAllocator<uint64_t, 64> > WordVector;
+
+	///@brief Packed sample data
+	WordVector m_words;
+
+	///@brief Gets the number of samples in the waveform
+	virtual size_t size()
+	{ return m_size; }
+
+	///@brief Packed waveforms always keep implicit timestamps, legacy code must use Unpack() instead
+	virtual void MaterializeTimestamps()
+	{}
+
+	///@brief Gets the number of 64-bit words needed to store a given number of samples
+	static size_t GetWordCount(size_t size)
+	{ return (size + 63) / 64; }
+
+	bool GetSample(size_t i)
+	{ return (m_words[i / 64] >> (i % 64)) & 1; }
+
+	/**
+		@brief Gets up to 64 consecutive samples starting at sample i, with sample i in the LSB.
+
+		The samples must all be within the waveform.
+	 */
+	uint64_t ExtractBits(size_t i, size_t count)
+	{
+		size_t w = i / 64;
+		size_t b = i % 64;
+		uint64_t value = m_words[w] >> b;
+		if( (b != 0) && (b + count > 64) )
+			value |= m_words[w+1] << (64 - b);
+		if(count < 64)
+			value &= (1ULL << count) - 1;
+		return value;
+	}
+
+	void SetSample(size_t i, bool value)
+	{
+		uint64_t mask = 1ULL << (i % 64);
+		if(value)
+			m_words[i / 64] |= mask;
+		else
+			m_words[i / 64] &= ~mask;
+	}
+
+	/**
+		@brief Resizes the waveform.
+
+		Newly added samples are zero. Timestamps are only allocated if the waveform is not dense packed, so
+		m_densePacked should be set before calling this.
+	 */
+	virtual void Resize(size_t size)
+	{
+		m_size = size;
+		m_words.resize(GetWordCount(size), 0);
+
+		//Clear any leftover bits past the new end in the last partial word
+		if(size % 64)
+			m_words[size / 64] &= (1ULL << (size % 64)) - 1;
+
+		if(m_densePacked)
+		{
+			m_offsets.clear();
+			m_durations.clear();
+		}
+		else
+		{
+			m_offsets.resize(size);
+			m_durations.resize(size);
+		}
+
+		MarkModified();
+	}
+
+	virtual void clear()
+	{
+		m_size = 0;
+		m_words.clear();
+		m_offsets.clear();
+		m_durations.clear();
+		MarkModified();
+	}
+
+	void Pack(DigitalWaveform* in);
+	void Unpack(DigitalWaveform* out);
+
+protected:
+	static void PackInner(uint64_t* words, const uint8_t* samples, size_t len);
+	static void PackInnerAVX2(uint64_t* words, const uint8_t* samples, size_t len);
+
+	///@brief Number of samples
+	size_t m_size;
+};
+
+#endif
@@ -52,9 +52,10 @@ void PeakDetector::FindPeaks(AnalogWaveform* cap, int64_t max_peaks, float searc
 		m_peaks.clear();
 	else
 	{
-		//Get peak search width in bins
+		//Get peak search width in bins.
+		//Search at least one bin each side, so coarse spectra (e.g. Welch averaged) with bins wider than the window work
 		int64_t search_bins = ceil(search_hz / cap->m_timescale);
-		int64_t search_rad = search_bins/2;
+		int64_t search_rad = max(search_bins/2, (int64_t)1);
 
 		//Find peaks (TODO: can we vectorize/multithread this?)
 		//Start at index 1 so we don't waste a marker on the DC peak
@@ -349,20 +349,16 @@ bool PicoOscilloscope::AcquireData()
 		auto offset = GetChannelOffset(chnum);
 
 		//Create our waveform
-		AnalogWaveform* cap = new AnalogWaveform;
+		AnalogWaveform* cap = WaveformPool::Allocate<AnalogWaveform>(memdepth);
 		cap->m_timescale = fs_per_sample;
 		cap->m_triggerPhase = 0;
 		cap->m_startTimestamp = time(NULL);
 		cap->m_densePacked = true;
 		double t = GetTime();
 		cap->m_startFemtoseconds = (t - floor(t)) * FS_PER_SECOND;
-		cap->Resize(memdepth);
+		cap->ResizeImplicit(memdepth);
 		for(size_t j=0; j<memdepth; j++)
-		{
-			cap->m_offsets[j] = j;
-			cap->m_durations[j] = 1;
 			cap->m_samples[j] = (buf[j] * scale) + offset;
-		}
 
 		s[m_channels[chnum]] = cap;
 
@@ -371,9 +367,7 @@ bool PicoOscilloscope::AcquireData()
 	}
 
 	//Save the waveforms to our queue
-	m_pendingWaveformsMutex.lock();
-	m_pendingWaveforms.push_back(s);
-	m_pendingWaveformsMutex.unlock();
+	PushPendingWaveform(s);
 
 	//If this was a one-shot trigger we're no longer armed
 	if(m_triggerOneShot)
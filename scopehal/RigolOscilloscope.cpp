@@ -625,7 +625,6 @@ bool RigolOscilloscope::AcquireData()
 		maxpoints = 8192; // FIXME
 	else if(m_protocol == MSO5)
 		maxpoints = GetSampleDepth();	 //You can use 250E6 points too, but it is very slow
-	unsigned char* temp_buf = new unsigned char[maxpoints + 1];
 	map<int, vector<AnalogWaveform*>> pending_waveforms;
 	for(size_t i = 0; i < m_analogChannelCount; i++)
 	{
@@ -716,34 +715,20 @@ bool RigolOscilloscope::AcquireData()
 				m_transport->SendCommand("WAV:DATA?");
 			}
 
-			//Read block header
-			unsigned char header[12] = {0};
-
-			unsigned char header_size;
-			m_transport->ReadRawData(2, header);
-			//LogWarning("Time %f\n", (GetTime() - start));
-
-			sscanf((char*)header, "#%c", &header_size);
-			header_size = header_size - '0';
-
-			m_transport->ReadRawData(header_size, header);
-
-			//Look up the block size
-			//size_t blocksize = end - npoints;
-			//LogDebug("Block size = %zu\n", blocksize);
+			//Read the block (the trailing byte is the response terminator, ReadBinaryBlock() discards it)
 			size_t header_blocksize;
-			sscanf((char*)header, "%zu", &header_blocksize);
+			auto block = m_transport->ReadBinaryBlock(header_blocksize);
 			//LogDebug("Header block size = %zu\n", header_blocksize);
 
-			if (header_blocksize == 0)
+			if(!block || (header_blocksize == 0) )
 			{
 				LogWarning("Ran out of data after %zu points\n", npoint);
 				break;
 			}
 
-			//Read actual block content and decode it
+			//Decode the block content
 			//Scale: (value - Yorigin - Yref) * Yinc
-			m_transport->ReadRawData(header_blocksize + 1, temp_buf);	 //why is there a trailing byte here??´
+			unsigned char* temp_buf = block->data();
 
 			double ydelta = yorigin + yreference;
 			cap->Resize(cap->m_samples.size() + header_blocksize);
@@ -766,7 +751,6 @@ bool RigolOscilloscope::AcquireData()
 	}
 
 	//Now that we have all of the pending waveforms, save them in sets across all channels
-	m_pendingWaveformsMutex.lock();
 	size_t num_pending = 1;	//TODO: segmented capture support
 	for(size_t i = 0; i < num_pending; i++)
 	{
@@ -776,12 +760,8 @@ bool RigolOscilloscope::AcquireData()
 			if(enabled[j])
 				s[m_channels[j]] = pending_waveforms[j][i];
 		}
-		m_pendingWaveforms.push_back(s);
+		PushPendingWaveform(s);
 	}
-	m_pendingWaveformsMutex.unlock();
-
-	//Clean up
-	delete[] temp_buf;
 
 	//TODO: support digital channels
 
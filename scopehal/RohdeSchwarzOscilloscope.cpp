@@ -462,7 +462,6 @@ bool RohdeSchwarzOscilloscope::AcquireData()
 	}
 
 	//Now that we have all of the pending waveforms, save them in sets across all channels
-	m_pendingWaveformsMutex.lock();
 	size_t num_pending = 1;	//TODO: segmented capture support
 	for(size_t i=0; i<num_pending; i++)
 	{
@@ -472,9 +471,8 @@ bool RohdeSchwarzOscilloscope::AcquireData()
 			if(IsChannelEnabled(j))
 				s[m_channels[j]] = pending_waveforms[j][i];
 		}
-		m_pendingWaveforms.push_back(s);
+		PushPendingWaveform(s);
 	}
-	m_pendingWaveformsMutex.unlock();
 
 	//TODO: support digital channels
 
@@ -37,11 +37,19 @@
 
 using namespace std;
 
+//Size of the receive buffer.
+//Reads of at least this size bypass the buffer and go straight to the caller.
+static const size_t g_rxBufferSize = 1024 * 1024;
+static const size_t g_rxDirectThreshold = 64 * 1024;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
 SCPISocketTransport::SCPISocketTransport(const string& args)
 	: m_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)
+	, m_rxStart(0)
+	, m_rxEnd(0)
+	, m_dropNewline(false)
 {
 	char hostname[128];
 	unsigned int port = 0;
@@ -62,6 +70,9 @@ SCPISocketTransport::SCPISocketTransport(const string& args)
 
 SCPISocketTransport::SCPISocketTransport(const string& hostname, unsigned short port)
 	: m_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)
+	, m_rxStart(0)
+	, m_rxEnd(0)
+	, m_dropNewline(false)
 	, m_hostname(hostname)
 	, m_port(port)
 {
@@ -72,6 +83,8 @@ void SCPISocketTransport::SharedCtorInit()
 {
 	LogDebug("Connecting to SCPI oscilloscope at %s:%d\n", m_hostname.c_str(), m_port);
 
+	m_rxBuffer.resize(g_rxBufferSize);
+
 	if(!m_socket.Connect(m_hostname, m_port))
 	{
 		m_socket.Close();
@@ -127,19 +140,82 @@ bool SCPISocketTransport::SendCommand(const string& cmd)
 	return m_socket.SendLooped((unsigned char*)tempbuf.c_str(), tempbuf.length());
 }
 
+/**
+	@brief Reads whatever data is available from the socket into the receive buffer
+
+	Blocks until at least one byte is available, or the receive timeout expires.
+
+	@return True if any data was read
+ */
+bool SCPISocketTransport::FillRxBuffer()
+{
+	//Move unconsumed data to the start of the buffer to make room at the end
+	if(m_rxStart == m_rxEnd)
+		m_rxStart = m_rxEnd = 0;
+	else if(m_rxEnd == m_rxBuffer.size())
+	{
+		memmove(&m_rxBuffer[0], &m_rxBuffer[m_rxStart], m_rxEnd - m_rxStart);
+		m_rxEnd -= m_rxStart;
+		m_rxStart = 0;
+	}
+
+	while(true)
+	{
+		int len = recv(m_socket, (char*)&m_rxBuffer[m_rxEnd], m_rxBuffer.size() - m_rxEnd, 0);
+		if(len > 0)
+		{
+			m_rxEnd += len;
+
+			//Drop the terminator of a binary block if it arrived after ReadBinaryBlockData() returned
+			if(m_dropNewline)
+			{
+				m_dropNewline = false;
+				if(m_rxBuffer[m_rxStart] == '\n')
+					m_rxStart ++;
+				if(m_rxStart == m_rxEnd)
+					continue;
+			}
+			return true;
+		}
+
+		//Retry if we got interrupted, fail on timeout/disconnect/error
+		if( (len < 0) && (errno == EINTR) )
+			continue;
+		return false;
+	}
+}
+
 string SCPISocketTransport::ReadReply(bool endOnSemicolon)
 {
-	//FIXME: there *has* to be a more efficient way to do this...
-	char tmp = ' ';
 	string ret;
 	while(true)
 	{
-		if(!m_socket.RecvLooped((unsigned char*)&tmp, 1))
+		if( (m_rxStart == m_rxEnd) && !FillRxBuffer() )
 			break;
-		if( (tmp == '\n') || ( (tmp == ';') && endOnSemicolon ) )
-			break;
-		else
-			ret += tmp;
+
+		//Look for the end of the reply in what we have so far
+		char* start = (char*)&m_rxBuffer[m_rxStart];
+		size_t avail = m_rxEnd - m_rxStart;
+		char* end = (char*)memchr(start, '\n', avail);
+		if(endOnSemicolon)
+		{
+			char* semi = (char*)memchr(start, ';', end ? (end - start) : avail);
+			if(semi)
+				end = semi;
+		}
+
+		//Not found, save it all and read more
+		if(!end)
+		{
+			ret.append(start, avail);
+			m_rxStart = m_rxEnd;
+			continue;
+		}
+
+		//Found it, consume the terminator too
+		ret.append(start, end - start);
+		m_rxStart += (end - start) + 1;
+		break;
 	}
 	LogTrace("Got %s\n", ret.c_str());
 	return ret;
@@ -152,8 +228,55 @@ void SCPISocketTransport::SendRawData(size_t len, const unsigned char* buf)
 
 size_t SCPISocketTransport::ReadRawData(size_t len, unsigned char* buf)
 {
-	if(!m_socket.RecvLooped(buf, len))
+	//Use whatever we have buffered first
+	size_t nbuf = min(len, m_rxEnd - m_rxStart);
+	if(nbuf)
+	{
+		memcpy(buf, &m_rxBuffer[m_rxStart], nbuf);
+		m_rxStart += nbuf;
+	}
+	size_t remaining = len - nbuf;
+	if(remaining == 0)
+		return len;
+
+	//Big reads go straight into the caller's buffer with no extra copy
+	//(unless a block terminator may still be on its way, FillRxBuffer() has to strip that)
+	if( (remaining >= g_rxDirectThreshold) && !m_dropNewline )
+	{
+		if(!m_socket.RecvLooped(buf + nbuf, remaining))
+			return 0;
+		return len;
+	}
+
+	//Small reads (block headers etc) go through the buffer so we don't make tons of tiny recv() calls
+	while(remaining)
+	{
+		if(!FillRxBuffer())
+			return 0;
+
+		size_t n = min(remaining, m_rxEnd - m_rxStart);
+		memcpy(buf + len - remaining, &m_rxBuffer[m_rxStart], n);
+		m_rxStart += n;
+		remaining -= n;
+	}
+	return len;
+}
+
+/**
+	@brief Reads the payload of a binary block, then consumes the trailing newline if there is one
+
+	Not all instruments send a terminator after a block, so we never wait for one. If nothing has been received past
+	the end of the block yet, the next byte to arrive is dropped if it's a newline.
+ */
+size_t SCPISocketTransport::ReadBinaryBlockData(size_t len, unsigned char* buf)
+{
+	if(len != ReadRawData(len, buf))
 		return 0;
+
+	if(m_rxStart == m_rxEnd)
+		m_dropNewline = true;
+	else if(m_rxBuffer[m_rxStart] == '\n')
+		m_rxStart ++;
 	return len;
 }
 
@@ -59,6 +59,8 @@ public:
 	virtual bool IsCommandBatchingSupported();
 	virtual bool IsConnected();
 
+	virtual size_t ReadBinaryBlockData(size_t len, unsigned char* buf);
+
 	TRANSPORT_INITPROC(SCPISocketTransport)
 
 	const std::string& GetHostname()
@@ -71,8 +73,22 @@ protected:
 
 	void SharedCtorInit();
 
+	bool FillRxBuffer();
+
 	Socket m_socket;
 
+	///@brief Buffer for received data which hasn't been consumed yet
+	std::vector<unsigned char> m_rxBuffer;
+
+	///@brief Index of the first unconsumed byte in m_rxBuffer
+	size_t m_rxStart;
+
+	///@brief Index one past the last valid byte in m_rxBuffer
+	size_t m_rxEnd;
+
+	///@brief True if the next byte received should be discarded if it's a newline (see ReadBinaryBlockData())
+	bool m_dropNewline;
+
 	std::string m_hostname;
 	unsigned short m_port;
 };
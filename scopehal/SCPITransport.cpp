@@ -39,6 +39,10 @@ using namespace std;
 
 SCPITransport::CreateMapType SCPITransport::m_createprocs;
 
+//Idle buffers kept in the block pool: enough for a few channels of a deep capture to be downloaded while the
+//previous one is still being converted, without pinning more than that
+BufferPool<unsigned char> SCPITransport::m_blockPool(32, 1024LL * 1024 * 1024);
+
 SCPITransport::SCPITransport()
 {
 }
@@ -162,3 +166,116 @@ void* SCPITransport::SendCommandImmediateWithRawBlockReply(string cmd, size_t& l
 	len = ReadRawData(len, buf);
 	return buf;
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Binary block API
+
+/**
+	@brief Reads the header of an IEEE 488.2 definite length binary block (#<n><length>)
+
+	Any prefix before the '#' (for example a command echo like "DAT1,") is discarded. After this returns, exactly
+	len bytes of block data are waiting to be read by ReadBinaryBlockData(), which can read them straight into a
+	caller-provided buffer.
+
+	Indefinite length blocks (#0) are not supported.
+
+	@param len	Length of the block payload, in bytes
+
+	@return True on success, false on a malformed header or I/O error
+ */
+bool SCPITransport::ReadBinaryBlockHeader(size_t& len)
+{
+	//Skip anything before the start of the block, but don't wander off into a text reply forever
+	const size_t maxprefix = 64;
+	char c = 0;
+	size_t i = 0;
+	for(; i<maxprefix; i++)
+	{
+		if(1 != ReadRawData(1, (unsigned char*)&c))
+			return false;
+		if(c == '#')
+			break;
+	}
+	if(i == maxprefix)
+	{
+		LogError("ReadBinaryBlockHeader: no block header found\n");
+		return false;
+	}
+
+	//Number of length digits
+	if(1 != ReadRawData(1, (unsigned char*)&c))
+		return false;
+	if( (c < '1') || (c > '9') )
+	{
+		LogError("ReadBinaryBlockHeader: bad or indefinite length block header (#%c)\n", c);
+		return false;
+	}
+	size_t ndigits = c - '0';
+
+	//Read the length
+	char digits[10] = {0};
+	if(ndigits != ReadRawData(ndigits, (unsigned char*)digits))
+		return false;
+	len = strtoull(digits, NULL, 10);
+	return true;
+}
+
+/**
+	@brief Reads the payload of a binary block whose header was read by ReadBinaryBlockHeader()
+
+	Not all instruments send a response terminator after the block, so this doesn't try to read one. Message based
+	transports discard the rest of the reply when the next command is sent. Stream based transports override this
+	to drop the terminator if and when it arrives (see SCPISocketTransport and SCPIUARTTransport).
+
+	@param len	Number of bytes to read (as returned by ReadBinaryBlockHeader())
+	@param buf	Output buffer, must be at least len bytes in size
+
+	@return Number of bytes read
+ */
+size_t SCPITransport::ReadBinaryBlockData(size_t len, unsigned char* buf)
+{
+	return ReadRawData(len, buf);
+}
+
+/**
+	@brief Reads a complete binary block (header and payload) into a pooled buffer
+
+	Conversion code can consume the buffer in place. It goes back to the pool as soon as the last reference to it is
+	dropped, so there's no need to free it.
+
+	@param len	Length of the block payload, in bytes. The buffer may be larger than this.
+
+	@return The buffer, or NULL on failure
+ */
+SCPITransport::BlockBufferPtr SCPITransport::ReadBinaryBlock(size_t& len)
+{
+	lock_guard<recursive_mutex> lock(m_netMutex);
+
+	if(!ReadBinaryBlockHeader(len))
+		return NULL;
+
+	auto buf = AllocateBlockBuffer(len);
+	if(len != ReadBinaryBlockData(len, buf->data()))
+		return NULL;
+	return buf;
+}
+
+/**
+	@brief Sends a command (jumping ahead of the queue) which reads a binary block response into a pooled buffer
+
+	This is an atomic operation requiring no mutexing at the caller side.
+ */
+SCPITransport::BlockBufferPtr SCPITransport::SendCommandImmediateWithBinaryBlockReply(string cmd, size_t& len)
+{
+	lock_guard<recursive_mutex> lock(m_netMutex);
+	SendCommand(cmd);
+	return ReadBinaryBlock(len);
+}
+
+/**
+	@brief Gets a buffer of at least len bytes from the block pool, allocating a new one if none are free
+ */
+SCPITransport::BlockBufferPtr SCPITransport::AllocateBlockBuffer(size_t len)
+{
+	return m_blockPool.Get(len);
+}
@@ -36,6 +36,9 @@
 #ifndef SCPITransport_h
 #define SCPITransport_h
 
+#include <memory>
+#include "BufferPool.h"
+
 /**
 	@brief Abstraction of a transport layer for moving SCPI data between endpoints
  */
@@ -69,6 +72,25 @@ public:
 	virtual bool IsCommandBatchingSupported() =0;
 	virtual bool IsConnected() =0;
 
+	//IEEE 488.2 definite length binary block API
+	virtual bool ReadBinaryBlockHeader(size_t& len);
+	virtual size_t ReadBinaryBlockData(size_t len, unsigned char* buf);
+
+	///@brief A 64-byte aligned buffer for binary block data. May be larger than the block it holds.
+	typedef BufferPool<unsigned char>::Buffer BlockBuffer;
+
+	///@brief Reference to a pooled BlockBuffer, which is recycled when the last reference goes away
+	typedef BufferPool<unsigned char>::BufferPtr BlockBufferPtr;
+
+	BlockBufferPtr ReadBinaryBlock(size_t& len);
+	BlockBufferPtr SendCommandImmediateWithBinaryBlockReply(std::string cmd, size_t& len);
+
+	static BlockBufferPtr AllocateBlockBuffer(size_t len);
+
+	///@brief Sets the maximum total size, in bytes, of idle buffers in the block pool
+	static void SetMaxBlockPoolMemory(size_t bytes)
+	{ m_blockPool.SetMaxMemory(bytes); }
+
 public:
 	typedef SCPITransport* (*CreateProcType)(const std::string& args);
 	static void DoAddTransportClass(std::string name, CreateProcType proc);
@@ -86,6 +108,10 @@ protected:
 	std::mutex m_queueMutex;
 	std::recursive_mutex m_netMutex;
 	std::list<std::string> m_txQueue;
+
+	//Buffer pool for binary blocks.
+	//This is global rather than per transport, so buffers can safely outlive the transport that filled them.
+	static BufferPool<unsigned char> m_blockPool;
 };
 
 #define TRANSPORT_INITPROC(T) \
@@ -41,6 +41,7 @@ using namespace std;
 // Construction / destruction
 
 SCPIUARTTransport::SCPIUARTTransport(const string& args)
+	: m_dropNewline(false)
 {
 	char devfile[128];
 	unsigned int baudrate = 0;
@@ -107,6 +108,12 @@ string SCPIUARTTransport::ReadReply(bool endOnSemicolon)
 	{
 		if(!m_uart.Read((unsigned char*)&tmp, 1))
 			break;
+		if(m_dropNewline)
+		{
+			m_dropNewline = false;
+			if(tmp == '\n')
+				continue;
+		}
 		if( (tmp == '\n') || ( (tmp == ';') && endOnSemicolon ) )
 			break;
 		else
@@ -123,11 +130,43 @@ void SCPIUARTTransport::SendRawData(size_t len, const unsigned char* buf)
 
 size_t SCPIUARTTransport::ReadRawData(size_t len, unsigned char* buf)
 {
+	if(len == 0)
+		return 0;
+
+	//If the previous block's terminator is still pending, the first byte may be it
+	if(m_dropNewline)
+	{
+		m_dropNewline = false;
+		if(!m_uart.Read(buf, 1))
+			return 0;
+		if(buf[0] != '\n')
+		{
+			if( (len > 1) && !m_uart.Read(buf + 1, len - 1) )
+				return 0;
+			return len;
+		}
+	}
+
 	if(!m_uart.Read(buf, len))
 		return 0;
 	return len;
 }
 
+/**
+	@brief Reads the payload of a binary block
+
+	Rather than blocking until the read times out on instruments which don't send a terminator after the block, the
+	next byte received is dropped if it's a newline.
+ */
+size_t SCPIUARTTransport::ReadBinaryBlockData(size_t len, unsigned char* buf)
+{
+	if(len != ReadRawData(len, buf))
+		return 0;
+
+	m_dropNewline = true;
+	return len;
+}
+
 bool SCPIUARTTransport::IsCommandBatchingSupported()
 {
 	return true;
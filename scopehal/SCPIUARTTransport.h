@@ -55,6 +55,8 @@ public:
 	virtual size_t ReadRawData(size_t len, unsigned char* buf);
 	virtual void SendRawData(size_t len, const unsigned char* buf);
 
+	virtual size_t ReadBinaryBlockData(size_t len, unsigned char* buf);
+
 	virtual bool IsCommandBatchingSupported();
 	virtual bool IsConnected();
 
@@ -65,6 +67,9 @@ protected:
 
 	std::string m_devfile;
 	unsigned int m_baudrate;
+
+	///@brief True if the next byte received should be discarded if it's a newline (see ReadBinaryBlockData())
+	bool m_dropNewline;
 };
 
 #endif
@@ -0,0 +1,122 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SPSCQueue
+ */
+#ifndef SPSCQueue_h
+#define SPSCQueue_h
+
+#include <atomic>
+#include <vector>
+
+/**
+	@brief A bounded, lock-free queue with one producer thread and one consumer thread
+
+	Capacity is rounded up to a power of two. Push() fails rather than blocking when the queue is full, so the
+	producer can decide how to apply backpressure.
+
+	If more than one thread may push (or pop), the caller must serialize them (for example with a mutex on that side
+	only); the producer and consumer sides never block each other.
+ */
+template<class T>
+class SPSCQueue
+{
+public:
+	SPSCQueue(size_t capacity)
+		: m_head(0)
+		, m_tail(0)
+	{
+		size_t n = 1;
+		while(n < capacity)
+			n <<= 1;
+		m_slots.resize(n);
+		m_mask = n - 1;
+	}
+
+	//not copyable or assignable
+	SPSCQueue(const SPSCQueue&) =delete;
+	SPSCQueue& operator=(const SPSCQueue&) =delete;
+
+	/**
+		@brief Adds an item to the end of the queue (producer only)
+
+		@return False if the queue is full, in which case item is left untouched
+	 */
+	bool Push(T& item)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if(tail - m_head.load(std::memory_order_acquire) > m_mask)
+			return false;
+
+		m_slots[tail & m_mask] = std::move(item);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+		@brief Removes the item at the front of the queue (consumer only)
+
+		@return False if the queue is empty
+	 */
+	bool Pop(T& item)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if(head == m_tail.load(std::memory_order_acquire))
+			return false;
+
+		item = std::move(m_slots[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	///@brief Gets the number of items in the queue. Only a snapshot if the other side is active.
+	size_t size() const
+	{ return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+
+	bool empty() const
+	{ return size() == 0; }
+
+	size_t capacity() const
+	{ return m_mask + 1; }
+
+protected:
+	std::vector<T> m_slots;
+	size_t m_mask;
+
+	///@brief Index of the next item to pop (written by the consumer only)
+	alignas(64) std::atomic<size_t> m_head;
+
+	///@brief Index of the next free slot (written by the producer only)
+	alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif
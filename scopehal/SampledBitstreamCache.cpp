@@ -0,0 +1,170 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of SampledBitstreamCache
+ */
+#include "scopehal.h"
+#include "SampledBitstreamCache.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates the cache
+
+	@param maxBytes	Upper bound on the total size of the cached samples and timestamps
+ */
+SampledBitstreamCache::SampledBitstreamCache(size_t maxBytes)
+	: m_bytes(0)
+	, m_maxBytes(maxBytes)
+	, m_hits(0)
+	, m_misses(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache access
+
+/**
+	@brief Looks up a data waveform revision sampled on the given edges of a clock waveform revision
+
+	@return The cached bitstream, or an empty pointer if not present
+ */
+SampledBitstreamCache::BitstreamPtr SampledBitstreamCache::Find(
+	uint64_t dataRevision,
+	uint64_t clockRevision,
+	int edgeType)
+{
+	lock_guard<mutex> lock(m_mutex);
+
+	auto it = m_index.find(KeyType(dataRevision, clockRevision, edgeType));
+	if(it == m_index.end())
+	{
+		m_misses ++;
+		return BitstreamPtr();
+	}
+
+	//Move to the front of the LRU list
+	m_lru.splice(m_lru.begin(), m_lru, it->second);
+	m_hits ++;
+	return it->second->m_bits;
+}
+
+/**
+	@brief Adds a sampled bitstream to the cache, replacing any existing entry
+ */
+void SampledBitstreamCache::Insert(uint64_t dataRevision, uint64_t clockRevision, int edgeType, BitstreamPtr bits)
+{
+	KeyType key(dataRevision, clockRevision, edgeType);
+	size_t bytes = GetSize(bits);
+	lock_guard<mutex> lock(m_mutex);
+
+	//If another thread got here first, replace its result
+	auto it = m_index.find(key);
+	if(it != m_index.end())
+	{
+		m_bytes -= it->second->m_bytes;
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+
+	m_lru.push_front(Entry(key, bits, bytes));
+	m_index[key] = m_lru.begin();
+	m_bytes += bytes;
+
+	Evict();
+}
+
+/**
+	@brief Removes least recently used entries until the cache fits in the memory limit.
+
+	The most recently used entry is always kept, even if it alone exceeds the limit.
+
+	Must be called with m_mutex held.
+ */
+void SampledBitstreamCache::Evict()
+{
+	while( (m_bytes > m_maxBytes) && (m_lru.size() > 1) )
+	{
+		auto& e = m_lru.back();
+		m_bytes -= e.m_bytes;
+		m_index.erase(e.m_key);
+		m_lru.pop_back();
+	}
+}
+
+/**
+	@brief Removes all entries from the cache.
+
+	Bitstreams already handed out remain valid until their last user releases them.
+ */
+void SampledBitstreamCache::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_lru.clear();
+	m_index.clear();
+	m_bytes = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory management
+
+/**
+	@brief Changes the memory limit, evicting entries immediately if we're now over it
+ */
+void SampledBitstreamCache::SetMaxMemory(size_t bytes)
+{
+	m_maxBytes = bytes;
+
+	lock_guard<mutex> lock(m_mutex);
+	Evict();
+}
+
+/**
+	@brief Gets the total size of the samples and timestamps currently held by the cache
+ */
+size_t SampledBitstreamCache::GetMemoryUsage()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_bytes;
+}
+
+/**
+	@brief Gets the size of the packed samples and timestamps of a bitstream
+ */
+size_t SampledBitstreamCache::GetSize(const BitstreamPtr& bits)
+{
+	return bits->m_words.size() * sizeof(uint64_t) +
+		(bits->m_offsets.size() + bits->m_durations.size()) * sizeof(int64_t);
+}
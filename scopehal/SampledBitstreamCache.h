@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of SampledBitstreamCache
+ */
+#ifndef SampledBitstreamCache_h
+#define SampledBitstreamCache_h
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+class PackedDigitalWaveform;
+
+/**
+	@brief Thread-safe, memory-bounded cache of digital waveforms sampled on the edges of a clock
+
+	Entries are keyed by (data revision, clock revision, edge type). As with ZeroCrossingCache, revisions are never
+	reused so a stale entry can never be returned for a new waveform that happens to share an old one's address.
+
+	Each entry is a bit-packed waveform holding one sample per UI, with explicit per-UI offsets and durations in
+	femtoseconds. Lookups hand out a shared reference to the cached waveform, which stays valid for as long as the
+	caller holds it even if the entry is evicted. Callers must not modify it.
+
+	There are far fewer sampled bitstreams than zero crossing lists in a typical filter graph, so a single lock is
+	used rather than sharding.
+ */
+class SampledBitstreamCache
+{
+public:
+	SampledBitstreamCache(size_t maxBytes = 256 * 1024 * 1024);
+
+	typedef std::shared_ptr<PackedDigitalWaveform> BitstreamPtr;
+
+	BitstreamPtr Find(uint64_t dataRevision, uint64_t clockRevision, int edgeType);
+	void Insert(uint64_t dataRevision, uint64_t clockRevision, int edgeType, BitstreamPtr bits);
+	void Clear();
+
+	void SetMaxMemory(size_t bytes);
+
+	///@brief Gets the maximum number of bytes of sample data held by the cache
+	size_t GetMaxMemory()
+	{ return m_maxBytes; }
+
+	size_t GetMemoryUsage();
+
+	///@brief Gets the number of lookups which found a cached result
+	size_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Gets the number of lookups which did not find a cached result
+	size_t GetMissCount()
+	{ return m_misses; }
+
+protected:
+	typedef std::tuple<uint64_t, uint64_t, int> KeyType;
+
+	class Entry
+	{
+	public:
+		Entry(KeyType key, BitstreamPtr bits, size_t bytes)
+		: m_key(key)
+		, m_bits(bits)
+		, m_bytes(bytes)
+		{}
+
+		KeyType m_key;
+		BitstreamPtr m_bits;
+
+		///@brief Size of the packed samples and timestamps
+		size_t m_bytes;
+	};
+
+	void Evict();
+
+	static size_t GetSize(const BitstreamPtr& bits);
+
+	std::mutex m_mutex;
+
+	///@brief Entries in most- to least-recently-used order
+	std::list<Entry> m_lru;
+
+	///@brief Index into m_lru by key
+	std::map<KeyType, std::list<Entry>::iterator> m_index;
+
+	///@brief Total size of the data held by the cache
+	size_t m_bytes;
+
+	std::atomic<size_t> m_maxBytes;
+	std::atomic<size_t> m_hits;
+	std::atomic<size_t> m_misses;
+};
+
+#endif
@@ -299,14 +299,37 @@ bool SiglentSCPIOscilloscope::AcquireData()
 
 				//Read the actual waveform data
 				m_transport->SendCommand(m_channels[chanNr]->GetHwname() + ":WF? DAT2");
-				char header[maxWaveHeaderSize] = {0};
-				size_t wavesize = ReadWaveHeader(header);
-				uint8_t *data = new uint8_t[wavesize];
-				m_transport->ReadRawData(wavesize, data);
-				// two \n...
+				//The block is followed by two newlines. Read the payload with plain ReadRawData() rather than
+				//ReadBinaryBlockData(), since whether that drops the first newline depends on the transport,
+				//then consume both explicitly.
+				size_t wavesize;
+				SCPITransport::BlockBufferPtr block;
+				if(m_transport->ReadBinaryBlockHeader(wavesize))
+				{
+					block = SCPITransport::AllocateBlockBuffer(wavesize);
+					if(wavesize != m_transport->ReadRawData(wavesize, block->data()))
+						block = NULL;
+				}
+				if(!block)
+				{
+					//We're out of sync with the instrument, so anything else we read would be garbage too
+					LogError("Failed to read waveform data\n");
+					delete cap;
+					for(auto it : pending_waveforms)
+					{
+						for(auto w : it.second)
+							delete w;
+					}
+					for(auto d : wavedescs)
+						delete d;
+					return false;
+				}
+				uint8_t* data = block->data();
 				m_transport->ReadReply();
 				m_transport->ReadReply();
 
+				char header[maxWaveHeaderSize] = {0};
+
 				double trigtime = 0;
 				if( (num_sequences > 1) && (seqNr > 0) )
 				{
@@ -367,7 +390,6 @@ bool SiglentSCPIOscilloscope::AcquireData()
 		m_triggerArmed = true;
 	}
 
-	m_pendingWaveformsMutex.lock();
 	size_t num_pending = 1;	//TODO: segmented capture support
 	for(size_t i = 0; i < num_pending; ++i)
 	{
@@ -377,9 +399,8 @@ bool SiglentSCPIOscilloscope::AcquireData()
 			if(enabled[j])
 				s[m_channels[j]] = pending_waveforms[j][i];
 		}
-		m_pendingWaveforms.push_back(s);
+		PushPendingWaveform(s);
 	}
-	m_pendingWaveformsMutex.unlock();
 
 	double dt = GetTime() - start;
 	LogTrace("Waveform download took %.3f ms\n", dt * 1000);
@@ -1470,7 +1470,6 @@ bool TektronixOscilloscope::AcquireData()
 	}
 
 	//Now that we have all of the pending waveforms, save them in sets across all channels
-	m_pendingWaveformsMutex.lock();
 	size_t num_pending = 1;	//TODO: segmented capture support
 	for(size_t i=0; i<num_pending; i++)
 	{
@@ -1480,9 +1479,8 @@ bool TektronixOscilloscope::AcquireData()
 			if(IsChannelEnabled(j))
 				s[m_channels[j]] = pending_waveforms[j][i];
 		}
-		m_pendingWaveforms.push_back(s);
+		PushPendingWaveform(s);
 	}
-	m_pendingWaveformsMutex.unlock();
 
 	//Re-arm the trigger if not in one-shot mode
 	if(!m_triggerOneShot)
@@ -1767,8 +1765,8 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 
 		//Read the data block
 		size_t nsamples;
-		int8_t* samples = (int8_t*)m_transport->SendCommandImmediateWithRawBlockReply("CURV?", nsamples);
-		if(samples == NULL)
+		auto block = m_transport->SendCommandImmediateWithBinaryBlockReply("CURV?", nsamples);
+		if(!block)
 		{
 			//Resynchronize
 			LogWarning("Timeout, attempting to recover\n");
@@ -1777,6 +1775,7 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 
 			return false;
 		}
+		int8_t* samples = (int8_t*)block->data();
 
 		//Set up the capture we're going to store our data into
 		//(no TDC data or fine timestamping available on Tektronix scopes?)
@@ -1814,12 +1813,6 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 
 		//Done, update the data
 		pending_waveforms[i].push_back(cap);
-
-		//Done
-		delete[] samples;
-
-		//Throw out garbage at the end of the message (why is this needed?)
-		m_transport->ReadReply();
 	}
 
 	//Get the spectrum stuff
@@ -1866,9 +1859,10 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 
 		//Read the data block
 		size_t msglen;
-		double* samples = (double*)m_transport->SendCommandImmediateWithRawBlockReply("CURV?", msglen);
-		if(samples == NULL)
+		auto block = m_transport->SendCommandImmediateWithBinaryBlockReply("CURV?", msglen);
+		if(!block)
 			return false;
+		double* samples = (double*)block->data();
 		size_t nsamples = msglen/8;
 
 		//Set up the capture we're going to store our data into
@@ -1877,11 +1871,13 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 		cap->m_timescale = hzbase;
 		cap->m_triggerPhase = 0;
 		cap->m_startTimestamp = time(NULL);
-		cap->m_densePacked = true;
 		double t = GetTime();
 		cap->m_startFemtoseconds = (t - floor(t)) * FS_PER_SECOND;
 		cap->Resize(nsamples);
 
+		//Not dense packed: offsets start at the first frequency bin, not zero
+		cap->m_densePacked = false;
+
 		//We get dBm from the instrument, so just have to convert double to single precision
 		//TODO: are other units possible here?
 		int64_t ibase = hzoff / hzbase;
@@ -1895,12 +1891,6 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 		//Done, update the data
 		pending_waveforms[nchan].push_back(cap);
 
-		//Done
-		delete[] samples;
-
-		//Throw out garbage at the end of the message (why is this needed?)
-		m_transport->ReadReply();
-
 		//Look for peaks
 		//TODO: make this configurable, for now 1 MHz spacing and up to 10 peaks
 		dynamic_cast<SpectrumChannel*>(m_channels[nchan])->FindPeaks(cap, 10, 1000000);
@@ -1962,9 +1952,10 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 
 		//And the acutal data
 		size_t msglen;
-		char* samples = (char*)m_transport->SendCommandImmediateWithRawBlockReply("CURV?", msglen);
-		if(samples == NULL)
+		auto block = m_transport->SendCommandImmediateWithBinaryBlockReply("CURV?", msglen);
+		if(!block)
 			return false;
+		char* samples = (char*)block->data();
 
 		//Process the data for each channel
 		for(int j=0; j<8; j++)
@@ -1992,12 +1983,6 @@ bool TektronixOscilloscope::AcquireDataMSO56(map<int, vector<WaveformBase*> >& p
 			//Done, update the data
 			pending_waveforms[m_digitalChannelBase + i*8 + j].push_back(cap);
 		}
-
-		//Done
-		delete[] samples;
-
-		//Throw out garbage at the end of the message (why is this needed?)
-		m_transport->ReadReply();
 	}
 	return true;
 }
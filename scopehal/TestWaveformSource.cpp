@@ -44,33 +44,10 @@ using namespace std;
 TestWaveformSource::TestWaveformSource(mt19937& rng)
 	: m_rng(rng)
 {
-	m_forwardPlan = NULL;
-	m_reversePlan = NULL;
-
-	m_cachedNumPoints = 0;
-	m_cachedRawSize = 0;
-
-	m_forwardInBuf = NULL;
-	m_forwardOutBuf = NULL;
-	m_reverseOutBuf = NULL;
 }
 
 TestWaveformSource::~TestWaveformSource()
 {
-	if(m_forwardPlan)
-		ffts_free(m_forwardPlan);
-	if(m_reversePlan)
-		ffts_free(m_reversePlan);
-
-	m_allocator.deallocate(m_forwardInBuf);
-	m_allocator.deallocate(m_forwardOutBuf);
-	m_allocator.deallocate(m_reverseOutBuf);
-
-	m_forwardPlan = NULL;
-	m_reversePlan = NULL;
-	m_forwardInBuf = NULL;
-	m_forwardOutBuf = NULL;
-	m_reverseOutBuf = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -85,9 +62,9 @@ WaveformBase* TestWaveformSource::GenerateStep(
 	int64_t sampleperiod,
 	size_t depth)
 {
-	auto ret = new AnalogWaveform;
+	auto ret = WaveformPool::Allocate<AnalogWaveform>(depth);
 	ret->m_timescale = sampleperiod;
-	ret->Resize(depth);
+	ret->ResizeImplicit(depth);
 
 	size_t mid = depth/2;
 	for(size_t i=0; i<depth; i++)
@@ -96,9 +73,6 @@ WaveformBase* TestWaveformSource::GenerateStep(
 			ret->m_samples[i] = vlo;
 		else
 			ret->m_samples[i] = vhi;
-
-		ret->m_offsets[i] = i;
-		ret->m_durations[i] = 1;
 	}
 
 	return ret;
@@ -115,9 +89,9 @@ WaveformBase* TestWaveformSource::GenerateNoisySinewave(
 	size_t depth,
 	float noise_amplitude)
 {
-	auto ret = new AnalogWaveform;
+	auto ret = WaveformPool::Allocate<AnalogWaveform>(depth);
 	ret->m_timescale = sampleperiod;
-	ret->Resize(depth);
+	ret->ResizeImplicit(depth);
 
 	normal_distribution<> noise(0, noise_amplitude);
 
@@ -129,9 +103,6 @@ WaveformBase* TestWaveformSource::GenerateNoisySinewave(
 
 	for(size_t i=0; i<depth; i++)
 	{
-		ret->m_offsets[i] = i;
-		ret->m_durations[i] = 1;
-
 		ret->m_samples[i] = scale * sinf(i*radians_per_sample + startphase) + noise(m_rng);
 	}
 
@@ -151,9 +122,9 @@ WaveformBase* TestWaveformSource::GenerateNoisySinewaveMix(
 	size_t depth,
 	float noise_amplitude)
 {
-	auto ret = new AnalogWaveform;
+	auto ret = WaveformPool::Allocate<AnalogWaveform>(depth);
 	ret->m_timescale = sampleperiod;
-	ret->Resize(depth);
+	ret->ResizeImplicit(depth);
 
 	normal_distribution<> noise(0, noise_amplitude);
 
@@ -166,9 +137,6 @@ WaveformBase* TestWaveformSource::GenerateNoisySinewaveMix(
 
 	for(size_t i=0; i<depth; i++)
 	{
-		ret->m_offsets[i] = i;
-		ret->m_durations[i] = 1;
-
 		ret->m_samples[i] = scale *
 			(sinf(i*radians_per_sample1 + startphase1) + sinf(i*radians_per_sample2 + startphase2))
 			+ noise(m_rng);
@@ -186,9 +154,9 @@ WaveformBase* TestWaveformSource::GeneratePRBS31(
 	float noise_amplitude
 	)
 {
-	auto ret = new AnalogWaveform;
+	auto ret = WaveformPool::Allocate<AnalogWaveform>(depth);
 	ret->m_timescale = sampleperiod;
-	ret->Resize(depth);
+	ret->ResizeImplicit(depth);
 
 	//Generate the PRBS as a square wave. Interpolate zero crossings as needed.
 	uint32_t prbs = rand();
@@ -197,9 +165,6 @@ WaveformBase* TestWaveformSource::GeneratePRBS31(
 	bool value = false;
 	for(size_t i=0; i<depth; i++)
 	{
-		ret->m_offsets[i] = i;
-		ret->m_durations[i] = 1;
-
 		//Increment phase accumulator
 		float last_phase = phase_to_next_edge;
 		phase_to_next_edge -= sampleperiod;
@@ -244,9 +209,9 @@ WaveformBase* TestWaveformSource::Generate8b10b(
 	bool lpf,
 	float noise_amplitude)
 {
-	auto ret = new AnalogWaveform;
+	auto ret = WaveformPool::Allocate<AnalogWaveform>(depth);
 	ret->m_timescale = sampleperiod;
-	ret->Resize(depth);
+	ret->ResizeImplicit(depth);
 
 	const int patternlen = 20;
 	const bool pattern[patternlen] =
@@ -262,9 +227,6 @@ WaveformBase* TestWaveformSource::Generate8b10b(
 	int nbit = 0;
 	for(size_t i=0; i<depth; i++)
 	{
-		ret->m_offsets[i] = i;
-		ret->m_durations[i] = 1;
-
 		//Increment phase accumulator
 		float last_phase = phase_to_next_edge;
 		phase_to_next_edge -= sampleperiod;
@@ -316,36 +278,25 @@ void TestWaveformSource::DegradeSerialData(
 	//RNGs
 	normal_distribution<> noise(0, noise_amplitude);
 
-	//Prepare for second pass: reallocate FFT buffer if sample depth changed
-	const size_t npoints = next_pow2(depth);
-	size_t nouts = npoints/2 + 1;
-	if(m_cachedNumPoints != npoints)
-	{
-		if(m_forwardPlan)
-			ffts_free(m_forwardPlan);
-		m_forwardPlan = ffts_init_1d_real(npoints, FFTS_FORWARD);
-
-		if(m_reversePlan)
-			ffts_free(m_reversePlan);
-		m_reversePlan = ffts_init_1d_real(npoints, FFTS_BACKWARD);
-
-		m_forwardInBuf = m_allocator.allocate(npoints);
-		m_forwardOutBuf = m_allocator.allocate(2*nouts);
-		m_reverseOutBuf = m_allocator.allocate(npoints);
-
-		m_cachedNumPoints = npoints;
-	}
-
 	if(lpf)
 	{
+		//Borrow FFT plans and buffers for the second pass
+		const size_t npoints = next_pow2(depth);
+		size_t nouts = npoints/2 + 1;
+		auto forwardPlan = FFTPlanCache::GetRealPlan(npoints, FFTS_FORWARD);
+		auto reversePlan = FFTPlanCache::GetRealPlan(npoints, FFTS_BACKWARD);
+		auto timeBuf = FFTPlanCache::GetScratchBuffer(npoints);
+		auto spectrumBuf = FFTPlanCache::GetScratchBuffer(2*nouts);
+		float* ptime = &(*timeBuf)[0];
+		float* pspectrum = &(*spectrumBuf)[0];
 
 		//Copy the input, then fill any extra space with zeroes
-		memcpy(m_forwardInBuf, &cap->m_samples[0], depth*sizeof(float));
+		memcpy(ptime, &cap->m_samples[0], depth*sizeof(float));
 		for(size_t i=depth; i<npoints; i++)
-			m_forwardInBuf[i] = 0;
+			ptime[i] = 0;
 
 		//Do the forward FFT
-		ffts_execute(m_forwardPlan, &m_forwardInBuf[0], &m_forwardOutBuf[0]);
+		ffts_execute(forwardPlan.get(), ptime, pspectrum);
 
 		//Simple channel response model
 		double sample_ghz = 1e6 / sampleperiod;
@@ -358,17 +309,17 @@ void TestWaveformSource::DegradeSerialData(
 			complex<float> h = prescale * complex<float>(1, 0) / (s - pole);
 
 			float binscale = abs(h);
-			m_forwardOutBuf[i*2] *= binscale;		//real
-			m_forwardOutBuf[i*2 + 1] *= binscale;	//imag
+			pspectrum[i*2] *= binscale;		//real
+			pspectrum[i*2 + 1] *= binscale;	//imag
 		}
 
 		//Calculate the inverse FFT
-		ffts_execute(m_reversePlan, &m_forwardOutBuf[0], &m_reverseOutBuf[0]);
+		ffts_execute(reversePlan.get(), pspectrum, ptime);
 
 		//Rescale the FFT output and copy to the output, then add noise
 		float fftscale = 1.0f / npoints;
 		for(size_t i=0; i<depth; i++)
-			cap->m_samples[i] = m_reverseOutBuf[i] * fftscale + noise(m_rng);
+			cap->m_samples[i] = ptime[i] * fftscale + noise(m_rng);
 	}
 
 	else
@@ -37,7 +37,6 @@
 #define TestWaveformSource_h
 
 #include "../scopehal/AlignedAllocator.h"
-#include <ffts.h>
 #include <random>
 
 /**
@@ -98,17 +97,6 @@ public:
 
 protected:
 	std::mt19937& m_rng;
-
-	//FFT stuff
-	AlignedAllocator<float, 32> m_allocator;
-	ffts_plan_t* m_forwardPlan;
-	ffts_plan_t* m_reversePlan;
-	size_t m_cachedNumPoints;
-	size_t m_cachedRawSize;
-
-	float* m_forwardInBuf;
-	float* m_forwardOutBuf;
-	float* m_reverseOutBuf;
 };
 
 #endif
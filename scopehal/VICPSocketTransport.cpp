@@ -43,6 +43,8 @@ using namespace std;
 VICPSocketTransport::VICPSocketTransport(const string& args)
 	: m_nextSequence(1)
 	, m_lastSequence(1)
+	, m_rxFrameRemaining(0)
+	, m_rxFrameEOI(false)
 	, m_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)
 {
 	char hostname[128];
@@ -221,3 +223,130 @@ bool VICPSocketTransport::IsCommandBatchingSupported()
 {
 	return true;
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Binary block API
+
+/**
+	@brief Reads the next VICP frame header and prepares to read its payload with ReadFramedData()
+ */
+bool VICPSocketTransport::ReadFrameHeader()
+{
+	unsigned char header[8];
+	if(!m_socket.RecvLooped(header, 8))
+		return false;
+
+	if(header[1] != 1)
+	{
+		LogError("Bad VICP protocol version\n");
+		return false;
+	}
+
+	m_rxFrameRemaining = (header[4] << 24) | (header[5] << 16) | (header[6] << 8) | header[7];
+	m_rxFrameEOI = (header[0] & OP_EOI) ? true : false;
+	return true;
+}
+
+/**
+	@brief Reads message payload, stripping VICP frame headers as needed.
+
+	Unlike ReadReply(), the data goes straight into the caller's buffer without being copied.
+ */
+size_t VICPSocketTransport::ReadFramedData(size_t len, unsigned char* buf)
+{
+	size_t done = 0;
+	while(done < len)
+	{
+		if(m_rxFrameRemaining == 0)
+		{
+			if(!ReadFrameHeader())
+				break;
+			continue;
+		}
+
+		size_t n = min(len - done, m_rxFrameRemaining);
+		if(!m_socket.RecvLooped(buf + done, n))
+			break;
+		done += n;
+		m_rxFrameRemaining -= n;
+	}
+	return done;
+}
+
+/**
+	@brief Discards the rest of the current message, up to and including the frame with EOI set
+ */
+void VICPSocketTransport::DiscardFramedData()
+{
+	unsigned char tmp[256];
+	while(true)
+	{
+		while(m_rxFrameRemaining)
+		{
+			size_t n = min(sizeof(tmp), m_rxFrameRemaining);
+			if(!m_socket.RecvLooped(tmp, n))
+				return;
+			m_rxFrameRemaining -= n;
+		}
+
+		if(m_rxFrameEOI)
+			break;
+		if(!ReadFrameHeader())
+			return;
+	}
+
+	m_rxFrameEOI = false;
+}
+
+bool VICPSocketTransport::ReadBinaryBlockHeader(size_t& len)
+{
+	//Start of a new message
+	m_rxFrameRemaining = 0;
+	m_rxFrameEOI = false;
+
+	//Skip the command echo ("DAT1," etc) and anything else before the block
+	const size_t maxprefix = 64;
+	char c = 0;
+	size_t i = 0;
+	for(; i<maxprefix; i++)
+	{
+		if(1 != ReadFramedData(1, (unsigned char*)&c))
+			return false;
+		if(c == '#')
+			break;
+	}
+	if(i == maxprefix)
+	{
+		LogError("ReadBinaryBlockHeader: no block header found\n");
+		DiscardFramedData();
+		return false;
+	}
+
+	//Number of length digits
+	if(1 != ReadFramedData(1, (unsigned char*)&c))
+		return false;
+	if( (c < '1') || (c > '9') )
+	{
+		LogError("ReadBinaryBlockHeader: bad or indefinite length block header (#%c)\n", c);
+		DiscardFramedData();
+		return false;
+	}
+	size_t ndigits = c - '0';
+
+	//Read the length
+	char digits[10] = {0};
+	if(ndigits != ReadFramedData(ndigits, (unsigned char*)digits))
+		return false;
+	len = strtoull(digits, NULL, 10);
+	return true;
+}
+
+size_t VICPSocketTransport::ReadBinaryBlockData(size_t len, unsigned char* buf)
+{
+	size_t ret = ReadFramedData(len, buf);
+
+	//Throw away the trailing newline and any empty EOI frame
+	if(ret == len)
+		DiscardFramedData();
+	return ret;
+}
@@ -60,6 +60,9 @@ public:
 	virtual bool IsCommandBatchingSupported();
 	virtual bool IsConnected();
 
+	virtual bool ReadBinaryBlockHeader(size_t& len);
+	virtual size_t ReadBinaryBlockData(size_t len, unsigned char* buf);
+
 	//VICP constant helpers
 	enum HEADER_OPS
 	{
@@ -77,9 +80,19 @@ public:
 protected:
 	uint8_t GetNextSequenceNumber();
 
+	bool ReadFrameHeader();
+	size_t ReadFramedData(size_t len, unsigned char* buf);
+	void DiscardFramedData();
+
 	uint8_t m_nextSequence;
 	uint8_t m_lastSequence;
 
+	///@brief Number of payload bytes left in the frame currently being read by ReadFramedData()
+	size_t m_rxFrameRemaining;
+
+	///@brief True if the frame currently being read by ReadFramedData() is the last one in the message
+	bool m_rxFrameEOI;
+
 	Socket m_socket;
 
 	std::string m_hostname;
@@ -0,0 +1,91 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformBase
+ */
+
+#include "scopehal.h"
+
+using namespace std;
+
+//Revision zero is never allocated so it can be used as a "no waveform" marker
+atomic<uint64_t> WaveformBase::m_nextRevision(1);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Implicit timestamp handling
+
+/**
+	@brief Allocates and fills in m_offsets and m_durations of a dense packed waveform with implicit timestamps.
+
+	This is safe to call from multiple threads at once (for example, two filters reading the same input), and is a
+	no-op if the waveform already has explicit timestamps. Entries still valid from an earlier fill are not rewritten.
+	The revision is not changed since the waveform's contents are logically the same.
+ */
+void WaveformBase::MaterializeTimestamps()
+{
+	if(!m_densePacked)
+		return;
+
+	lock_guard<mutex> lock(m_timestampMutex);
+	if(!HasImplicitTimestamps())
+		return;
+
+	size_t start = 0;
+	if(m_denseTimestampRevision == m_revision)
+		start = m_offsets.size();
+
+	size_t len = size();
+	m_offsets.resize(len);
+	m_durations.resize(len);
+	FillDenseTimestamps(start);
+	m_denseTimestampRevision = m_revision;
+}
+
+/**
+	@brief Fills m_offsets and m_durations with dense packed timestamps from the given index to the end
+ */
+void WaveformBase::FillDenseTimestamps(size_t start)
+{
+	size_t len = m_offsets.size();
+	if(start >= len)
+		return;
+
+	int64_t* offs = (int64_t*)&m_offsets[0];
+	int64_t* durs = (int64_t*)&m_durations[0];
+
+	#pragma omp parallel for if(len > 1000000)
+	for(size_t i=start; i<len; i++)
+	{
+		offs[i] = i;
+		durs[i] = 1;
+	}
+}
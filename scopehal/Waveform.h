@@ -37,6 +37,8 @@
 #define Waveform_h
 
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include <AlignedAllocator.h>
 
 /**
@@ -85,6 +87,8 @@ public:
 		, m_startFemtoseconds(0)
 		, m_triggerPhase(0)
 		, m_densePacked(false)
+		, m_revision(AllocateRevision())
+		, m_denseTimestampRevision(0)
 	{}
 
 	//empty virtual destructor in case any derived classes need one
@@ -113,7 +117,12 @@ public:
 
 		This means that m_durations is always 1, and m_offsets ranges from 0 to m_offsets.size()-1.
 
+		This is a promise about the timestamps, not just a hint: GetOffset(), CopyTimestamps(), the edge finders, etc
+		assume sample i starts at timestep i without looking at m_offsets. Waveforms with a nonzero first offset, gaps,
+		or run-length encoded samples must leave it false.
+
 		If dense packed, we can often perform various optimizations to avoid excessive copying of waveform data.
+		The timestamps may not be stored at all (see HasImplicitTimestamps()).
 
 		Most oscilloscopes output dense packed waveforms natively.
 	 */
@@ -131,29 +140,154 @@ public:
 		AlignedAllocator< EmptyConstructorWrapper<int64_t>, 64 >
 		> m_durations;
 
+	/**
+		@brief Revision number of the waveform's contents.
+
+		Every waveform gets a process-wide unique revision when created, and a new one each time it's modified. Unlike
+		the waveform's address, a revision is never reused, so it's safe to use as a key for caching analysis results.
+	 */
+	uint64_t m_revision;
+
+	/**
+		@brief Assigns a new revision number to the waveform.
+
+		Resize() and clear() do this automatically. Code which modifies sample data in place without resizing
+		must call this (or OscilloscopeChannel::SetData()) when finished.
+	 */
+	void MarkModified()
+	{ m_revision = AllocateRevision(); }
+
+	static uint64_t AllocateRevision()
+	{ return m_nextRevision ++; }
+
+	///@brief Gets the number of samples in the waveform
+	virtual size_t size()
+	{ return m_offsets.size(); }
+
+	///@brief Gets the number of samples the waveform can hold without reallocating
+	virtual size_t capacity()
+	{ return m_offsets.capacity(); }
+
+	///@brief Gets the number of bytes of sample and timestamp storage currently allocated
+	virtual size_t GetAllocatedSize()
+	{ return (m_offsets.capacity() + m_durations.capacity()) * sizeof(int64_t); }
+
+	/**
+		@brief Returns true if the waveform is dense packed and its timestamps are not stored.
+
+		In this case m_offsets and m_durations are shorter than the waveform (usually empty). Sample i implicitly starts
+		at timestep i and lasts for one timestep, which is all the vectors would have contained anyway, so we save 16
+		bytes per sample of memory and bandwidth by not writing them.
+
+		Code which is aware of this should use GetOffset() and GetDuration(), which work for either representation.
+		OscilloscopeChannel::GetData() calls MaterializeTimestamps() so that code accessing m_offsets and m_durations
+		directly keeps working.
+	 */
+	bool HasImplicitTimestamps()
+	{ return m_densePacked && (m_offsets.size() != size()); }
+
+	///@brief Gets the start time of a sample, in timebase units
+	int64_t GetOffset(size_t i)
+	{
+		if(m_densePacked)
+			return i;
+		else
+			return m_offsets[i];
+	}
+
+	///@brief Gets the duration of a sample, in timebase units
+	int64_t GetDuration(size_t i)
+	{
+		if(m_densePacked)
+			return 1;
+		else
+			return m_durations[i];
+	}
+
+	virtual void MaterializeTimestamps();
+
 	virtual void clear()
 	{
 		m_offsets.clear();
 		m_durations.clear();
+		MarkModified();
 	}
 
 	virtual void Resize(size_t size)
 	{
 		m_offsets.resize(size);
 		m_durations.resize(size);
+		MarkModified();
 	}
 
 	/**
 		@brief Copies offsets/durations from one waveform to another.
 
 		Must have been resized to match rhs first.
+
+		If rhs is dense packed, there's nothing to copy: this waveform becomes dense packed too, with implicit
+		timestamps.
 	 */
 	void CopyTimestamps(const WaveformBase* rhs)
 	{
-		size_t len = sizeof(int64_t) * rhs->m_offsets.size();
+		if(rhs->m_densePacked)
+		{
+			ResizeTimestamps(size(), true);
+			return;
+		}
+
+		m_densePacked = false;
+		size_t len = sizeof(int64_t) * std::min(m_offsets.size(), rhs->m_offsets.size());
 		memcpy((void*)&m_offsets[0], (void*)&rhs->m_offsets[0], len);
 		memcpy((void*)&m_durations[0], (void*)&rhs->m_durations[0], len);
 	}
+
+protected:
+	/**
+		@brief Resizes m_offsets and m_durations and assigns a new revision. Used by Resize() and ResizeImplicit().
+
+		Dense packed timestamps left over from an earlier fill (see m_denseTimestampRevision) are kept, so only
+		samples past the old end ever need filling in. If implicit is set the waveform becomes dense packed and the
+		arrays are trimmed to whatever is still valid, to be extended by MaterializeTimestamps() if needed.
+		Otherwise, if the waveform had implicit timestamps, new entries are filled in here.
+
+		Capacity is never released since most waveforms are reused for the next acquisition.
+	 */
+	void ResizeTimestamps(size_t len, bool implicit)
+	{
+		bool valid = m_densePacked && (m_denseTimestampRevision == m_revision);
+		bool fill = !implicit && (valid || HasImplicitTimestamps());
+		size_t oldlen = valid ? m_offsets.size() : 0;
+
+		if(implicit)
+		{
+			m_densePacked = true;
+			len = std::min(len, oldlen);
+		}
+		m_offsets.resize(len);
+		m_durations.resize(len);
+		if(fill)
+			FillDenseTimestamps(oldlen);
+
+		MarkModified();
+		if(implicit || fill)
+			m_denseTimestampRevision = m_revision;
+	}
+
+	void FillDenseTimestamps(size_t start);
+
+	static std::atomic<uint64_t> m_nextRevision;
+
+	/**
+		@brief Revision for which m_offsets and m_durations were last filled with dense packed timestamps.
+
+		While this matches m_revision every entry present is valid, so reused output waveforms don't have to refill
+		their timestamps every acquisition.
+	 */
+	uint64_t m_denseTimestampRevision;
+
+	///@brief Serializes MaterializeTimestamps() calls from multiple readers of this waveform
+	std::mutex m_timestampMutex;
 };
 
 /**
@@ -167,10 +301,35 @@ public:
 	///@brief Sample data
 	std::vector< S, AlignedAllocator<S, 64> > m_samples;
 
+	virtual size_t size()
+	{ return m_samples.size(); }
+
+	virtual size_t capacity()
+	{ return m_samples.capacity(); }
+
+	virtual size_t GetAllocatedSize()
+	{ return WaveformBase::GetAllocatedSize() + m_samples.capacity() * sizeof(S); }
+
+	/**
+		@brief Resizes the waveform.
+
+		If the waveform previously had implicit timestamps, they're filled in so that m_offsets and m_durations are
+		valid afterwards.
+	 */
 	virtual void Resize(size_t size)
 	{
-		m_offsets.resize(size);
-		m_durations.resize(size);
+		ResizeTimestamps(size, false);
+		m_samples.resize(size);
+	}
+
+	/**
+		@brief Resizes the waveform, marks it as dense packed, and makes the timestamps implicit.
+
+		This is the preferred way for drivers and filters producing dense packed data to size their output.
+	 */
+	void ResizeImplicit(size_t size)
+	{
+		ResizeTimestamps(size, true);
 		m_samples.resize(size);
 	}
 
@@ -179,13 +338,13 @@ public:
 		m_offsets.clear();
 		m_durations.clear();
 		m_samples.clear();
+		MarkModified();
 	}
 };
 
 typedef Waveform<EmptyConstructorWrapper<bool> >	DigitalWaveform;
 typedef Waveform<EmptyConstructorWrapper<float>>	AnalogWaveform;
 
-typedef Waveform< std::vector<bool> > 	DigitalBusWaveform;
 typedef Waveform<char>					AsciiWaveform;
 
 #endif
@@ -0,0 +1,220 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformPool
+ */
+#include "scopehal.h"
+#include "WaveformPool.h"
+
+using namespace std;
+
+///@brief Maximum number of idle waveforms kept in any one size class
+static const size_t g_maxWaveformsPerClass = 16;
+
+mutex WaveformPool::m_mutex;
+map<WaveformPool::KeyType, vector<WaveformBase*> > WaveformPool::m_free;
+set<type_index> WaveformPool::m_types;
+size_t WaveformPool::m_bytes = 0;
+atomic<size_t> WaveformPool::m_maxBytes(2048LL * 1024 * 1024);
+atomic<uint64_t> WaveformPool::m_hits(0);
+atomic<uint64_t> WaveformPool::m_misses(0);
+atomic<uint64_t> WaveformPool::m_discards(0);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation
+
+/**
+	@brief Gets the size class for a waveform of the given capacity (floor of log2)
+ */
+size_t WaveformPool::GetSizeClass(size_t capacity)
+{
+	size_t ret = 0;
+	while(capacity > 1)
+	{
+		capacity >>= 1;
+		ret ++;
+	}
+	return ret;
+}
+
+/**
+	@brief Removes an idle waveform of the requested type and capacity from the pool, and resets it
+
+	@param type	Exact type of the waveform
+	@param size	Minimum capacity, in samples. If zero, any idle waveform of this type will do.
+
+	@return The waveform, or NULL if none was available
+ */
+WaveformBase* WaveformPool::Take(type_index type, size_t size)
+{
+	WaveformBase* ret = NULL;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_types.insert(type);
+
+		//Waveforms in a class have capacity between 2^n and 2^(n+1) - 1, so the first class we look at may or may not
+		//have one big enough. Anything in a bigger class will do, but don't go more than a couple of classes up
+		//or we'll hand out huge buffers for small waveforms.
+		size_t first = GetSizeClass(size);
+		size_t last = (size == 0) ? SIZE_MAX : first + 2;
+		for(auto it = m_free.lower_bound(KeyType(type, first)); (ret == NULL) && (it != m_free.end()); ++it)
+		{
+			if( (it->first.first != type) || (it->first.second > last) )
+				break;
+
+			auto& bucket = it->second;
+			for(size_t i=bucket.size(); i>0; i--)
+			{
+				auto w = bucket[i-1];
+				if(w->capacity() >= size)
+				{
+					bucket.erase(bucket.begin() + (i-1));
+					m_bytes -= w->GetAllocatedSize();
+					ret = w;
+					break;
+				}
+			}
+		}
+	}
+
+	if(ret == NULL)
+	{
+		m_misses ++;
+		return NULL;
+	}
+	m_hits ++;
+
+	//Make it look freshly constructed (Release() already emptied it)
+	ret->m_timescale = 0;
+	ret->m_startTimestamp = 0;
+	ret->m_startFemtoseconds = 0;
+	ret->m_triggerPhase = 0;
+	ret->m_densePacked = false;
+	ret->MarkModified();
+	return ret;
+}
+
+/**
+	@brief Returns a waveform to the pool once it's no longer in use.
+
+	The caller must not touch the waveform afterwards. It's freed if it's not of a type the pool recycles, or if the
+	pool is full.
+
+	@param w	The waveform (may be NULL)
+ */
+void WaveformPool::Release(WaveformBase* w)
+{
+	if(w == NULL)
+		return;
+
+	//Emptying the waveform keeps its buffers, but gets rid of anything in them which owns memory of its own
+	w->clear();
+	size_t bytes = w->GetAllocatedSize();
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+
+		type_index type(typeid(*w));
+		if(m_types.find(type) != m_types.end())
+		{
+			auto& bucket = m_free[KeyType(type, GetSizeClass(w->capacity()))];
+			if( (m_bytes + bytes <= m_maxBytes) && (bucket.size() < g_maxWaveformsPerClass) )
+			{
+				bucket.push_back(w);
+				m_bytes += bytes;
+				return;
+			}
+
+			m_discards ++;
+		}
+	}
+
+	delete w;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Pool management
+
+/**
+	@brief Frees all idle waveforms
+ */
+void WaveformPool::Clear()
+{
+	lock_guard<mutex> lock(m_mutex);
+	for(auto& it : m_free)
+	{
+		for(auto w : it.second)
+			delete w;
+	}
+	m_free.clear();
+	m_bytes = 0;
+}
+
+/**
+	@brief Sets the maximum number of bytes of idle waveforms held by the pool
+
+	If the pool is already bigger than this, idle waveforms are freed (largest first) until it fits.
+ */
+void WaveformPool::SetMaxMemory(size_t bytes)
+{
+	m_maxBytes = bytes;
+
+	lock_guard<mutex> lock(m_mutex);
+	while(m_bytes > bytes)
+	{
+		//Find the biggest idle waveform
+		vector<WaveformBase*>* biggest = NULL;
+		for(auto& it : m_free)
+		{
+			if(it.second.empty())
+				continue;
+			if( (biggest == NULL) || (it.second.back()->GetAllocatedSize() > biggest->back()->GetAllocatedSize()) )
+				biggest = &it.second;
+		}
+		if(biggest == NULL)
+			break;
+
+		auto w = biggest->back();
+		biggest->pop_back();
+		m_bytes -= w->GetAllocatedSize();
+		delete w;
+	}
+}
+
+/**
+	@brief Gets the total allocated size of the idle waveforms held by the pool
+ */
+size_t WaveformPool::GetMemoryUsage()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_bytes;
+}
@@ -0,0 +1,125 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformPool
+ */
+#ifndef WaveformPool_h
+#define WaveformPool_h
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <typeindex>
+#include <vector>
+
+/**
+	@brief Process-wide pool of recycled waveforms
+
+	Deep captures are hundreds of megabytes per channel, and drivers and filters create a fresh waveform for each
+	trigger. Allocating that much memory every time means page faults (and the kernel zeroing every page) before we
+	can write a single sample. Rather than freeing waveforms, OscilloscopeChannel::SetData() and the pending waveform
+	queue hand them back to the pool, and Allocate() gives them out again with their buffers still mapped.
+
+	Idle waveforms are binned by type and size class (power of two of the sample capacity), and the pool's total
+	footprint is capped. Only types which have been allocated through the pool at least once are kept; anything
+	else passed to Release() is simply deleted.
+ */
+class WaveformPool
+{
+public:
+
+	/**
+		@brief Gets an empty waveform able to hold at least size samples without reallocating.
+
+		All metadata is reset to the same state as a newly constructed waveform, and it gets a new revision.
+	 */
+	template<class T>
+	static T* Allocate(size_t size)
+	{
+		T* ret = static_cast<T*>(Take(typeid(T), size));
+		if(ret)
+			return ret;
+
+		ret = new T;
+		ret->m_samples.reserve(size);
+		return ret;
+	}
+
+	static void Release(WaveformBase* w);
+	static void Clear();
+
+	static void SetMaxMemory(size_t bytes);
+
+	///@brief Gets the maximum number of bytes of idle waveforms held by the pool
+	static size_t GetMaxMemory()
+	{ return m_maxBytes; }
+
+	static size_t GetMemoryUsage();
+
+	///@brief Gets the number of allocations satisfied by a recycled waveform
+	static uint64_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Gets the number of allocations which had to create a new waveform
+	static uint64_t GetMissCount()
+	{ return m_misses; }
+
+	///@brief Gets the number of released waveforms which were freed because the pool was full
+	static uint64_t GetDiscardCount()
+	{ return m_discards; }
+
+protected:
+	static WaveformBase* Take(std::type_index type, size_t size);
+
+	static size_t GetSizeClass(size_t capacity);
+
+	typedef std::pair<std::type_index, size_t> KeyType;
+
+	static std::mutex m_mutex;
+
+	///@brief Idle waveforms, by type and size class
+	static std::map<KeyType, std::vector<WaveformBase*> > m_free;
+
+	///@brief Types which have been allocated through the pool (and are thus safe to recycle)
+	static std::set<std::type_index> m_types;
+
+	///@brief Total allocated size of the idle waveforms
+	static size_t m_bytes;
+
+	static std::atomic<size_t> m_maxBytes;
+	static std::atomic<uint64_t> m_hits;
+	static std::atomic<uint64_t> m_misses;
+	static std::atomic<uint64_t> m_discards;
+};
+
+#endif
@@ -0,0 +1,448 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of WaveformStatistics
+ */
+#include "scopehal.h"
+#include "WaveformStatistics.h"
+#include <immintrin.h>
+#include <omp.h>
+
+using namespace std;
+
+mutex WaveformStatistics::m_cacheMutex;
+list< pair<WaveformStatistics::KeyType, WaveformStatistics::StatisticsPtr> > WaveformStatistics::m_cache;
+atomic<size_t> WaveformStatistics::m_hits(0);
+atomic<size_t> WaveformStatistics::m_misses(0);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+WaveformStatistics::WaveformStatistics()
+	: m_count(0)
+	, m_min(FLT_MAX)
+	, m_max(-FLT_MAX)
+	, m_mean(0)
+	, m_variance(0)
+{
+}
+
+WaveformStatistics::BlockMoments::BlockMoments()
+	: m_count(0)
+	, m_min(FLT_MAX)
+	, m_max(-FLT_MAX)
+	, m_shift(0)
+	, m_sum(0)
+	, m_sumSquares(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache access
+
+/**
+	@brief Gets the statistics of a waveform, computing them if they're not already cached
+
+	The returned object is shared with the cache and with other callers.
+
+	@param cap		The waveform to analyze
+	@param nbins	Number of histogram bins between the minimum and maximum, or 0 if only the moments are needed
+ */
+WaveformStatistics::StatisticsPtr WaveformStatistics::Get(AnalogWaveform* cap, size_t nbins)
+{
+	KeyType key(cap->m_revision, nbins);
+	StatisticsPtr sameRevision;
+
+	{
+		lock_guard<mutex> lock(m_cacheMutex);
+		for(auto it = m_cache.begin(); it != m_cache.end(); it++)
+		{
+			//Any entry for this revision will do if we don't need a histogram
+			if( (it->first == key) || ( (nbins == 0) && (it->first.first == key.first) ) )
+			{
+				//Move to the front of the LRU list
+				m_cache.splice(m_cache.begin(), m_cache, it);
+				m_hits ++;
+				return it->second;
+			}
+
+			if(it->first.first == key.first)
+				sameRevision = it->second;
+		}
+		m_misses ++;
+	}
+
+	//Reuse the moments if we already have them for a different bin count
+	auto stats = make_shared<WaveformStatistics>();
+	if(sameRevision)
+	{
+		stats->m_count = sameRevision->m_count;
+		stats->m_min = sameRevision->m_min;
+		stats->m_max = sameRevision->m_max;
+		stats->m_mean = sameRevision->m_mean;
+		stats->m_variance = sameRevision->m_variance;
+	}
+	else
+		stats->CalculateMoments(cap);
+
+	if(nbins)
+		MakeHistogram(cap, stats->m_min, stats->m_max, nbins, stats->m_histogram);
+
+	lock_guard<mutex> lock(m_cacheMutex);
+	m_cache.push_front(make_pair(key, stats));
+	while(m_cache.size() > MAX_CACHE_ENTRIES)
+		m_cache.pop_back();
+	return stats;
+}
+
+/**
+	@brief Removes all entries from the cache.
+
+	Results already handed out remain valid until their last user releases them.
+ */
+void WaveformStatistics::ClearCache()
+{
+	lock_guard<mutex> lock(m_cacheMutex);
+	m_cache.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Analysis helpers
+
+/**
+	@brief Finds the most populated histogram bin in [firstBin, endBin) and returns the voltage at its center
+
+	If several bins tie, the lowest wins.
+ */
+float WaveformStatistics::GetMostProbableVoltage(size_t firstBin, size_t endBin) const
+{
+	endBin = min(endBin, m_histogram.size());
+
+	size_t binval = 0;
+	size_t idx = firstBin;
+	for(size_t i=firstBin; i<endBin; i++)
+	{
+		if(m_histogram[i] > binval)
+		{
+			binval = m_histogram[i];
+			idx = i;
+		}
+	}
+
+	return GetBinCenter(idx);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Computation
+
+/**
+	@brief Calculates min, max, mean, and variance of a waveform in a single pass
+ */
+void WaveformStatistics::CalculateMoments(AnalogWaveform* cap)
+{
+	size_t len = cap->m_samples.size();
+	if(len == 0)
+		return;
+	const float* samples = (const float*)&cap->m_samples[0];
+
+	//Round blocks to multiples of 64 samples for clean vectorization
+	size_t numblocks = Filter::GetParallelBlockCount(len);
+	size_t lastblock = numblocks - 1;
+	size_t blocksize = len / numblocks;
+	blocksize = blocksize - (blocksize % 64);
+
+	vector<BlockMoments> blocks(numblocks);
+
+	#pragma omp parallel for if(numblocks > 1)
+	for(size_t i=0; i<numblocks; i++)
+	{
+		//Last block gets any extra that didn't divide evenly
+		size_t bstart = i*blocksize;
+		size_t bend = bstart + blocksize;
+		if(i == lastblock)
+			bend = len;
+
+		if(g_hasAvx2)
+			AccumulateMomentsAVX2(samples, bstart, bend, blocks[i]);
+		else
+			AccumulateMoments(samples, bstart, bend, blocks[i]);
+	}
+
+	//Merge the blocks
+	for(size_t i=1; i<numblocks; i++)
+		blocks[0].Merge(blocks[i]);
+
+	auto& m = blocks[0];
+	m_count = m.m_count;
+	m_min = m.m_min;
+	m_max = m.m_max;
+	m_mean = m.m_shift + m.m_sum / m.m_count;
+	m_variance = max(0.0, (m.m_sumSquares - m.m_sum*m.m_sum / m.m_count) / m.m_count);
+}
+
+/**
+	@brief Combines the moments of another block into this one
+ */
+void WaveformStatistics::BlockMoments::Merge(const BlockMoments& rhs)
+{
+	if(rhs.m_count == 0)
+		return;
+	if(m_count == 0)
+	{
+		*this = rhs;
+		return;
+	}
+
+	//Convert rhs to our shift, then add: the pairwise update of Chan et al, in shifted-sum form
+	double na = m_count;
+	double nb = rhs.m_count;
+	double meanA = m_sum / na;
+	double meanB = rhs.m_sum / nb + (rhs.m_shift - m_shift);
+	double m2a = m_sumSquares - m_sum*meanA;
+	double m2b = rhs.m_sumSquares - rhs.m_sum*rhs.m_sum/nb;
+	double delta = meanB - meanA;
+	double n = na + nb;
+
+	double mean = meanA + delta * nb / n;
+	double m2 = m2a + m2b + delta*delta * na * nb / n;
+
+	m_count += rhs.m_count;
+	m_min = min(m_min, rhs.m_min);
+	m_max = max(m_max, rhs.m_max);
+	m_sum = mean * n;
+	m_sumSquares = m2 + m_sum*mean;
+}
+
+void WaveformStatistics::AccumulateMoments(const float* samples, size_t start, size_t end, BlockMoments& moments)
+{
+	if(end <= start)
+		return;
+
+	float vmin = FLT_MAX;
+	float vmax = -FLT_MAX;
+	double shift = samples[start];
+	double sum = 0;
+	double sumSquares = 0;
+
+	for(size_t i=start; i<end; i++)
+	{
+		float v = samples[i];
+		vmin = min(vmin, v);
+		vmax = max(vmax, v);
+
+		double d = v - shift;
+		sum += d;
+		sumSquares += d*d;
+	}
+
+	BlockMoments block;
+	block.m_count = end - start;
+	block.m_min = vmin;
+	block.m_max = vmax;
+	block.m_shift = shift;
+	block.m_sum = sum;
+	block.m_sumSquares = sumSquares;
+	moments.Merge(block);
+}
+
+__attribute__((target("avx2")))
+void WaveformStatistics::AccumulateMomentsAVX2(const float* samples, size_t start, size_t end, BlockMoments& moments)
+{
+	if(end <= start)
+		return;
+
+	size_t len = end - start;
+	size_t end_rounded = start + len - (len % 8);
+
+	double shift = samples[start];
+	__m256 vmin = _mm256_set1_ps(FLT_MAX);
+	__m256 vmax = _mm256_set1_ps(-FLT_MAX);
+	__m256d vshift = _mm256_set1_pd(shift);
+	__m256d vsum_lo = _mm256_setzero_pd();
+	__m256d vsum_hi = _mm256_setzero_pd();
+	__m256d vsq_lo = _mm256_setzero_pd();
+	__m256d vsq_hi = _mm256_setzero_pd();
+
+	for(size_t i=start; i<end_rounded; i+=8)
+	{
+		__m256 v = _mm256_loadu_ps(samples + i);
+		vmin = _mm256_min_ps(vmin, v);
+		vmax = _mm256_max_ps(vmax, v);
+
+		//Widen to double for the sums
+		__m256d lo = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)), vshift);
+		__m256d hi = _mm256_sub_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)), vshift);
+		vsum_lo = _mm256_add_pd(vsum_lo, lo);
+		vsum_hi = _mm256_add_pd(vsum_hi, hi);
+		vsq_lo = _mm256_add_pd(vsq_lo, _mm256_mul_pd(lo, lo));
+		vsq_hi = _mm256_add_pd(vsq_hi, _mm256_mul_pd(hi, hi));
+	}
+
+	//Horizontal reduction
+	float fmin[8] __attribute__((aligned(32)));
+	float fmax[8] __attribute__((aligned(32)));
+	double dsum[4] __attribute__((aligned(32)));
+	double dsq[4] __attribute__((aligned(32)));
+	_mm256_store_ps(fmin, vmin);
+	_mm256_store_ps(fmax, vmax);
+	_mm256_store_pd(dsum, _mm256_add_pd(vsum_lo, vsum_hi));
+	_mm256_store_pd(dsq, _mm256_add_pd(vsq_lo, vsq_hi));
+
+	BlockMoments block;
+	block.m_count = end_rounded - start;
+	block.m_shift = shift;
+	for(size_t i=0; i<8; i++)
+	{
+		block.m_min = min(block.m_min, fmin[i]);
+		block.m_max = max(block.m_max, fmax[i]);
+	}
+	block.m_sum = dsum[0] + dsum[1] + dsum[2] + dsum[3];
+	block.m_sumSquares = dsq[0] + dsq[1] + dsq[2] + dsq[3];
+	moments.Merge(block);
+
+	//Get any extras
+	AccumulateMoments(samples, end_rounded, end, moments);
+}
+
+/**
+	@brief Makes a histogram from a waveform with the specified number of bins.
+
+	Any values outside the range are clamped (put in bin 0 or bins-1 as appropriate).
+
+	@param cap	The waveform to analyze
+	@param low	Low endpoint of the histogram (volts)
+	@param high High endpoint of the histogram (volts)
+	@param bins	Number of histogram bins
+	@param hist	Output histogram
+ */
+void WaveformStatistics::MakeHistogram(AnalogWaveform* cap, float low, float high, size_t bins, vector<size_t>& hist)
+{
+	hist.assign(bins, 0);
+
+	//Early out if we have zero span
+	size_t len = cap->m_samples.size();
+	if( (bins == 0) || (len == 0) )
+		return;
+	const float* samples = (const float*)&cap->m_samples[0];
+
+	//Everything is in the first bin if there's no range to spread it over
+	float delta = high - low;
+	if(delta <= 0)
+	{
+		hist[0] = len;
+		return;
+	}
+
+	size_t numblocks = Filter::GetParallelBlockCount(len);
+	size_t lastblock = numblocks - 1;
+	size_t blocksize = len / numblocks;
+	blocksize = blocksize - (blocksize % 64);
+
+	//First block goes straight to the output, the rest get their own histograms and are merged at the end
+	vector< vector<size_t> > blockHists(numblocks - 1, vector<size_t>(bins, 0));
+
+	#pragma omp parallel for if(numblocks > 1)
+	for(size_t i=0; i<numblocks; i++)
+	{
+		size_t bstart = i*blocksize;
+		size_t bend = bstart + blocksize;
+		if(i == lastblock)
+			bend = len;
+
+		size_t* out = (i == 0) ? &hist[0] : &blockHists[i-1][0];
+		if(g_hasAvx2)
+			AccumulateHistogramAVX2(samples, bstart, bend, low, delta, bins, out);
+		else
+			AccumulateHistogram(samples, bstart, bend, low, delta, bins, out);
+	}
+
+	for(auto& b : blockHists)
+	{
+		for(size_t i=0; i<bins; i++)
+			hist[i] += b[i];
+	}
+}
+
+void WaveformStatistics::AccumulateHistogram(
+	const float* samples,
+	size_t start,
+	size_t end,
+	float low,
+	float delta,
+	size_t bins,
+	size_t* hist)
+{
+	float fbins = bins;
+	float maxbin = bins - 1;
+	for(size_t i=start; i<end; i++)
+	{
+		float fbin = floor( (samples[i] - low) / delta * fbins);
+		fbin = min(max(fbin, 0.0f), maxbin);
+		hist[(size_t)fbin] ++;
+	}
+}
+
+__attribute__((target("avx2")))
+void WaveformStatistics::AccumulateHistogramAVX2(
+	const float* samples,
+	size_t start,
+	size_t end,
+	float low,
+	float delta,
+	size_t bins,
+	size_t* hist)
+{
+	size_t len = end - start;
+	size_t end_rounded = start + len - (len % 8);
+
+	__m256 vlow = _mm256_set1_ps(low);
+	__m256 vdelta = _mm256_set1_ps(delta);
+	__m256 vbins = _mm256_set1_ps(bins);
+	__m256 vzero = _mm256_setzero_ps();
+	__m256 vmaxbin = _mm256_set1_ps(bins - 1);
+
+	int32_t idx[8] __attribute__((aligned(32)));
+	for(size_t i=start; i<end_rounded; i+=8)
+	{
+		//Bin indexes are computed eight at a time, but the increments have to be done one by one
+		__m256 v = _mm256_loadu_ps(samples + i);
+		__m256 fbin = _mm256_floor_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_sub_ps(v, vlow), vdelta), vbins));
+		fbin = _mm256_min_ps(_mm256_max_ps(fbin, vzero), vmaxbin);
+		_mm256_store_si256((__m256i*)idx, _mm256_cvttps_epi32(fbin));
+
+		for(size_t j=0; j<8; j++)
+			hist[idx[j]] ++;
+	}
+
+	//Get any extras
+	AccumulateHistogram(samples, end_rounded, end, low, delta, bins, hist);
+}
@@ -0,0 +1,149 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of WaveformStatistics
+ */
+#ifndef WaveformStatistics_h
+#define WaveformStatistics_h
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+	@brief Summary statistics of an analog waveform, computed in one fused pass and memoized per waveform revision
+
+	Many measurements need the same handful of numbers: min and max, the mean, and a histogram between min and max
+	to find the most probable top and base levels. Computing each separately means several full passes over the
+	samples, repeated by every filter looking at the same waveform.
+
+	Get() computes min, max, mean, and variance in a single multithreaded, SIMD pass. If a histogram is requested, a
+	second pass builds it (this can't be fused into the first since its range depends on the min and max). The result
+	is cached by (waveform revision, bin count) so, for example, top, base, and peak-to-peak measurements of the same
+	signal share one computation. If only the bin count differs, the moments of an existing entry are reused and only
+	the histogram is recomputed; a request without a histogram is satisfied by any entry for the same revision.
+
+	The mean and variance are accumulated in double precision relative to the first sample of each block, and blocks
+	are combined with the pairwise update of Chan et al, so deep captures with a large DC offset don't lose precision.
+ */
+class WaveformStatistics
+{
+public:
+	WaveformStatistics();
+
+	typedef std::shared_ptr<const WaveformStatistics> StatisticsPtr;
+
+	static StatisticsPtr Get(AnalogWaveform* cap, size_t nbins = 0);
+
+	static void MakeHistogram(AnalogWaveform* cap, float low, float high, size_t bins, std::vector<size_t>& hist);
+
+	static void ClearCache();
+
+	///@brief Gets the number of lookups which found a cached result
+	static size_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Gets the number of lookups which did not find a cached result
+	static size_t GetMissCount()
+	{ return m_misses; }
+
+	///@brief Gets the voltage at the center of a histogram bin
+	float GetBinCenter(size_t bin) const
+	{ return (bin + 0.5f) / m_histogram.size() * (m_max - m_min) + m_min; }
+
+	float GetMostProbableVoltage(size_t firstBin, size_t endBin) const;
+
+	///@brief Number of samples
+	size_t m_count;
+
+	///@brief Lowest sample value (FLT_MAX if the waveform is empty)
+	float m_min;
+
+	///@brief Highest sample value (-FLT_MAX if the waveform is empty)
+	float m_max;
+
+	///@brief Mean of all samples
+	double m_mean;
+
+	///@brief Population variance of all samples
+	double m_variance;
+
+	///@brief Histogram of the samples between m_min and m_max (only valid if Get() was called with a nonzero bin count)
+	std::vector<size_t> m_histogram;
+
+protected:
+
+	///@brief Partial moments of one block of samples
+	class BlockMoments
+	{
+	public:
+		BlockMoments();
+
+		void Merge(const BlockMoments& rhs);
+
+		size_t m_count;
+		float m_min;
+		float m_max;
+
+		///@brief Sums below are of (sample - m_shift) to avoid cancellation
+		double m_shift;
+		double m_sum;
+		double m_sumSquares;
+	};
+
+	void CalculateMoments(AnalogWaveform* cap);
+
+	static void AccumulateMoments(const float* samples, size_t start, size_t end, BlockMoments& moments);
+	static void AccumulateMomentsAVX2(const float* samples, size_t start, size_t end, BlockMoments& moments);
+
+	static void AccumulateHistogram(
+		const float* samples, size_t start, size_t end, float low, float delta, size_t bins, size_t* hist);
+	static void AccumulateHistogramAVX2(
+		const float* samples, size_t start, size_t end, float low, float delta, size_t bins, size_t* hist);
+
+	///@brief Waveform revision and bin count
+	typedef std::pair<uint64_t, size_t> KeyType;
+
+	static std::mutex m_cacheMutex;
+
+	///@brief Cached results in most- to least-recently-used order
+	static std::list< std::pair<KeyType, StatisticsPtr> > m_cache;
+
+	enum { MAX_CACHE_ENTRIES = 256 };
+
+	static std::atomic<size_t> m_hits;
+	static std::atomic<size_t> m_misses;
+};
+
+#endif
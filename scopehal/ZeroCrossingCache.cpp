@@ -0,0 +1,171 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Implementation of ZeroCrossingCache
+ */
+#include "scopehal.h"
+#include "ZeroCrossingCache.h"
+
+using namespace std;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+/**
+	@brief Creates the cache
+
+	@param maxBytes	Upper bound on the total size of the cached edge data
+ */
+ZeroCrossingCache::ZeroCrossingCache(size_t maxBytes)
+	: m_maxBytes(maxBytes)
+	, m_hits(0)
+	, m_misses(0)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache access
+
+/**
+	@brief Looks up the crossings of a waveform revision at a given threshold
+
+	@return The cached edges, or an empty pointer if not present
+ */
+ZeroCrossingCache::EdgeBuffer ZeroCrossingCache::Find(uint64_t revision, float threshold)
+{
+	auto& shard = GetShard(revision);
+	lock_guard<mutex> lock(shard.m_mutex);
+
+	auto it = shard.m_index.find(KeyType(revision, threshold));
+	if(it == shard.m_index.end())
+	{
+		m_misses ++;
+		return EdgeBuffer();
+	}
+
+	//Move to the front of the LRU list
+	shard.m_lru.splice(shard.m_lru.begin(), shard.m_lru, it->second);
+	m_hits ++;
+	return it->second->m_edges;
+}
+
+/**
+	@brief Adds the crossings of a waveform revision to the cache, replacing any existing entry
+ */
+void ZeroCrossingCache::Insert(uint64_t revision, float threshold, EdgeBuffer edges)
+{
+	KeyType key(revision, threshold);
+	auto& shard = GetShard(revision);
+	lock_guard<mutex> lock(shard.m_mutex);
+
+	//If another thread got here first, replace its result
+	auto it = shard.m_index.find(key);
+	if(it != shard.m_index.end())
+	{
+		shard.m_bytes -= GetSize(it->second->m_edges);
+		shard.m_lru.erase(it->second);
+		shard.m_index.erase(it);
+	}
+
+	shard.m_lru.push_front(Entry(key, edges));
+	shard.m_index[key] = shard.m_lru.begin();
+	shard.m_bytes += GetSize(edges);
+
+	Evict(shard);
+}
+
+/**
+	@brief Removes least recently used entries from a shard until it fits in its share of the memory limit.
+
+	The most recently used entry is always kept, even if it alone exceeds the limit, so that several filters
+	asking for the crossings of one huge waveform in succession still share a single computation.
+
+	Must be called with the shard's mutex held.
+ */
+void ZeroCrossingCache::Evict(Shard& shard)
+{
+	size_t limit = m_maxBytes / NUM_SHARDS;
+	while( (shard.m_bytes > limit) && (shard.m_lru.size() > 1) )
+	{
+		auto& e = shard.m_lru.back();
+		shard.m_bytes -= GetSize(e.m_edges);
+		shard.m_index.erase(e.m_key);
+		shard.m_lru.pop_back();
+	}
+}
+
+/**
+	@brief Removes all entries from the cache.
+
+	Buffers already handed out remain valid until their last user releases them.
+ */
+void ZeroCrossingCache::Clear()
+{
+	for(auto& shard : m_shards)
+	{
+		lock_guard<mutex> lock(shard.m_mutex);
+		shard.m_lru.clear();
+		shard.m_index.clear();
+		shard.m_bytes = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory management
+
+/**
+	@brief Changes the memory limit, evicting entries immediately if we're now over it
+ */
+void ZeroCrossingCache::SetMaxMemory(size_t bytes)
+{
+	m_maxBytes = bytes;
+
+	for(auto& shard : m_shards)
+	{
+		lock_guard<mutex> lock(shard.m_mutex);
+		Evict(shard);
+	}
+}
+
+/**
+	@brief Gets the total size of the edge data currently held by the cache
+ */
+size_t ZeroCrossingCache::GetMemoryUsage()
+{
+	size_t total = 0;
+	for(auto& shard : m_shards)
+	{
+		lock_guard<mutex> lock(shard.m_mutex);
+		total += shard.m_bytes;
+	}
+	return total;
+}
@@ -0,0 +1,132 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Declaration of ZeroCrossingCache
+ */
+#ifndef ZeroCrossingCache_h
+#define ZeroCrossingCache_h
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+
+/**
+	@brief Thread-safe, memory-bounded cache of interpolated zero crossings of analog waveforms
+
+	Entries are keyed by (waveform revision, threshold) rather than by waveform pointer, so a waveform being freed and
+	another allocated at the same address can never return stale results.
+
+	Edge lists are stored as shared, immutable buffers. Lookups hand out a reference to the cached buffer rather than
+	a copy, and the buffer stays valid for as long as the caller holds it even if the entry is evicted.
+
+	The cache is split into several independently locked shards to reduce contention when many filters look up
+	crossings at once. Each shard evicts its least recently used entries once over its share of the memory limit.
+ */
+class ZeroCrossingCache
+{
+public:
+	ZeroCrossingCache(size_t maxBytes = 512 * 1024 * 1024);
+
+	typedef std::shared_ptr< const std::vector<int64_t> > EdgeBuffer;
+
+	EdgeBuffer Find(uint64_t revision, float threshold);
+	void Insert(uint64_t revision, float threshold, EdgeBuffer edges);
+	void Clear();
+
+	void SetMaxMemory(size_t bytes);
+
+	///@brief Gets the maximum number of bytes of edge data held by the cache
+	size_t GetMaxMemory()
+	{ return m_maxBytes; }
+
+	size_t GetMemoryUsage();
+
+	///@brief Gets the number of lookups which found a cached result
+	size_t GetHitCount()
+	{ return m_hits; }
+
+	///@brief Gets the number of lookups which did not find a cached result
+	size_t GetMissCount()
+	{ return m_misses; }
+
+protected:
+	typedef std::pair<uint64_t, float> KeyType;
+
+	class Entry
+	{
+	public:
+		Entry(KeyType key, EdgeBuffer edges)
+		: m_key(key)
+		, m_edges(edges)
+		{}
+
+		KeyType m_key;
+		EdgeBuffer m_edges;
+	};
+
+	class Shard
+	{
+	public:
+		Shard()
+		: m_bytes(0)
+		{}
+
+		std::mutex m_mutex;
+
+		///@brief Entries in most- to least-recently-used order
+		std::list<Entry> m_lru;
+
+		///@brief Index into m_lru by key
+		std::map<KeyType, std::list<Entry>::iterator> m_index;
+
+		///@brief Total size of the edge data held by this shard
+		size_t m_bytes;
+	};
+
+	Shard& GetShard(uint64_t revision)
+	{ return m_shards[revision % NUM_SHARDS]; }
+
+	void Evict(Shard& shard);
+
+	static size_t GetSize(const EdgeBuffer& edges)
+	{ return edges->size() * sizeof(int64_t); }
+
+	enum { NUM_SHARDS = 16 };
+	Shard m_shards[NUM_SHARDS];
+
+	std::atomic<size_t> m_maxBytes;
+	std::atomic<size_t> m_hits;
+	std::atomic<size_t> m_misses;
+};
+
+#endif
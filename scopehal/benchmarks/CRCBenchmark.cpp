@@ -0,0 +1,120 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* ANTIKERNEL v0.1                                                                                                      *
+*                                                                                                                      *
+* Copyright (c) 2012-2021 Andrew D. Zonenberg                                                                          *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@author Andrew D. Zonenberg
+	@brief Standalone throughput benchmark for CRC
+
+	Not built by default. Build with "make crcbench" and run from the build directory.
+ */
+
+#include "../scopehal.h"
+#include "../CRC.h"
+
+using namespace std;
+
+/**
+	@brief Reference bit-at-a-time CRC-32, as the decoders used before CRC was introduced
+ */
+static uint32_t UpdateCRC32Bitwise(uint32_t crc, const uint8_t* data, size_t len)
+{
+	for(size_t i=0; i<len; i++)
+	{
+		crc ^= data[i];
+		for(int j=0; j<8; j++)
+		{
+			if(crc & 1)
+				crc = (crc >> 1) ^ 0xedb88320;
+			else
+				crc >>= 1;
+		}
+	}
+	return crc;
+}
+
+/**
+	@brief Runs one implementation over the buffer until at least 256 MB have been processed, returns MB/s
+ */
+template<class T>
+static double Measure(const char* name, const vector<uint8_t>& buf, uint32_t expected, T func)
+{
+	size_t iters = max<size_t>(1, (256 * 1024 * 1024) / buf.size());
+
+	uint32_t crc = 0;
+	double start = GetTime();
+	for(size_t i=0; i<iters; i++)
+		crc = ~func(0xffffffff, buf.data(), buf.size());
+	double dt = GetTime() - start;
+
+	double mbps = (iters * buf.size()) / (dt * 1024 * 1024);
+	printf("    %-12s %10.1f MB/s%s\n", name, mbps, (crc == expected) ? "" : " (MISMATCH)");
+	return mbps;
+}
+
+int main()
+{
+	DetectCPUFeatures();
+	bool pclmul = g_hasPclmul;
+
+	auto& crc32 = CRC::GetCRC32();
+
+	//Check value for the standard CRC-32 polynomial
+	const char* check = "123456789";
+	if(~crc32.Update(0xffffffff, (const uint8_t*)check, 9) != 0xcbf43926)
+	{
+		printf("CRC-32 check value mismatch\n");
+		return 1;
+	}
+
+	size_t sizes[] = {64, 1518, 4096, 65536};
+	for(auto size : sizes)
+	{
+		vector<uint8_t> buf(size);
+		for(size_t i=0; i<size; i++)
+			buf[i] = rand();
+		uint32_t expected = ~UpdateCRC32Bitwise(0xffffffff, buf.data(), size);
+
+		printf("CRC-32, %zu byte buffers:\n", size);
+		Measure("bitwise", buf, expected, UpdateCRC32Bitwise);
+
+		g_hasPclmul = false;
+		Measure("slice-by-8", buf, expected,
+			[&](uint32_t crc, const uint8_t* data, size_t len) { return crc32.Update(crc, data, len); });
+
+		if(pclmul)
+		{
+			g_hasPclmul = true;
+			Measure("pclmul", buf, expected,
+				[&](uint32_t crc, const uint8_t* data, size_t len) { return crc32.Update(crc, data, len); });
+		}
+	}
+
+	return 0;
+}
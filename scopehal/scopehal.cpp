@@ -76,6 +76,7 @@ bool g_hasAvx512F = false;
 bool g_hasAvx512DQ = false;
 bool g_hasAvx512VL = false;
 bool g_hasAvx2 = false;
+bool g_hasPclmul = false;
 bool g_disableOpenCL = false;
 
 #ifdef HAVE_OPENCL
@@ -114,6 +115,7 @@ void DetectCPUFeatures()
 	g_hasAvx512VL = __builtin_cpu_supports("avx512vl");
 	g_hasAvx512DQ = __builtin_cpu_supports("avx512dq");
 	g_hasAvx2 = __builtin_cpu_supports("avx2");
+	g_hasPclmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
 
 	if(g_hasAvx2)
 		LogDebug("* AVX2\n");
@@ -123,6 +125,8 @@ void DetectCPUFeatures()
 		LogDebug("* AVX512DQ\n");
 	if(g_hasAvx512VL)
 		LogDebug("* AVX512VL\n");
+	if(g_hasPclmul)
+		LogDebug("* PCLMULQDQ\n");
 	LogDebug("\n");
 }
 
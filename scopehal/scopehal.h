@@ -74,6 +74,12 @@
 #include "SCPIDevice.h"
 
 #include "OscilloscopeChannel.h"
+#include "PackedDigitalWaveform.h"
+#include "DigitalBusWaveform.h"
+#include "WaveformPool.h"
+#include "FFTPlanCache.h"
+#include "WaveformStatistics.h"
+#include "CRC.h"
 #include "FlowGraphNode.h"
 #include "Trigger.h"
 
@@ -87,6 +93,7 @@
 #include "Statistic.h"
 #include "FilterParameter.h"
 #include "Filter.h"
+#include "FilterGraphExecutor.h"
 #include "PeakDetectionFilter.h"
 #include "SpectrumChannel.h"
 
@@ -124,6 +131,7 @@ extern bool g_hasAvx512F;
 extern bool g_hasAvx512VL;
 extern bool g_hasAvx512DQ;
 extern bool g_hasAvx2;
+extern bool g_hasPclmul;
 
 #define FS_PER_SECOND 1e15
 #define SECONDS_PER_FS 1e-15
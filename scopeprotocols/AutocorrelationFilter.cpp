@@ -127,20 +127,25 @@ void AutocorrelationFilter::Refresh()
 	}
 
 	//Set up the output waveform
-	auto cap = new AnalogWaveform;
-
-	size_t end = len - range;
-	for(size_t delta=1; delta <= range; delta ++)
+	auto cap = WaveformPool::Allocate<AnalogWaveform>(range);
+	cap->Resize(range);
+	for(size_t i=0; i<range; i++)
 	{
-		double total = 0;
-		for(size_t i=0; i<end; i++)
-			total += din->m_samples[i] * din->m_samples[i+delta];
-
-		cap->m_samples.push_back(total / end);
-		cap->m_offsets.push_back(delta);
-		cap->m_durations.push_back(1);
+		cap->m_offsets[i] = i+1;
+		cap->m_durations[i] = 1;
 	}
 
+	//Direct computation is O(N * range) and the FFT is O(N log N) no matter how many lags we want.
+	//Each FFT costs a few operations per point per stage, and we need three of them.
+	size_t end = len - range;
+	size_t npoints = next_pow2(len);
+	double directCost = static_cast<double>(range) * end;
+	double fftCost = 12.0 * npoints * log2(npoints);
+	if(directCost > fftCost)
+		RefreshFFT(din, cap, range, end);
+	else
+		RefreshDirect(din, cap, range, end);
+
 	//Calculate range of the output waveform
 	float x = GetMaxVoltage(cap);
 	float n = GetMinVoltage(cap);
@@ -154,3 +159,70 @@ void AutocorrelationFilter::Refresh()
 
 	SetData(cap, 0);
 }
+
+/**
+	@brief Calculates the autocorrelation one lag at a time. Fastest for small lag ranges.
+ */
+void AutocorrelationFilter::RefreshDirect(AnalogWaveform* din, AnalogWaveform* cap, size_t range, size_t end)
+{
+	for(size_t delta=1; delta <= range; delta ++)
+	{
+		double total = 0;
+		for(size_t i=0; i<end; i++)
+			total += din->m_samples[i] * din->m_samples[i+delta];
+
+		cap->m_samples[delta-1] = total / end;
+	}
+}
+
+/**
+	@brief Calculates the autocorrelation for all lags at once in the frequency domain (Wiener-Khinchin).
+
+	Every lag sums over the same window of the first "end" samples, so the output is the cross-correlation of that
+	window with the whole waveform: IFFT(conj(FFT(window)) * FFT(waveform)). Zero padding to at least the full
+	waveform length is enough to keep the circular correlation from wrapping around for lags up to "range".
+ */
+void AutocorrelationFilter::RefreshFFT(AnalogWaveform* din, AnalogWaveform* cap, size_t range, size_t end)
+{
+	size_t len = din->m_samples.size();
+	size_t npoints = next_pow2(len);
+	size_t nouts = npoints/2 + 1;
+
+	auto forwardPlan = FFTPlanCache::GetRealPlan(npoints, FFTS_FORWARD);
+	auto reversePlan = FFTPlanCache::GetRealPlan(npoints, FFTS_BACKWARD);
+	auto inbuf = FFTPlanCache::GetScratchBuffer(npoints);
+	auto windowSpectrum = FFTPlanCache::GetScratchBuffer(2 * nouts);
+	auto signalSpectrum = FFTPlanCache::GetScratchBuffer(2 * nouts);
+	float* pin = &(*inbuf)[0];
+	float* a = &(*windowSpectrum)[0];
+	float* b = &(*signalSpectrum)[0];
+
+	//Transform the window, zero padded
+	memcpy(pin, &din->m_samples[0], end * sizeof(float));
+	memset(pin + end, 0, (npoints - end) * sizeof(float));
+	ffts_execute(forwardPlan.get(), pin, a);
+
+	//Transform the whole waveform, zero padded
+	memcpy(pin + end, &din->m_samples[end], (len - end) * sizeof(float));
+	ffts_execute(forwardPlan.get(), pin, b);
+
+	//Cross spectrum: conj(window) * signal
+	for(size_t i=0; i<nouts; i++)
+	{
+		float ar = a[i*2];
+		float ai = a[i*2 + 1];
+		float br = b[i*2];
+		float bi = b[i*2 + 1];
+
+		b[i*2]		= ar*br + ai*bi;
+		b[i*2 + 1]	= ar*bi - ai*br;
+	}
+
+	//Back to the time domain, reusing the input buffer for the output.
+	//The inverse FFT isn't normalized, so divide out the point count as well.
+	ffts_execute(reversePlan.get(), b, pin);
+
+	float scale = 1.0f / (static_cast<double>(npoints) * end);
+	for(size_t delta=1; delta <= range; delta ++)
+		cap->m_samples[delta-1] = pin[delta] * scale;
+}
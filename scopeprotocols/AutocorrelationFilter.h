@@ -55,6 +55,9 @@ public:
 	PROTOCOL_DECODER_INITPROC(AutocorrelationFilter)
 
 protected:
+	void RefreshDirect(AnalogWaveform* din, AnalogWaveform* cap, size_t range, size_t end);
+	void RefreshFFT(AnalogWaveform* din, AnalogWaveform* cap, size_t range, size_t end);
+
 	double	m_range;
 	double	m_offset;
 	std::string m_maxDeltaName;
@@ -112,10 +112,10 @@ void BaseMeasurement::Refresh()
 	size_t len = din->m_samples.size();
 
 	//Make a histogram of the waveform
-	float vmin = GetMinVoltage(din);
-	float vmax = GetMaxVoltage(din);
 	size_t nbins = 64;
-	vector<size_t> hist = MakeHistogram(din, vmin, vmax, nbins);
+	auto stats = WaveformStatistics::Get(din, nbins);
+	float vmin = stats->m_min;
+	float vmax = stats->m_max;
 
 	//Set temporary midpoint and range
 	m_range = (vmax - vmin);
@@ -123,18 +123,7 @@ void BaseMeasurement::Refresh()
 
 	//Find the highest peak in the first quarter of the histogram
 	//This is the base for the entire waveform
-	size_t binval = 0;
-	size_t idx = 0;
-	for(size_t i=0; i<(nbins/4); i++)
-	{
-		if(hist[i] > binval)
-		{
-			binval = hist[i];
-			idx = i;
-		}
-	}
-	float fbin = (idx + 0.5f)/nbins;
-	float global_base = fbin*m_range + vmin;
+	float global_base = stats->GetMostProbableVoltage(0, nbins/4);
 
 	//Create the output
 	auto cap = new AnalogWaveform;
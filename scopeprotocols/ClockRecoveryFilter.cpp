@@ -128,8 +128,8 @@ void ClockRecoveryFilter::Refresh()
 	auto gate = GetDigitalInputWaveform(1);
 
 	//Timestamps of the edges
-	vector<int64_t> edges;
-	FindZeroCrossings(din, m_parameters[m_threshname].GetFloatVal(), edges);
+	auto pedges = FindZeroCrossings(din, m_parameters[m_threshname].GetFloatVal());
+	auto& edges = *pedges;
 	if(edges.empty())
 	{
 		SetData(NULL, 0);
@@ -140,7 +140,7 @@ void ClockRecoveryFilter::Refresh()
 	int64_t period = round(FS_PER_SECOND / m_parameters[m_baudname].GetFloatVal());
 
 	//Create the output waveform and copy our timescales
-	auto cap = new DigitalWaveform;
+	auto cap = WaveformPool::Allocate<DigitalWaveform>(edges.size());
 	cap->m_startTimestamp = din->m_startTimestamp;
 	cap->m_startFemtoseconds = din->m_startFemtoseconds;
 	cap->m_triggerPhase = 0;
@@ -130,9 +130,8 @@ void DDJMeasurement::Refresh()
 	auto thresh = GetDigitalInputWaveform(1);
 	auto clk = GetDigitalInputWaveform(2);
 
-	//Sample the input data
-	DigitalWaveform samples;
-	SampleOnAnyEdges(thresh, clk, samples);
+	//Sample the input data (shared with any other filter sampling the same signals)
+	auto samples = SampleBitstream(thresh, clk);
 
 	//DDJ history (8 UIs)
 	uint8_t window = 0;
@@ -150,7 +149,7 @@ void DDJMeasurement::Refresh()
 	}
 
 	size_t tielen = tie->m_samples.size();
-	size_t samplen = samples.m_samples.size();
+	size_t samplen = samples->size();
 
 	size_t itie = 0;
 
@@ -161,7 +160,7 @@ void DDJMeasurement::Refresh()
 	{
 		//Sample the next bit in the thresholded waveform
 		window = (window >> 1);
-		if(samples.m_samples[idata])
+		if(samples->GetSample(idata))
 			window |= 0x80;
 		nbits ++;
 
@@ -170,7 +169,7 @@ void DDJMeasurement::Refresh()
 			continue;
 
 		//If we're still before the first TIE sample, nothing to do
-		int64_t tstart = samples.m_offsets[idata];
+		int64_t tstart = samples->m_offsets[idata];
 		if(tstart < tfirst)
 			continue;
 
@@ -188,7 +187,7 @@ void DDJMeasurement::Refresh()
 
 		//If the TIE sample is after this bit, don't do anything.
 		//We need edges within this UI.
-		int64_t tend = tstart + samples.m_durations[idata];
+		int64_t tend = tstart + samples->m_durations[idata];
 		if(target > tend)
 			continue;
 
@@ -646,16 +646,7 @@ string DSIPacketDecoder::GetText(int i)
 uint16_t DSIPacketDecoder::UpdateCRC(uint16_t crc, uint8_t data)
 {
 	//CRC16 with polynomial x^16 + x^12 + x^5 + x^0 (CRC-16-CCITT)
-	uint16_t poly = 0x8408;
-	for(int i=0; i<8; i++)
-	{
-		if( ((data >> i) ^ crc) & 1 )
-			crc = (crc >> 1) ^ poly;
-		else
-			crc >>= 1;
-	}
-
-	return crc;
+	return CRC::GetCRC16CCITT().Update(crc, data);
 }
 
 vector<string> DSIPacketDecoder::GetHeaders()
@@ -30,9 +30,19 @@
 #include "../scopehal/scopehal.h"
 #include "DeEmbedFilter.h"
 #include <immintrin.h>
+#include <omp.h>
 
 using namespace std;
 
+///@brief Captures at least this deep are processed in blocks rather than with one huge FFT
+static const size_t g_overlapSaveMinPoints = 1024 * 1024;
+
+///@brief Smallest block size for overlap-save processing
+static const size_t g_overlapSaveMinBlock = 64 * 1024;
+
+///@brief Largest block size for overlap-save processing (beyond this, long impulse responses use a single FFT)
+static const size_t g_overlapSaveMaxBlock = 4 * 1024 * 1024;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -53,12 +63,14 @@ DeEmbedFilter::DeEmbedFilter(const string& color)
 	m_max = -FLT_MAX;
 	m_cachedBinSize = 0;
 
-	m_forwardPlan = NULL;
-	m_reversePlan = NULL;
-
 	m_cachedNumPoints = 0;
 	m_cachedRawSize = 0;
 
+	m_blockPoints = 0;
+	m_blockFirstTap = 0;
+	m_blockLastTap = 0;
+	m_blockResponseValid = false;
+
 	#ifdef HAVE_CLFFT
 
 		m_clfftForwardPlan = 0;
@@ -158,14 +170,6 @@ DeEmbedFilter::~DeEmbedFilter()
 	m_fftoutbuf = NULL;
 	m_windowbuf = NULL;
 #endif
-
-	if(m_forwardPlan)
-		ffts_free(m_forwardPlan);
-	if(m_reversePlan)
-		ffts_free(m_reversePlan);
-
-	m_forwardPlan = NULL;
-	m_reversePlan = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -314,6 +318,72 @@ void DeEmbedFilter::DoRefresh(bool invert)
 	auto din = GetAnalogInputWaveform(0);
 	const size_t npoints_raw = din->m_samples.size();
 
+	//Calculate maximum group delay for the first few S-parameter bins (approx propagation delay of the channel)
+	int64_t groupdelay_fs = GetGroupDelay();
+	int64_t groupdelay_samples = ceil( groupdelay_fs / din->m_timescale );
+
+	//Calculate bounds for the *meaningful* output data.
+	//Since we're phase shifting, there's gonna be some garbage response at one end of the channel.
+	size_t istart = 0;
+	size_t iend = npoints_raw;
+	AnalogWaveform* cap = NULL;
+	if(invert)
+	{
+		iend -= groupdelay_samples;
+		cap = SetupOutputWaveform(din, 0, 0, groupdelay_samples);
+	}
+	else
+	{
+		istart += groupdelay_samples;
+		cap = SetupOutputWaveform(din, 0, groupdelay_samples, 0);
+	}
+
+	//Apply phase shift for the group delay so we draw the waveform in the right place even if dense packed
+	if(invert)
+		cap->m_triggerPhase = -groupdelay_fs;
+	else
+		cap->m_triggerPhase = groupdelay_fs;
+
+	//Deep captures are processed in blocks if possible, to bound memory usage and make use of all cores.
+	//The GPU path does the whole capture in one go.
+	bool gpu = false;
+	#ifdef HAVE_CLFFT
+		gpu = (g_clContext && m_windowProgram && m_deembedProgram);
+	#endif
+	float vmin = FLT_MAX;
+	float vmax = -FLT_MAX;
+	if(gpu || (npoints_raw < g_overlapSaveMinPoints) || !OverlapSaveRefresh(din, invert, cap, istart, iend, vmin, vmax))
+		SingleBlockRefresh(din, invert, cap, istart, iend, vmin, vmax);
+
+	//Calculate bounds
+	m_max = max(m_max, vmax);
+	m_min = min(m_min, vmin);
+	m_range = (m_max - m_min) * 1.05;
+	m_offset = -( (m_max - m_min)/2 + m_min );
+}
+
+/**
+	@brief Applies the S-parameters to the whole waveform with a single FFT
+
+	@param din		Input waveform
+	@param invert	True to de-embed, false to embed
+	@param cap		Output waveform, already set up
+	@param istart	First sample of the filtered waveform to output
+	@param iend		End of the range of samples of the filtered waveform to output
+	@param vmin		Minimum output value
+	@param vmax		Maximum output value
+ */
+void DeEmbedFilter::SingleBlockRefresh(
+	AnalogWaveform* din,
+	bool invert,
+	AnalogWaveform* cap,
+	size_t istart,
+	size_t iend,
+	float& vmin,
+	float& vmax)
+{
+	const size_t npoints_raw = din->m_samples.size();
+
 	//Zero pad to next power of two up
 	const size_t npoints = next_pow2(npoints_raw);
 	//LogTrace("DeEmbedFilter: processing %zu raw points\n", npoints_raw);
@@ -327,16 +397,6 @@ void DeEmbedFilter::DoRefresh(bool invert)
 	bool sizechange = false;
 	if( (m_cachedNumPoints != npoints) || (m_cachedRawSize != npoints_raw) )
 	{
-		if(m_forwardPlan)
-			ffts_free(m_forwardPlan);
-		m_forwardPlan = ffts_init_1d_real(npoints, FFTS_FORWARD);
-
-		if(m_reversePlan)
-			ffts_free(m_reversePlan);
-		m_reversePlan = ffts_init_1d_real(npoints, FFTS_BACKWARD);
-
-		m_forwardInBuf.resize(npoints);
-		m_forwardOutBuf.resize(2 * nouts);
 		m_reverseOutBuf.resize(npoints);
 
 		m_cachedNumPoints = npoints;
@@ -414,11 +474,12 @@ void DeEmbedFilter::DoRefresh(bool invert)
 
 	//Resample S21 to our FFT bin size if needed.
 	//Cache trig function output because there's no AVX instructions for this.
-	if( (fabs(m_cachedBinSize - bin_hz) > FLT_EPSILON) || sizechange )
+	if( (fabs(m_cachedBinSize - bin_hz) > FLT_EPSILON) || sizechange || (m_resampledSparamSines.size() != nouts) )
 	{
 		m_resampledSparamCosines.clear();
 		m_resampledSparamSines.clear();
 		InterpolateSparameters(bin_hz, invert, nouts);
+		m_blockResponseValid = false;
 
 		#ifdef HAVE_CLFFT
 			if(g_clContext)
@@ -494,57 +555,36 @@ void DeEmbedFilter::DoRefresh(bool invert)
 		{
 	#endif
 
+		auto forwardPlan = FFTPlanCache::GetRealPlan(npoints, FFTS_FORWARD);
+		auto reversePlan = FFTPlanCache::GetRealPlan(npoints, FFTS_BACKWARD);
+		auto inbuf = FFTPlanCache::GetScratchBuffer(npoints);
+		auto spectrum = FFTPlanCache::GetScratchBuffer(2 * nouts);
+		float* pin = &(*inbuf)[0];
+		float* pspectrum = &(*spectrum)[0];
+
 		//Copy the input, then fill any extra space with zeroes
-		memcpy(&m_forwardInBuf[0], &din->m_samples[0], npoints_raw*sizeof(float));
+		memcpy(pin, &din->m_samples[0], npoints_raw*sizeof(float));
 		for(size_t i=npoints_raw; i<npoints; i++)
-			m_forwardInBuf[i] = 0;
+			pin[i] = 0;
 
 		//Do the forward FFT
-		ffts_execute(m_forwardPlan, &m_forwardInBuf[0], &m_forwardOutBuf[0]);
+		ffts_execute(forwardPlan.get(), pin, pspectrum);
 
 		//Do the actual filter operation
 		if(g_hasAvx2)
-			MainLoopAVX2(nouts);
+			MainLoopAVX2(pspectrum, nouts);
 		else
-			MainLoop(nouts);
+			MainLoop(pspectrum, nouts);
 
 		//Calculate the inverse FFT
-		ffts_execute(m_reversePlan, &m_forwardOutBuf[0], &m_reverseOutBuf[0]);
+		ffts_execute(reversePlan.get(), pspectrum, &m_reverseOutBuf[0]);
 
 	#ifdef HAVE_CLFFT
 		}
 	#endif
 
-	//Calculate maximum group delay for the first few S-parameter bins (approx propagation delay of the channel)
-	int64_t groupdelay_fs = GetGroupDelay();
-	int64_t groupdelay_samples = ceil( groupdelay_fs / din->m_timescale );
-
-	//Calculate bounds for the *meaningful* output data.
-	//Since we're phase shifting, there's gonna be some garbage response at one end of the channel.
-	size_t istart = 0;
-	size_t iend = npoints_raw;
-	AnalogWaveform* cap = NULL;
-	if(invert)
-	{
-		iend -= groupdelay_samples;
-		cap = SetupOutputWaveform(din, 0, 0, groupdelay_samples);
-	}
-	else
-	{
-		istart += groupdelay_samples;
-		cap = SetupOutputWaveform(din, 0, groupdelay_samples, 0);
-	}
-
-	//Apply phase shift for the group delay so we draw the waveform in the right place even if dense packed
-	if(invert)
-		cap->m_triggerPhase = -groupdelay_fs;
-	else
-		cap->m_triggerPhase = groupdelay_fs;
-
 	//Copy waveform data after rescaling
 	float scale = 1.0f / npoints;
-	float vmin = FLT_MAX;
-	float vmax = -FLT_MAX;
 	size_t outlen = iend - istart;
 	for(size_t i=0; i<outlen; i++)
 	{
@@ -553,12 +593,226 @@ void DeEmbedFilter::DoRefresh(bool invert)
 		vmax = max(v, vmax);
 		cap->m_samples[i] = v;
 	}
+}
 
-	//Calculate bounds
-	m_max = max(m_max, vmax);
-	m_min = min(m_min, vmin);
-	m_range = (m_max - m_min) * 1.05;
-	m_offset = -( (m_max - m_min)/2 + m_min );
+/**
+	@brief Applies the S-parameters to the waveform in fixed size blocks (overlap-save)
+
+	Each block is FFT'd, multiplied by the resampled S-parameters, and inverse FFT'd. The first and last few samples
+	of the result are corrupted by circular wraparound of the impulse response, so blocks overlap by the length of the
+	impulse response and only the good part of each is kept. Blocks are independent, so they're spread across all
+	cores, and memory usage depends on the block size rather than the capture depth.
+
+	@return False if no block size small enough to be worth it can hold the impulse response, in which case nothing
+			was done and the caller should process the waveform in a single block instead.
+ */
+bool DeEmbedFilter::OverlapSaveRefresh(
+	AnalogWaveform* din,
+	bool invert,
+	AnalogWaveform* cap,
+	size_t istart,
+	size_t iend,
+	float& vmin,
+	float& vmax)
+{
+	const size_t npoints_raw = din->m_samples.size();
+	double fs = din->m_timescale * (din->m_offsets[1] - din->m_offsets[0]);
+	double sample_ghz = 1e6 / fs;
+
+	//Find the smallest block size where the impulse response takes up no more than half the block.
+	//Start from what we used last time so we don't keep re-measuring the response at sizes we know are too small.
+	size_t nblock = max(g_overlapSaveMinBlock, m_blockPoints);
+	while(true)
+	{
+		if( (nblock > g_overlapSaveMaxBlock) || (nblock >= npoints_raw) )
+			return false;
+
+		//Resample S21 to our FFT bin size if needed
+		size_t nouts = nblock/2 + 1;
+		double bin_hz = round((0.5f * sample_ghz * 1e9f) / nouts);
+		if( (fabs(m_cachedBinSize - bin_hz) > FLT_EPSILON) || (m_resampledSparamSines.size() != nouts) )
+		{
+			m_resampledSparamCosines.clear();
+			m_resampledSparamSines.clear();
+			InterpolateSparameters(bin_hz, invert, nouts);
+			m_blockResponseValid = false;
+		}
+
+		SetBlockSize(nblock);
+		if(!m_blockResponseValid)
+			MeasureImpulseResponse();
+
+		if( (m_blockLastTap - m_blockFirstTap) <= (int64_t)(nblock / 2) )
+			break;
+		nblock *= 2;
+	}
+
+	//Output samples n0 ... n0+nvalid-1 of a block depend on input samples n0-lasttap ... n0+nvalid-1-firsttap,
+	//and come out of the inverse FFT starting at index lasttap.
+	int64_t firsttap = m_blockFirstTap;
+	int64_t lasttap = m_blockLastTap;
+	size_t nvalid = nblock - (lasttap - firsttap);
+	size_t nouts = nblock/2 + 1;
+	size_t outlen = iend - istart;
+	size_t nblocks = (outlen + nvalid - 1) / nvalid;
+	size_t nworkers = min((size_t)omp_get_max_threads(), nblocks);
+	float scale = 1.0f / nblock;
+
+	vector<float> workermin(nworkers);
+	vector<float> workermax(nworkers);
+
+	#pragma omp parallel for
+	for(size_t w=0; w<nworkers; w++)
+	{
+		//Plans have internal scratch space, so each thread borrows its own
+		auto forwardPlan = FFTPlanCache::GetRealPlan(nblock, FFTS_FORWARD);
+		auto reversePlan = FFTPlanCache::GetRealPlan(nblock, FFTS_BACKWARD);
+		auto scratch = FFTPlanCache::GetScratchBuffer(2*nblock + 2*nouts);
+		float* inbuf = &(*scratch)[0];
+		float* outbuf = inbuf + nblock;
+		float* spectrum = outbuf + nblock;
+		float* samples = (float*)&din->m_samples[0];
+
+		float wmin = FLT_MAX;
+		float wmax = -FLT_MAX;
+		for(size_t b=w; b<nblocks; b += nworkers)
+		{
+			//Copy the input, zero filling anything off either end of the waveform
+			int64_t n0 = istart + b*nvalid;
+			int64_t s0 = n0 - lasttap;
+			int64_t copystart = max(s0, (int64_t)0);
+			int64_t copyend = min(s0 + (int64_t)nblock, (int64_t)npoints_raw);
+			if(copystart > s0)
+				memset(inbuf, 0, (copystart - s0) * sizeof(float));
+			if(copyend > copystart)
+				memcpy(inbuf + (copystart - s0), samples + copystart, (copyend - copystart) * sizeof(float));
+			else
+				copyend = copystart;
+			if(copyend < s0 + (int64_t)nblock)
+				memset(inbuf + (copyend - s0), 0, (s0 + nblock - copyend) * sizeof(float));
+
+			//Do the actual filter operation
+			ffts_execute(forwardPlan.get(), inbuf, spectrum);
+			if(g_hasAvx2)
+				MainLoopAVX2(spectrum, nouts);
+			else
+				MainLoop(spectrum, nouts);
+			ffts_execute(reversePlan.get(), spectrum, outbuf);
+
+			//Save the good part
+			size_t count = min(nvalid, (size_t)(iend - n0));
+			float* dout = (float*)&cap->m_samples[n0 - istart];
+			for(size_t k=0; k<count; k++)
+			{
+				float v = outbuf[lasttap + k] * scale;
+				wmin = min(v, wmin);
+				wmax = max(v, wmax);
+				dout[k] = v;
+			}
+		}
+
+		workermin[w] = wmin;
+		workermax[w] = wmax;
+	}
+
+	for(size_t w=0; w<nworkers; w++)
+	{
+		vmin = min(vmin, workermin[w]);
+		vmax = max(vmax, workermax[w]);
+	}
+
+	return true;
+}
+
+/**
+	@brief Switches to a new overlap-save block size, invalidating the cached impulse response extent if it changed
+ */
+void DeEmbedFilter::SetBlockSize(size_t nblock)
+{
+	if(m_blockPoints == nblock)
+		return;
+
+	m_blockPoints = nblock;
+	m_blockResponseValid = false;
+}
+
+/**
+	@brief Finds the extent of the impulse response at the current block size
+
+	The impulse response is the inverse FFT of the resampled S-parameters. Starting from its peak, grow a window
+	(circularly, since taps before time zero wrap around to the end of the block) until it contains all but a tiny
+	fraction of the energy. Causal taps count up from zero and anticausal ones are negative.
+ */
+void DeEmbedFilter::MeasureImpulseResponse()
+{
+	size_t nblock = m_blockPoints;
+	size_t nouts = nblock/2 + 1;
+	auto reversePlan = FFTPlanCache::GetRealPlan(nblock, FFTS_BACKWARD);
+	auto scratch = FFTPlanCache::GetScratchBuffer(nblock + 2*nouts);
+	float* h = &(*scratch)[0];
+
+	//Apply the S-parameters to a unit impulse
+	float* spectrum = h + nblock;
+	for(size_t i=0; i<nouts; i++)
+	{
+		spectrum[i*2] = 1;
+		spectrum[i*2 + 1] = 0;
+	}
+	if(g_hasAvx2)
+		MainLoopAVX2(spectrum, nouts);
+	else
+		MainLoop(spectrum, nouts);
+	ffts_execute(reversePlan.get(), spectrum, h);
+
+	//Find the total energy and the peak
+	double total = 0;
+	size_t peak = 0;
+	for(size_t i=0; i<nblock; i++)
+	{
+		float e = h[i] * h[i];
+		total += e;
+		if(e > h[peak] * h[peak])
+			peak = i;
+	}
+
+	//Grow the window a group of samples at a time (so we don't get stuck on zero crossings of ringing),
+	//toward whichever side has more energy
+	const size_t group = 64;
+	double target = total * (1 - 1e-6);
+	int64_t lo = peak;
+	int64_t hi = peak;
+	double energy = h[peak] * h[peak];
+	while( (energy < target) && ((size_t)(hi - lo + 1) + group < nblock) )
+	{
+		double elo = 0;
+		double ehi = 0;
+		for(size_t i=1; i<=group; i++)
+		{
+			float vlo = h[(lo - i + nblock) % nblock];
+			float vhi = h[(hi + i) % nblock];
+			elo += vlo * vlo;
+			ehi += vhi * vhi;
+		}
+
+		if(elo > ehi)
+		{
+			lo -= group;
+			energy += elo;
+		}
+		else
+		{
+			hi += group;
+			energy += ehi;
+		}
+	}
+
+	//Convert to signed tap positions, centered on the peak
+	int64_t shift = 0;
+	if(peak > nblock/2)
+		shift = nblock;
+	m_blockFirstTap = min(lo - shift, (int64_t)0);
+	m_blockLastTap = max(hi - shift, (int64_t)0);
+	m_blockResponseValid = true;
 }
 
 int64_t DeEmbedFilter::GetGroupDelay()
@@ -603,25 +857,25 @@ void DeEmbedFilter::InterpolateSparameters(float bin_hz, bool invert, size_t nou
 	}
 }
 
-void DeEmbedFilter::MainLoop(size_t nouts)
+void DeEmbedFilter::MainLoop(float* buf, size_t nouts)
 {
 	for(size_t i=0; i<nouts; i++)
 	{
-		float cosval = m_resampledSparamSines[i];
-		float sinval = m_resampledSparamCosines[i];
+		float cosval = m_resampledSparamCosines[i];
+		float sinval = m_resampledSparamSines[i];
 
 		//Uncorrected complex value
-		float real_orig = m_forwardOutBuf[i*2 + 0];
-		float imag_orig = m_forwardOutBuf[i*2 + 1];
+		float real_orig = buf[i*2 + 0];
+		float imag_orig = buf[i*2 + 1];
 
 		//Amplitude correction
-		m_forwardOutBuf[i*2 + 0] = real_orig*cosval - imag_orig*sinval;
-		m_forwardOutBuf[i*2 + 1] = real_orig*sinval + imag_orig*cosval;
+		buf[i*2 + 0] = real_orig*cosval - imag_orig*sinval;
+		buf[i*2 + 1] = real_orig*sinval + imag_orig*cosval;
 	}
 }
 
 __attribute__((target("avx2")))
-void DeEmbedFilter::MainLoopAVX2(size_t nouts)
+void DeEmbedFilter::MainLoopAVX2(float* buf, size_t nouts)
 {
 	unsigned int end = nouts - (nouts % 8);
 
@@ -634,8 +888,8 @@ void DeEmbedFilter::MainLoopAVX2(size_t nouts)
 		__m256 cosval = _mm256_load_ps(&m_resampledSparamCosines[i]);
 
 		//Load uncorrected complex values (interleaved real/imag real/imag)
-		__m256 din0 = _mm256_load_ps(&m_forwardOutBuf[i*2]);
-		__m256 din1 = _mm256_load_ps(&m_forwardOutBuf[i*2 + 8]);
+		__m256 din0 = _mm256_load_ps(&buf[i*2]);
+		__m256 din1 = _mm256_load_ps(&buf[i*2 + 8]);
 
 		//Original state of each block is riririri.
 		//Shuffle them around to get all the reals and imaginaries together.
@@ -676,8 +930,8 @@ void DeEmbedFilter::MainLoopAVX2(size_t nouts)
 		din1 =_mm256_permute_ps(_mm256_castsi256_ps(block1), 0xd8);
 
 		//Write back output
-		_mm256_store_ps(&m_forwardOutBuf[i*2], din0);
-		_mm256_store_ps(&m_forwardOutBuf[i*2] + 8, din1);
+		_mm256_store_ps(&buf[i*2], din0);
+		_mm256_store_ps(&buf[i*2] + 8, din1);
 	}
 
 	//Do any leftovers
@@ -686,11 +940,11 @@ void DeEmbedFilter::MainLoopAVX2(size_t nouts)
 		//Fetch inputs
 		float cosval = m_resampledSparamCosines[i];
 		float sinval = m_resampledSparamSines[i];
-		float real_orig = m_forwardOutBuf[i*2 + 0];
-		float imag_orig = m_forwardOutBuf[i*2 + 1];
+		float real_orig = buf[i*2 + 0];
+		float imag_orig = buf[i*2 + 1];
 
 		//Do the actual phase correction
-		m_forwardOutBuf[i*2 + 0] = real_orig*cosval - imag_orig*sinval;
-		m_forwardOutBuf[i*2 + 1] = real_orig*sinval + imag_orig*cosval;
+		buf[i*2 + 0] = real_orig*cosval - imag_orig*sinval;
+		buf[i*2 + 1] = real_orig*sinval + imag_orig*cosval;
 	}
 }
@@ -87,17 +87,46 @@ protected:
 
 	SParameters m_sparams;
 
-	ffts_plan_t* m_forwardPlan;
-	ffts_plan_t* m_reversePlan;
 	size_t m_cachedNumPoints;
 	size_t m_cachedRawSize;
 
-	std::vector<float, AlignedAllocator<float, 64> > m_forwardInBuf;
-	std::vector<float, AlignedAllocator<float, 64> > m_forwardOutBuf;
 	std::vector<float, AlignedAllocator<float, 64> > m_reverseOutBuf;
 
-	void MainLoop(size_t nouts);
-	void MainLoopAVX2(size_t nouts);
+	void MainLoop(float* buf, size_t nouts);
+	void MainLoopAVX2(float* buf, size_t nouts);
+
+	void SingleBlockRefresh(
+		AnalogWaveform* din,
+		bool invert,
+		AnalogWaveform* cap,
+		size_t istart,
+		size_t iend,
+		float& vmin,
+		float& vmax);
+
+	bool OverlapSaveRefresh(
+		AnalogWaveform* din,
+		bool invert,
+		AnalogWaveform* cap,
+		size_t istart,
+		size_t iend,
+		float& vmin,
+		float& vmax);
+
+	void SetBlockSize(size_t nblock);
+	void MeasureImpulseResponse();
+
+	///@brief Block size for overlap-save processing
+	size_t m_blockPoints;
+
+	///@brief Earliest tap of the impulse response (zero or negative), in samples
+	int64_t m_blockFirstTap;
+
+	///@brief Latest tap of the impulse response (zero or positive), in samples
+	int64_t m_blockLastTap;
+
+	///@brief True if m_blockFirstTap and m_blockLastTap are up to date with the resampled S-parameters
+	bool m_blockResponseValid;
 
 	#ifdef HAVE_CLFFT
 	clfftPlanHandle m_clfftForwardPlan;
@@ -127,7 +127,7 @@ void EthernetGMIIDecoder::Refresh()
 
 	size_t len = den.m_samples.size();
 	len = min(len, der.m_samples.size());
-	len = min(len, ddata.m_samples.size());
+	len = min(len, ddata.size());
 	for(size_t i=0; i < len; i++)
 	{
 		if(!den.m_samples[i])
@@ -141,13 +141,8 @@ void EthernetGMIIDecoder::Refresh()
 		//TODO: handle error signal (ignored for now)
 		while( (i < len) && (den.m_samples[i]) )
 		{
-			//Convert bits to bytes
-			uint8_t dval = 0;
-			for(size_t j=0; j<8; j++)
-			{
-				if(ddata.m_samples[i][j])
-					dval |= (1 << j);
-			}
+			//Low 8 bits of the bus are the data byte
+			uint8_t dval = ddata.GetSample(i) & 0xff;
 
 			bytes.push_back(dval);
 			starts.push_back(ddata.m_offsets[i]);
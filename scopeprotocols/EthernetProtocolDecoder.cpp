@@ -139,6 +139,7 @@ void EthernetProtocolDecoder::BytesToFrames(
 	EthernetFrameSegment segment;
 	segment.m_type = EthernetFrameSegment::TYPE_INVALID;
 	size_t start = 0;
+	size_t framestart = 0;
 	size_t len = bytes.size();
 	for(size_t i=0; i<len; i++)
 	{
@@ -187,6 +188,7 @@ void EthernetProtocolDecoder::BytesToFrames(
 					//Set up for data
 					segment.m_type = EthernetFrameSegment::TYPE_DST_MAC;
 					segment.m_data.clear();
+					framestart = i+1;
 
 					//Save to the PCAP file, if open
 					if(m_fpOut)
@@ -450,6 +452,20 @@ void EthernetProtocolDecoder::BytesToFrames(
 				//Are we done? Add it
 				if(segment.m_data.size() == 4)
 				{
+					//FCS covers everything from the destination MAC to the end of the payload,
+					//and is sent as the inverted CRC-32, least significant byte first
+					uint32_t crc = ~CRC::GetCRC32().Update(0xffffffff, &bytes[framestart], i - 3 - framestart);
+					uint32_t fcs =
+						(segment.m_data[3] << 24) |
+						(segment.m_data[2] << 16) |
+						(segment.m_data[1] << 8) |
+						segment.m_data[0];
+					if(crc != fcs)
+					{
+						segment.m_type = EthernetFrameSegment::TYPE_FCS_BAD;
+						pack->m_displayBackgroundColor = m_backgroundColors[PROTO_COLOR_ERROR];
+					}
+
 					cap->m_durations.push_back( (ends[i] - start)/ cap->m_timescale);
 					cap->m_samples.push_back(segment);
 
@@ -495,9 +511,10 @@ Gdk::Color EthernetProtocolDecoder::GetColor(int i)
 		case EthernetFrameSegment::TYPE_VLAN_TAG:
 			return m_standardColors[COLOR_CONTROL];
 
-		//TODO: verify checksum
 		case EthernetFrameSegment::TYPE_FCS:
 			return m_standardColors[COLOR_CHECKSUM_OK];
+		case EthernetFrameSegment::TYPE_FCS_BAD:
+			return m_standardColors[COLOR_CHECKSUM_BAD];
 
 		//Signal has entirely disappeared
 		case EthernetFrameSegment::TYPE_NO_CARRIER:
@@ -652,15 +669,17 @@ string EthernetProtocolDecoder::GetText(int i)
 			}
 
 		case EthernetFrameSegment::TYPE_FCS:
+		case EthernetFrameSegment::TYPE_FCS_BAD:
 			{
 				if(sample.m_data.size() != 4)
 					return "[invalid FCS length]";
 
-				snprintf(tmp, sizeof(tmp), "CRC: %02x%02x%02x%02x",
+				snprintf(tmp, sizeof(tmp), "CRC: %02x%02x%02x%02x%s",
 					sample.m_data[0],
 					sample.m_data[1],
 					sample.m_data[2],
-					sample.m_data[3]);
+					sample.m_data[3],
+					(sample.m_type == EthernetFrameSegment::TYPE_FCS_BAD) ? " (bad)" : "");
 				return tmp;
 			}
 
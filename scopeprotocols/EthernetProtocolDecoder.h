@@ -53,7 +53,8 @@ public:
 		TYPE_ETHERTYPE,
 		TYPE_VLAN_TAG,
 		TYPE_PAYLOAD,
-		TYPE_FCS,
+		TYPE_FCS,			//valid FCS
+		TYPE_FCS_BAD,
 		TYPE_INBAND_STATUS,	//RGMII or similar
 		TYPE_NO_CARRIER
 	} m_type;
@@ -116,7 +116,7 @@ void EthernetRGMIIDecoder::Refresh()
 
 	//Need a reasonable number of samples or there's no point in decoding.
 	//Cut off the last few samples because we might be either DDR or SDR and need to seek past our current position.
-	size_t len = min(dctl.m_samples.size(), ddata.m_samples.size());
+	size_t len = min(dctl.m_samples.size(), ddata.size());
 	if(len < 100)
 	{
 		SetData(NULL, 0);
@@ -137,12 +137,7 @@ void EthernetRGMIIDecoder::Refresh()
 		if(!dctl.m_samples[i])
 		{
 			//Extract in-band status
-			uint8_t status = 0;
-			for(size_t j=0; j<4; j++)
-			{
-				if(ddata.m_samples[i][j])
-					status |= (1 << j);
-			}
+			uint8_t status = ddata.GetSample(i) & 0xf;
 
 			//Same status? Merge samples
 			bool extend = false;
@@ -192,18 +187,8 @@ void EthernetRGMIIDecoder::Refresh()
 
 			if(ddr)
 			{
-				//Convert bits to bytes
-				uint8_t dval = 0;
-				for(size_t j=0; j<8; j++)
-				{
-					if(j < 4)
-					{
-						if(ddata.m_samples[i][j])
-							dval |= (1 << j);
-					}
-					else if(ddata.m_samples[i+1][j-4])
-						dval |= (1 << j);
-				}
+				//Low nibble first
+				uint8_t dval = (ddata.GetSample(i) & 0xf) | ( (ddata.GetSample(i+1) & 0xf) << 4);
 				bytes.push_back(dval);
 
 				ends.push_back(ddata.m_offsets[i+1] + ddata.m_durations[i+1]);
@@ -212,18 +197,8 @@ void EthernetRGMIIDecoder::Refresh()
 
 			else
 			{
-				//Convert bits to bytes
-				uint8_t dval = 0;
-				for(size_t j=0; j<8; j++)
-				{
-					if(j < 4)
-					{
-						if(ddata.m_samples[i][j])
-							dval |= (1 << j);
-					}
-					else if(ddata.m_samples[i+2][j-4])
-						dval |= (1 << j);
-				}
+				//Low nibble first
+				uint8_t dval = (ddata.GetSample(i) & 0xf) | ( (ddata.GetSample(i+2) & 0xf) << 4);
 				bytes.push_back(dval);
 
 				ends.push_back(ddata.m_offsets[i+3] + ddata.m_durations[i+3]);
@@ -31,6 +31,7 @@
 #include "EyePattern.h"
 #include <algorithm>
 #include <immintrin.h>
+#include <omp.h>
 
 using namespace std;
 
@@ -113,6 +114,12 @@ EyePattern::EyePattern(const string& color)
 	, m_vmodeName("Vertical Scale Mode")
 	, m_rangeName("Vertical Range")
 	, m_clockAlignName("Clock Alignment")
+	, m_maskBitmapWidth(0)
+	, m_maskBitmapHeight(0)
+	, m_maskBitmapXOff(0)
+	, m_maskBitmapXScale(0)
+	, m_maskBitmapYScale(0)
+	, m_maskBitmapUIWidth(0)
 {
 	//Set up channels
 	CreateInput("din");
@@ -455,27 +462,60 @@ void EyePattern::Refresh()
 	//Process the eye
 	size_t cend = clock_edges.size() - 1;
 	size_t wend = waveform->m_samples.size()-1;
-	int32_t ymax = m_height - 1;
-	int32_t xmax = m_width - 1;
 	if(m_xscale > FLT_EPSILON)
 	{
-		//Optimized inner loop for dense packed waveforms
-		//We can assume m_offsets[i] = i and m_durations[i] = 0 for all input
-		if(waveform->m_densePacked)
-		{
-			if(g_hasAvx2)
-				DensePackedInnerLoopAVX2(waveform, clock_edges, data, wend, cend, xmax, ymax, xtimescale, yscale, yoff);
-			else
-				DensePackedInnerLoop(waveform, clock_edges, data, wend, cend, xmax, ymax, xtimescale, yscale, yoff);
-		}
+		//Each block after the first integrates into its own accumulator, summed into the eye once all are done
+		size_t numblocks = GetParallelBlockCount(wend);
+
+		if(numblocks <= 1)
+			AccumulateBlock(waveform, clock_edges, data, 0, wend, cend, xtimescale, yscale, yoff);
 
-		//Normal main loop
 		else
-			SparsePackedInnerLoop(waveform, clock_edges, data, wend, cend, xmax, ymax, xtimescale, yscale, yoff);
+		{
+			//Round blocks to multiples of 8 samples for clean vectorization
+			size_t npix = m_width * m_height;
+			size_t lastblock = numblocks - 1;
+			size_t blocksize = wend / numblocks;
+			blocksize = blocksize - (blocksize % 8);
+			m_blockAccum.resize(lastblock * npix);
+
+			#pragma omp parallel for
+			for(size_t i=0; i<numblocks; i++)
+			{
+				//Last block gets any extra that didn't divide evenly
+				size_t istart = i*blocksize;
+				size_t iend = istart + blocksize;
+				if(i == lastblock)
+					iend = wend;
+
+				int64_t* accum = data;
+				if(i > 0)
+				{
+					accum = &m_blockAccum[(i-1) * npix];
+					memset(accum, 0, npix * sizeof(int64_t));
+				}
+
+				AccumulateBlock(waveform, clock_edges, accum, istart, iend, cend, xtimescale, yscale, yoff);
+			}
+
+			//Merge the per-block accumulators into the eye
+			#pragma omp parallel for
+			for(size_t y=0; y<m_height; y++)
+			{
+				int64_t* row = data + y*m_width;
+				for(size_t i=0; i<lastblock; i++)
+				{
+					int64_t* brow = &m_blockAccum[i*npix + y*m_width];
+					for(size_t x=0; x<m_width; x++)
+						row[x] += brow[x];
+				}
+			}
+		}
 	}
 
 	//Rightmost column of the eye has some rounding artifacts.
 	//For now, just replace it with the value from 1 column to its left.
+	int32_t xmax = m_width - 1;
 	size_t delta = ceil(m_xscale);
 	size_t xstart = xmax - delta;
 	size_t xend = xmax;
@@ -500,12 +540,72 @@ void EyePattern::Refresh()
 	LogTrace("Refresh took %.3f ms (avg %.3f)\n", dt * 1000, (total_time * 1000) / total_frames);
 }
 
+/**
+	@brief Integrates samples [istart, iend) of the waveform into an eye accumulator buffer
+
+	@param waveform		The input waveform
+	@param clock_edges	Timestamps of the sampling clock edges
+	@param data			Accumulator buffer to integrate into
+	@param istart		Index of the first sample to process
+	@param iend			Index one past the last sample to process (must be less than the waveform length)
+	@param cend			Index of the last clock edge
+ */
+void EyePattern::AccumulateBlock(
+	AnalogWaveform* waveform,
+	vector<int64_t>& clock_edges,
+	int64_t* data,
+	size_t istart,
+	size_t iend,
+	size_t cend,
+	float xtimescale,
+	float yscale,
+	float yoff
+	)
+{
+	//Find the UI containing the first sample of the block.
+	//This is the last clock edge at or before the sample (or the first edge, if the sample comes before it).
+	int64_t tstart = waveform->GetOffset(istart) * waveform->m_timescale + waveform->m_triggerPhase;
+	size_t iclock = upper_bound(clock_edges.begin(), clock_edges.end(), tstart) - clock_edges.begin();
+	if(iclock > 0)
+		iclock --;
+	if(iclock >= cend)
+		return;
+
+	int32_t ymax = m_height - 1;
+	int32_t xmax = m_width - 1;
+
+	//Optimized inner loop for dense packed waveforms
+	//We can assume m_offsets[i] = i and m_durations[i] = 0 for all input
+	if(waveform->m_densePacked)
+	{
+		if(g_hasAvx2)
+		{
+			DensePackedInnerLoopAVX2(
+				waveform, clock_edges, data, istart, iend, iclock, cend, xmax, ymax, xtimescale, yscale, yoff);
+		}
+		else
+		{
+			DensePackedInnerLoop(
+				waveform, clock_edges, data, istart, iend, iclock, cend, xmax, ymax, xtimescale, yscale, yoff);
+		}
+	}
+
+	//Normal main loop
+	else
+	{
+		SparsePackedInnerLoop(
+			waveform, clock_edges, data, istart, iend, iclock, cend, xmax, ymax, xtimescale, yscale, yoff);
+	}
+}
+
 __attribute__((target("avx2")))
 void EyePattern::DensePackedInnerLoopAVX2(
 	AnalogWaveform* waveform,
 	vector<int64_t>& clock_edges,
 	int64_t* data,
-	size_t wend,
+	size_t istart,
+	size_t iend,
+	size_t iclock,
 	size_t cend,
 	int32_t xmax,
 	int32_t ymax,
@@ -514,9 +614,8 @@ void EyePattern::DensePackedInnerLoopAVX2(
 	float yoff
 	)
 {
-	size_t iclock = 0;
-
-	size_t wend_rounded = wend - (wend % 8);
+	size_t len = iend - istart;
+	size_t iend_rounded = istart + len - (len % 8);
 
 	//Splat some constants into vector regs
 	__m256i vxoff 		= _mm256_set1_epi32((int)m_xoff);
@@ -530,9 +629,9 @@ void EyePattern::DensePackedInnerLoopAVX2(
 	float* samples = (float*)&waveform->m_samples[0];
 
 	//Main unrolled loop, 8 samples per iteration
-	size_t i = 0;
+	size_t i = istart;
 	uint32_t bufmax = m_width * (m_height - 1);
-	for(; i<wend_rounded && iclock < cend; i+= 8)
+	for(; i<iend_rounded && iclock < cend; i+= 8)
 	{
 		//Figure out timestamp of this sample within the UI.
 		//This doesn't vectorize well, but it's pretty fast.
@@ -616,7 +715,7 @@ void EyePattern::DensePackedInnerLoopAVX2(
 	}
 
 	//Catch any stragglers
-	for(; i<wend && iclock < cend; i++)
+	for(; i<iend && iclock < cend; i++)
 	{
 		//Find time of this sample.
 		//If it's past the end of the current UI, move to the next clock edge
@@ -670,7 +769,9 @@ void EyePattern::DensePackedInnerLoop(
 	AnalogWaveform* waveform,
 	vector<int64_t>& clock_edges,
 	int64_t* data,
-	size_t wend,
+	size_t istart,
+	size_t iend,
+	size_t iclock,
 	size_t cend,
 	int32_t xmax,
 	int32_t ymax,
@@ -679,8 +780,7 @@ void EyePattern::DensePackedInnerLoop(
 	float yoff
 	)
 {
-	size_t iclock = 0;
-	for(size_t i=0; i<wend && iclock < cend; i++)
+	for(size_t i=istart; i<iend && iclock < cend; i++)
 	{
 		//Find time of this sample.
 		//If it's past the end of the current UI, move to the next clock edge
@@ -734,7 +834,9 @@ void EyePattern::SparsePackedInnerLoop(
 	AnalogWaveform* waveform,
 	vector<int64_t>& clock_edges,
 	int64_t* data,
-	size_t wend,
+	size_t istart,
+	size_t iend,
+	size_t iclock,
 	size_t cend,
 	int32_t xmax,
 	int32_t ymax,
@@ -743,8 +845,7 @@ void EyePattern::SparsePackedInnerLoop(
 	float yoff
 	)
 {
-	size_t iclock = 0;
-	for(size_t i=0; i<wend && iclock < cend; i++)
+	for(size_t i=istart; i<iend && iclock < cend; i++)
 	{
 		//Find time of this sample.
 		//If it's past the end of the current UI, move to the next clock edge
@@ -858,7 +959,42 @@ void EyePattern::RecalculateUIWidth()
  */
 void EyePattern::DoMaskTest(EyeWaveform* cap)
 {
-	//TODO: performance optimization, don't re-render mask every waveform, only when we resize
+	float yscale = m_height / GetVoltageRange();
+	UpdateMaskBitmap(cap, yscale);
+
+	//Test each pixel of the eye pattern against the mask
+	auto accum = cap->GetAccumData();
+	auto mask = &m_maskBitmap[0];
+	size_t npix = m_width * m_height;
+	int64_t total = 0;
+	int64_t hits = 0;
+	if(g_hasAvx2)
+		CountMaskHitsAVX2(mask, accum, 0, npix, total, hits);
+	else
+		CountMaskHits(mask, accum, 0, npix, total, hits);
+
+	cap->SetMaskHitRate(hits * 1.0f / total);
+}
+
+/**
+	@brief Rasterizes the mask into m_maskBitmap, if it's not already up to date.
+
+	The mask only needs to be re-rendered when the mask file, eye size, or scales change, not every waveform.
+ */
+void EyePattern::UpdateMaskBitmap(EyeWaveform* cap, float yscale)
+{
+	//UI width only matters if the mask is in UIs, but it's cheap to always compare
+	float uiwidth = cap->GetUIWidth();
+	if( (m_maskBitmapFile == m_mask.GetFileName()) &&
+		(m_maskBitmapWidth == m_width) &&
+		(m_maskBitmapHeight == m_height) &&
+		(m_maskBitmapXOff == m_xoff) &&
+		(m_maskBitmapXScale == m_xscale) &&
+		(m_maskBitmapYScale == yscale) &&
+		(m_maskBitmapUIWidth == uiwidth) )
+	{
+		return;
+	}
 
 	//Create the Cairo surface we're drawing on
 	Cairo::RefPtr< Cairo::ImageSurface > surface =
@@ -875,7 +1011,6 @@ void EyePattern::DoMaskTest(EyeWaveform* cap)
 	cr->fill();
 
 	//Software rendering
-	float yscale = m_height / GetVoltageRange();
 	m_mask.RenderForAnalysis(
 		cr,
 		cap,
@@ -884,30 +1019,96 @@ void EyePattern::DoMaskTest(EyeWaveform* cap)
 		yscale,
 		0,
 		m_height);
+	surface->flush();
 
-	auto accum = cap->GetAccumData();
-
-	//Test each pixel of the eye pattern against the mask
+	//Anything that isn't black is part of the mask
+	m_maskBitmap.resize(m_width * m_height);
 	uint32_t* data = reinterpret_cast<uint32_t*>(surface->get_data());
 	int stride = surface->get_stride() / sizeof(uint32_t);
-	size_t total = 0;
-	size_t hits = 0;
 	for(size_t y=0; y<m_height; y++)
 	{
 		auto row = data + (y*stride);
-		auto eyerow = accum + (y*m_width);
+		auto maskrow = &m_maskBitmap[y*m_width];
 		for(size_t x=0; x<m_width; x++)
-		{
-			//Look up the eye pattern pixel
-			auto bin = eyerow[x];
-			total += bin;
-
-			//If mask pixel isn't black, count violations
-			uint32_t pix = row[x];
-			if( (pix & 0xff) != 0)
-				hits += bin;
-		}
+			maskrow[x] = (row[x] & 0xff) ? 0xff : 0;
 	}
 
-	cap->SetMaskHitRate(hits * 1.0f / total);
+	m_maskBitmapFile = m_mask.GetFileName();
+	m_maskBitmapWidth = m_width;
+	m_maskBitmapHeight = m_height;
+	m_maskBitmapXOff = m_xoff;
+	m_maskBitmapXScale = m_xscale;
+	m_maskBitmapYScale = yscale;
+	m_maskBitmapUIWidth = uiwidth;
+}
+
+/**
+	@brief Sums eye pixels [start, end), both in total and for pixels inside the mask
+
+	@param mask		Mask bitmap (nonzero for pixels inside the mask)
+	@param accum	Eye accumulator buffer
+	@param start	Index of the first pixel to process
+	@param end		Index one past the last pixel to process
+	@param total	Sum of all pixels is added to this
+	@param hits		Sum of pixels inside the mask is added to this
+ */
+void EyePattern::CountMaskHits(
+	const uint8_t* mask,
+	const int64_t* accum,
+	size_t start,
+	size_t end,
+	int64_t& total,
+	int64_t& hits)
+{
+	for(size_t i=start; i<end; i++)
+	{
+		auto bin = accum[i];
+		total += bin;
+		if(mask[i])
+			hits += bin;
+	}
+}
+
+__attribute__((target("avx2")))
+void EyePattern::CountMaskHitsAVX2(
+	const uint8_t* mask,
+	const int64_t* accum,
+	size_t start,
+	size_t end,
+	int64_t& total,
+	int64_t& hits)
+{
+	size_t len = end - start;
+	size_t end_rounded = start + len - (len % 8);
+
+	__m256i vtotal0 = _mm256_setzero_si256();
+	__m256i vtotal1 = _mm256_setzero_si256();
+	__m256i vhits0 = _mm256_setzero_si256();
+	__m256i vhits1 = _mm256_setzero_si256();
+
+	for(size_t i=start; i<end_rounded; i+=8)
+	{
+		__m256i bins0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accum + i));
+		__m256i bins1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(accum + i + 4));
+
+		//Sign extend 0x00 / 0xff mask bytes to 64-bit lane masks
+		__m128i mbytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(mask + i));
+		__m256i mask0 = _mm256_cvtepi8_epi64(mbytes);
+		__m256i mask1 = _mm256_cvtepi8_epi64(_mm_srli_si128(mbytes, 4));
+
+		vtotal0 = _mm256_add_epi64(vtotal0, bins0);
+		vtotal1 = _mm256_add_epi64(vtotal1, bins1);
+		vhits0 = _mm256_add_epi64(vhits0, _mm256_and_si256(bins0, mask0));
+		vhits1 = _mm256_add_epi64(vhits1, _mm256_and_si256(bins1, mask1));
+	}
+
+	//Horizontal reduction
+	int64_t tmp[4] __attribute__((aligned(32)));
+	_mm256_store_si256(reinterpret_cast<__m256i*>(tmp), _mm256_add_epi64(vtotal0, vtotal1));
+	total += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(tmp), _mm256_add_epi64(vhits0, vhits1));
+	hits += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+
+	//Get any extras
+	CountMaskHits(mask, accum, end_rounded, end, total, hits);
 }
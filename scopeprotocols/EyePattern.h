@@ -170,12 +170,32 @@ public:
 
 protected:
 	void DoMaskTest(EyeWaveform* cap);
+	void UpdateMaskBitmap(EyeWaveform* cap, float yscale);
+
+	static void CountMaskHits(
+		const uint8_t* mask, const int64_t* accum, size_t start, size_t end, int64_t& total, int64_t& hits);
+	static void CountMaskHitsAVX2(
+		const uint8_t* mask, const int64_t* accum, size_t start, size_t end, int64_t& total, int64_t& hits);
+
+	void AccumulateBlock(
+		AnalogWaveform* waveform,
+		std::vector<int64_t>& clock_edges,
+		int64_t* data,
+		size_t istart,
+		size_t iend,
+		size_t cend,
+		float xtimescale,
+		float yscale,
+		float yoff
+		);
 
 	void SparsePackedInnerLoop(
 		AnalogWaveform* waveform,
 		std::vector<int64_t>& clock_edges,
 		int64_t* data,
-		size_t wend,
+		size_t istart,
+		size_t iend,
+		size_t iclock,
 		size_t cend,
 		int32_t xmax,
 		int32_t ymax,
@@ -188,7 +208,9 @@ protected:
 		AnalogWaveform* waveform,
 		std::vector<int64_t>& clock_edges,
 		int64_t* data,
-		size_t wend,
+		size_t istart,
+		size_t iend,
+		size_t iclock,
 		size_t cend,
 		int32_t xmax,
 		int32_t ymax,
@@ -201,7 +223,9 @@ protected:
 		AnalogWaveform* waveform,
 		std::vector<int64_t>& clock_edges,
 		int64_t* data,
-		size_t wend,
+		size_t istart,
+		size_t iend,
+		size_t iclock,
 		size_t cend,
 		int32_t xmax,
 		int32_t ymax,
@@ -217,6 +241,9 @@ protected:
 	float m_xscale;
 	ClockAlignment m_lastClockAlign;
 
+	///@brief Scratch accumulators for all but the first block when integrating in parallel
+	std::vector<int64_t, AlignedAllocator<int64_t, 64> > m_blockAccum;
+
 	std::string m_saturationName;
 	std::string m_centerName;
 	std::string m_maskName;
@@ -226,6 +253,18 @@ protected:
 	std::string m_clockAlignName;
 
 	EyeMask m_mask;
+
+	///@brief Rasterized mask used by DoMaskTest(), one byte per eye pixel (0xff if inside the mask, 0 if not)
+	std::vector<uint8_t, AlignedAllocator<uint8_t, 64> > m_maskBitmap;
+
+	//Configuration m_maskBitmap was rendered for, so we only re-render when something changes
+	std::string m_maskBitmapFile;
+	size_t m_maskBitmapWidth;
+	size_t m_maskBitmapHeight;
+	int64_t m_maskBitmapXOff;
+	float m_maskBitmapXScale;
+	float m_maskBitmapYScale;
+	float m_maskBitmapUIWidth;
 };
 
 #endif
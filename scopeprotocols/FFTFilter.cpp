@@ -31,6 +31,7 @@
 #include "../scopehal/AlignedAllocator.h"
 #include "FFTFilter.h"
 #include <immintrin.h>
+#include <omp.h>
 #include "../scopehal/avx_mathfun.h"
 
 using namespace std;
@@ -41,6 +42,9 @@ using namespace std;
 FFTFilter::FFTFilter(const string& color)
 	: PeakDetectionFilter(OscilloscopeChannel::CHANNEL_TYPE_ANALOG, color, CAT_RF)
 	, m_windowName("Window")
+	, m_modeName("Mode")
+	, m_segmentLengthName("Segment Length")
+	, m_overlapName("Segment Overlap")
 {
 	m_xAxisUnit = Unit(Unit::UNIT_HZ);
 	m_yAxisUnit = Unit(Unit::UNIT_DBM);
@@ -50,7 +54,6 @@ FFTFilter::FFTFilter(const string& color)
 
 	m_cachedNumPoints = 0;
 	m_cachedNumPointsFFT = 0;
-	m_plan = NULL;
 
 	//Default config
 	m_range = 70;
@@ -63,6 +66,17 @@ FFTFilter::FFTFilter(const string& color)
 	m_parameters[m_windowName].AddEnumValue("Rectangular", WINDOW_RECTANGULAR);
 	m_parameters[m_windowName].SetIntVal(WINDOW_HAMMING);
 
+	m_parameters[m_modeName] = FilterParameter(FilterParameter::TYPE_ENUM, Unit(Unit::UNIT_COUNTS));
+	m_parameters[m_modeName].AddEnumValue("Single FFT", MODE_SINGLE);
+	m_parameters[m_modeName].AddEnumValue("Welch averaged", MODE_WELCH);
+	m_parameters[m_modeName].SetIntVal(MODE_SINGLE);
+
+	m_parameters[m_segmentLengthName] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_SAMPLEDEPTH));
+	m_parameters[m_segmentLengthName].SetIntVal(65536);
+
+	m_parameters[m_overlapName] = FilterParameter(FilterParameter::TYPE_FLOAT, Unit(Unit::UNIT_PERCENT));
+	m_parameters[m_overlapName].SetFloatVal(0.5);
+
 	#ifdef HAVE_CLFFT
 
 		m_clfftPlan = 0;
@@ -150,9 +164,6 @@ FFTFilter::FFTFilter(const string& color)
 
 FFTFilter::~FFTFilter()
 {
-	if(m_plan)
-		ffts_free(m_plan);
-
 	#ifdef HAVE_CLFFT
 		if(m_clfftPlan != 0)
 			clfftDestroyPlan(&m_clfftPlan);
@@ -245,19 +256,10 @@ void FFTFilter::ReallocateBuffers(size_t npoints_raw, size_t npoints, size_t nou
 	{
 		m_cachedNumPointsFFT = npoints;
 
-		if(m_plan)
-		{
-			ffts_free(m_plan);
-
-			#ifdef HAVE_CLFFT
-				if(m_clfftPlan != 0)
-					clfftDestroyPlan(&m_clfftPlan);
-			#endif
-		}
-
-		m_plan = ffts_init_1d_real(npoints, FFTS_FORWARD);
-
+		//CPU side plans come from FFTPlanCache at execution time, so only the clFFT plan is ours to manage
 		#ifdef HAVE_CLFFT
+			if(m_clfftPlan != 0)
+				clfftDestroyPlan(&m_clfftPlan);
 
 			if(g_clContext)
 			{
@@ -285,7 +287,6 @@ void FFTFilter::ReallocateBuffers(size_t npoints_raw, size_t npoints, size_t nou
 		#endif
 	}
 
-	m_rdinbuf.resize(npoints);
 	m_rdoutbuf.resize(2*nouts);
 }
 
@@ -299,8 +300,18 @@ void FFTFilter::Refresh()
 	}
 	auto din = GetAnalogInputWaveform(0);
 
-	//Round size up to next power of two
+	double fs = din->m_timescale * (din->m_offsets[1] - din->m_offsets[0]);
+
+	//Averaged spectrum of shorter segments, if requested
 	const size_t npoints_raw = din->m_samples.size();
+	size_t seglen = GetWelchSegmentLength(npoints_raw);
+	if(seglen)
+	{
+		DoRefreshWelch(din, din->m_samples, fs, seglen, true);
+		return;
+	}
+
+	//Round size up to next power of two
 	const size_t npoints = next_pow2(npoints_raw);
 	LogTrace("FFTFilter: processing %zu raw points\n", npoints_raw);
 	LogTrace("Rounded to %zu\n", npoints);
@@ -311,7 +322,6 @@ void FFTFilter::Refresh()
 		ReallocateBuffers(npoints_raw, npoints, nouts);
 	LogTrace("Output: %zu\n", nouts);
 
-	double fs = din->m_timescale * (din->m_offsets[1] - din->m_offsets[0]);
 	DoRefresh(din, din->m_samples, fs, npoints, nouts, true);
 }
 
@@ -330,30 +340,7 @@ void FFTFilter::DoRefresh(
 	auto window = static_cast<WindowFunction>(m_parameters[m_windowName].GetIntVal());
 	LogTrace("bin_hz: %f\n", bin_hz);
 
-	//Set up output and copy time scales / configuration
-	AnalogWaveform* cap = dynamic_cast<AnalogWaveform*>(GetData(0));
-	if(cap == NULL)
-	{
-		cap = new AnalogWaveform;
-		SetData(cap, 0);
-	}
-	cap->m_startTimestamp = din->m_startTimestamp;
-	cap->m_startFemtoseconds = din->m_startFemtoseconds;
-	cap->m_triggerPhase = 0;
-	cap->m_timescale = bin_hz;
-	cap->m_densePacked = true;
-
-	//Update output timestamps if capture depth grew
-	size_t oldlen = cap->m_offsets.size();
-	cap->Resize(nouts);
-	if(nouts > oldlen)
-	{
-		for(size_t i = oldlen; i < nouts; i++)
-		{
-			cap->m_offsets[i] = i;
-			cap->m_durations[i] = 1;
-		}
-	}
+	auto cap = SetupSpectrumWaveform(din, bin_hz, nouts);
 
 	#ifdef HAVE_CLFFT
 		if(g_clContext && m_windowProgram && m_normalizeProgram)
@@ -436,15 +423,18 @@ void FFTFilter::DoRefresh(
 	#endif
 
 		//Copy the input with windowing, then zero pad to the desired input length
+		auto inbuf = FFTPlanCache::GetScratchBuffer(npoints);
+		float* pin = &(*inbuf)[0];
 		ApplyWindow(
 			(float*)&data[0],
 			m_cachedNumPoints,
-			&m_rdinbuf[0],
+			pin,
 			window);
-		memset(&m_rdinbuf[m_cachedNumPoints], 0, (npoints - m_cachedNumPoints) * sizeof(float));
+		memset(pin + m_cachedNumPoints, 0, (npoints - m_cachedNumPoints) * sizeof(float));
 
 		//Calculate the FFT
-		ffts_execute(m_plan, &m_rdinbuf[0], &m_rdoutbuf[0]);
+		auto plan = FFTPlanCache::GetRealPlan(npoints, FFTS_FORWARD);
+		ffts_execute(plan.get(), pin, &m_rdoutbuf[0]);
 
 		//Normalize magnitudes
 		if(log_output)
@@ -470,6 +460,153 @@ void FFTFilter::DoRefresh(
 	FindPeaks(cap);
 }
 
+/**
+	@brief Sets up the output waveform and copies time scales / configuration
+ */
+AnalogWaveform* FFTFilter::SetupSpectrumWaveform(AnalogWaveform* din, double bin_hz, size_t nouts)
+{
+	AnalogWaveform* cap = dynamic_cast<AnalogWaveform*>(GetData(0));
+	if(cap == NULL)
+	{
+		cap = new AnalogWaveform;
+		SetData(cap, 0);
+	}
+	cap->m_startTimestamp = din->m_startTimestamp;
+	cap->m_startFemtoseconds = din->m_startFemtoseconds;
+	cap->m_triggerPhase = 0;
+	cap->m_timescale = bin_hz;
+	cap->m_densePacked = true;
+
+	//Update output timestamps if capture depth grew
+	size_t oldlen = cap->m_offsets.size();
+	cap->Resize(nouts);
+	if(nouts > oldlen)
+	{
+		for(size_t i = oldlen; i < nouts; i++)
+		{
+			cap->m_offsets[i] = i;
+			cap->m_durations[i] = 1;
+		}
+	}
+
+	return cap;
+}
+
+/**
+	@brief Gets the segment length for Welch averaging of a record, or zero to transform the whole record at once
+
+	Segments are rounded up to a power of two. Records no longer than one segment are always done as a single FFT.
+ */
+size_t FFTFilter::GetWelchSegmentLength(size_t npoints_raw)
+{
+	if(m_parameters[m_modeName].GetIntVal() != MODE_WELCH)
+		return 0;
+
+	size_t seglen = next_pow2(max((int64_t)16, m_parameters[m_segmentLengthName].GetIntVal()));
+	if(npoints_raw <= seglen)
+		return 0;
+	return seglen;
+}
+
+/**
+	@brief Calculates an averaged spectrum by Welch's method
+
+	The record is split into overlapping segments of seglen points, each of which is windowed and transformed
+	separately. The power spectra of all segments are averaged, which gives a much lower variance estimate than one huge
+	FFT, at the cost of frequency resolution. Segments are divided among threads, each with its own plan.
+
+	Always runs on the CPU.
+ */
+void FFTFilter::DoRefreshWelch(
+	AnalogWaveform* din,
+	vector<EmptyConstructorWrapper<float>, AlignedAllocator<EmptyConstructorWrapper<float>, 64>>& data,
+	double fs_per_sample,
+	size_t seglen,
+	bool log_output)
+{
+	size_t len = data.size();
+	size_t nouts = seglen/2 + 1;
+
+	//Segment starts have to be multiples of 8 samples to keep the AVX window functions aligned
+	float overlap = m_parameters[m_overlapName].GetFloatVal();
+	overlap = max(0.0f, min(overlap, 0.99f));
+	size_t hop = static_cast<size_t>(seglen * (1 - overlap)) & ~(size_t)7;
+	hop = max(hop, (size_t)8);
+	size_t nsegs = (len - seglen) / hop + 1;
+	LogTrace("FFTFilter: Welch averaging %zu segments of %zu points\n", nsegs, seglen);
+
+	//Look up some parameters
+	float scale = 2.0 / seglen;
+	double sample_ghz = 1e6 / fs_per_sample;
+	double bin_hz = round((0.5f * sample_ghz * 1e9f) / nouts);
+	auto window = static_cast<WindowFunction>(m_parameters[m_windowName].GetIntVal());
+
+	auto cap = SetupSpectrumWaveform(din, bin_hz, nouts);
+
+	//Each thread sums the power spectra of its segments
+	size_t nthreads = min((size_t)omp_get_max_threads(), nsegs);
+	auto sums = FFTPlanCache::GetScratchBuffer(nthreads * nouts);
+	float* psums = &(*sums)[0];
+	memset(psums, 0, nthreads * nouts * sizeof(float));
+	const float* samples = (const float*)&data[0];
+
+	#pragma omp parallel for
+	for(size_t t=0; t<nthreads; t++)
+	{
+		//Plans have internal scratch space, so each thread borrows its own
+		auto plan = FFTPlanCache::GetRealPlan(seglen, FFTS_FORWARD);
+		auto scratch = FFTPlanCache::GetScratchBuffer(seglen + 2*nouts);
+		float* pin = &(*scratch)[0];
+		float* spectrum = pin + seglen;
+		float* tsum = psums + t*nouts;
+
+		for(size_t seg=t; seg<nsegs; seg += nthreads)
+		{
+			ApplyWindow(samples + seg*hop, seglen, pin, window);
+			ffts_execute(plan.get(), pin, spectrum);
+
+			for(size_t i=0; i<nouts; i++)
+			{
+				float real = spectrum[i*2];
+				float imag = spectrum[i*2 + 1];
+				tsum[i] += real*real + imag*imag;
+			}
+		}
+	}
+
+	//Merge the per-thread sums and convert mean power back to a (real) amplitude, so the usual normalization applies.
+	//Our single-FFT buffers are no longer the right size, so make sure they get reallocated if we switch back.
+	m_cachedNumPoints = 0;
+	m_rdoutbuf.resize(2*nouts);
+	float invsegs = 1.0f / nsegs;
+	for(size_t i=0; i<nouts; i++)
+	{
+		float total = 0;
+		for(size_t t=0; t<nthreads; t++)
+			total += psums[t*nouts + i];
+		m_rdoutbuf[i*2] = sqrtf(total * invsegs);
+		m_rdoutbuf[i*2 + 1] = 0;
+	}
+
+	if(log_output)
+	{
+		if(g_hasAvx2)
+			NormalizeOutputLogAVX2(cap, nouts, scale);
+		else
+			NormalizeOutputLog(cap, nouts, scale);
+	}
+	else
+	{
+		if(g_hasAvx2)
+			NormalizeOutputLinearAVX2(cap, nouts, scale);
+		else
+			NormalizeOutputLinear(cap, nouts, scale);
+	}
+
+	//Peak search
+	FindPeaks(cap);
+}
+
 bool FFTFilter::UsesCLFFT()
 {
 	#ifdef HAVE_CLFFT
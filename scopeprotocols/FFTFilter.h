@@ -72,6 +72,12 @@ public:
 		WINDOW_BLACKMAN_HARRIS
 	};
 
+	enum SpectrumMode
+	{
+		MODE_SINGLE,
+		MODE_WELCH
+	};
+
 	//Window function helpers
 	static void ApplyWindow(const float* data, size_t len, float* out, WindowFunction func);
 	static void HannWindow(const float* data, size_t len, float* out);
@@ -91,21 +97,31 @@ protected:
 
 	void ReallocateBuffers(size_t npoints_raw, size_t npoints, size_t nouts);
 
+	AnalogWaveform* SetupSpectrumWaveform(AnalogWaveform* din, double bin_hz, size_t nouts);
+
 	void DoRefresh(
 		AnalogWaveform* din,
 		std::vector<EmptyConstructorWrapper<float>, AlignedAllocator<EmptyConstructorWrapper<float>, 64>>& data,
 		double fs_per_sample, size_t npoints, size_t nouts, bool log_output);
 
+	size_t GetWelchSegmentLength(size_t npoints_raw);
+
+	void DoRefreshWelch(
+		AnalogWaveform* din,
+		std::vector<EmptyConstructorWrapper<float>, AlignedAllocator<EmptyConstructorWrapper<float>, 64>>& data,
+		double fs_per_sample, size_t seglen, bool log_output);
+
 	size_t m_cachedNumPoints;
 	size_t m_cachedNumPointsFFT;
-	std::vector<float, AlignedAllocator<float, 64> > m_rdinbuf;
 	std::vector<float, AlignedAllocator<float, 64> > m_rdoutbuf;
-	ffts_plan_t* m_plan;
 
 	float m_range;
 	float m_offset;
 
 	std::string m_windowName;
+	std::string m_modeName;
+	std::string m_segmentLengthName;
+	std::string m_overlapName;
 
 	#ifdef HAVE_CLFFT
 	cl::CommandQueue* m_queue;
@@ -30,9 +30,13 @@
 #include "scopeprotocols.h"
 #include "FIRFilter.h"
 #include <immintrin.h>
+#include <omp.h>
 
 using namespace std;
 
+size_t FIRFilter::m_fftCrossover = 0;
+mutex FIRFilter::m_fftCrossoverMutex;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -56,6 +60,13 @@ FIRFilter::FIRFilter(const string& color)
 	m_min = FLT_MAX;
 	m_max = -FLT_MAX;
 
+	m_cachedType = FILTER_TYPE_LOWPASS;
+	m_cachedFreqLow = 0;
+	m_cachedFreqHigh = 0;
+	m_cachedAtten = 0;
+	m_cachedSampleRate = 0;
+	m_kernelSpectrumSize = 0;
+
 	m_parameters[m_filterTypeName] = FilterParameter(FilterParameter::TYPE_ENUM, Unit(Unit::UNIT_COUNTS));
 	m_parameters[m_filterTypeName].AddEnumValue("Low pass", FILTER_TYPE_LOWPASS);
 	m_parameters[m_filterTypeName].AddEnumValue("High pass", FILTER_TYPE_HIGHPASS);
@@ -212,16 +223,30 @@ void FIRFilter::Refresh()
 		filterlen = (atten / 22) * (sample_hz / (fhi - flo) );
 	filterlen |= 1;	//force length to be odd
 
-	//Create the filter coefficients (TODO: cache this)
-	vector<float> coeffs;
-	coeffs.resize(filterlen);
-	CalculateFilterCoefficients(
-		coeffs,
-		flo / nyquist,
-		fhi / nyquist,
-		atten,
-		type
-		);
+	//Create the filter coefficients, unless the design hasn't changed since last time
+	if( (m_coefficients.size() != filterlen) ||
+		(m_cachedType != type) ||
+		(m_cachedFreqLow != flo) ||
+		(m_cachedFreqHigh != fhi) ||
+		(m_cachedAtten != atten) ||
+		(m_cachedSampleRate != sample_hz) )
+	{
+		m_coefficients.resize(filterlen);
+		CalculateFilterCoefficients(
+			m_coefficients,
+			flo / nyquist,
+			fhi / nyquist,
+			atten,
+			type
+			);
+
+		m_cachedType = type;
+		m_cachedFreqLow = flo;
+		m_cachedFreqHigh = fhi;
+		m_cachedAtten = atten;
+		m_cachedSampleRate = sample_hz;
+		m_kernelSpectrumSize = 0;
+	}
 
 	//Set up output
 	m_xAxisUnit = m_inputs[0].m_channel->GetXAxisUnits();
@@ -230,9 +255,9 @@ void FIRFilter::Refresh()
 	auto cap = SetupOutputWaveform(din, 0, 0, filterlen);
 
 	//Run the actual filter
-	float vmin;
-	float vmax;
-	DoFilterKernel(coeffs, din, cap, vmin, vmax);
+	float vmin = FLT_MAX;
+	float vmax = -FLT_MAX;
+	DoFilterKernel(m_coefficients, din, cap, vmin, vmax);
 
 	//Shift output to compensate for filter group delay
 	cap->m_triggerPhase = (radius * fs_per_sample) + din->m_triggerPhase;
@@ -253,10 +278,39 @@ void FIRFilter::DoFilterKernel(
 {
 	#ifdef HAVE_OPENCL
 	if(g_clContext && m_kernel)
+	{
 		DoFilterKernelOpenCL(coefficients, din, cap, vmin, vmax);
-	else
+		return;
+	}
 	#endif
 
+	//Long filters are cheaper to do by FFT convolution
+	size_t filterlen = coefficients.size();
+	size_t len = din->m_samples.size();
+	if( (len > filterlen) && (filterlen > GetFFTCrossover()) )
+	{
+		size_t nfft = GetFFTSize(filterlen, len);
+		if( (m_kernelSpectrumSize != nfft) || (&coefficients != &m_coefficients) )
+		{
+			CalculateKernelSpectrum(coefficients, nfft, m_kernelSpectrum);
+			m_kernelSpectrumSize = (&coefficients == &m_coefficients) ? nfft : 0;
+		}
+		DoFilterKernelFFT(m_kernelSpectrum, nfft, filterlen, din, cap, vmin, vmax);
+	}
+	else
+		DoFilterKernelDirect(coefficients, din, cap, vmin, vmax);
+}
+
+/**
+	@brief Runs the fastest direct-form kernel the CPU supports
+ */
+void FIRFilter::DoFilterKernelDirect(
+	vector<float>& coefficients,
+	AnalogWaveform* din,
+	AnalogWaveform* cap,
+	float& vmin,
+	float& vmax)
+{
 	if(g_hasAvx512F)
 		DoFilterKernelAVX512F(coefficients, din, cap, vmin, vmax);
 	else if(g_hasAvx2)
@@ -494,7 +548,7 @@ void FIRFilter::DoFilterKernelAVX2(
 	}
 
 	//Catch any stragglers
-	for(; i<end_rounded; i++)
+	for(; i<end; i++)
 	{
 		float v = 0;
 		for(size_t j=0; j<filterlen; j++)
@@ -598,7 +652,7 @@ void FIRFilter::DoFilterKernelAVX512F(
 	}
 
 	//Catch any stragglers
-	for(; i<end_rounded; i++)
+	for(; i<end; i++)
 	{
 		float v = 0;
 		for(size_t j=0; j<filterlen; j++)
@@ -611,6 +665,218 @@ void FIRFilter::DoFilterKernelAVX512F(
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FFT convolution
+
+/**
+	@brief Picks the FFT size for overlap-add convolution
+
+	Each block yields nfft - filterlen + 1 new samples for an FFT and an inverse FFT, so the FFT should be a few times
+	the filter length to amortize the overlap. There's no point going beyond what's needed to do the whole record at once.
+ */
+size_t FIRFilter::GetFFTSize(size_t filterlen, size_t len)
+{
+	size_t nfft = max(next_pow2(4 * filterlen), (size_t)1024);
+	return min(nfft, next_pow2(len + filterlen - 1));
+}
+
+/**
+	@brief Calculates the frequency response used by DoFilterKernelFFT()
+
+	The kernels compute out[i] = sum(in[i+j] * coeff[j]), a correlation, so we transform the time reversed coefficients to
+	get a convolution. The 1/N scaling of the inverse FFT is folded in here too.
+ */
+void FIRFilter::CalculateKernelSpectrum(
+	const vector<float>& coefficients,
+	size_t nfft,
+	vector<float, AlignedAllocator<float, 64> >& spectrum)
+{
+	size_t filterlen = coefficients.size();
+	auto buf = FFTPlanCache::GetScratchBuffer(nfft);
+	float* pin = &(*buf)[0];
+	float scale = 1.0f / nfft;
+	for(size_t i=0; i<filterlen; i++)
+		pin[i] = coefficients[filterlen - 1 - i] * scale;
+	memset(pin + filterlen, 0, (nfft - filterlen) * sizeof(float));
+
+	spectrum.resize(2 * (nfft/2 + 1));
+	auto plan = FFTPlanCache::GetRealPlan(nfft, FFTS_FORWARD);
+	ffts_execute(plan.get(), pin, &spectrum[0]);
+}
+
+/**
+	@brief FIR filter by overlap-add FFT convolution
+
+	The input is cut into blocks of nfft - filterlen + 1 samples. Each block is zero padded, multiplied by the kernel
+	spectrum in the frequency domain and transformed back, giving a block-sized chunk of the full convolution plus a
+	filterlen - 1 sample tail which overlaps the next block.
+
+	Each thread handles a contiguous run of blocks, adding tails into the output as it goes. The tail of a thread's last
+	block lands in the next thread's range, so it's set aside and added once all threads are done.
+
+	@param spectrum		Output of CalculateKernelSpectrum()
+	@param nfft			FFT size
+	@param filterlen	Number of taps
+ */
+void FIRFilter::DoFilterKernelFFT(
+	const vector<float, AlignedAllocator<float, 64> >& spectrum,
+	size_t nfft,
+	size_t filterlen,
+	AnalogWaveform* din,
+	AnalogWaveform* cap,
+	float& vmin,
+	float& vmax)
+{
+	size_t len = din->m_samples.size();
+	size_t end = len - filterlen;
+	size_t nouts = nfft/2 + 1;
+	size_t blocklen = nfft - filterlen + 1;
+	size_t taillen = filterlen - 1;
+	size_t nblocks = (len + blocklen - 1) / blocklen;
+	size_t nthreads = min((size_t)omp_get_max_threads(), nblocks);
+	size_t blocksPerThread = (nblocks + nthreads - 1) / nthreads;
+	nthreads = (nblocks + blocksPerThread - 1) / blocksPerThread;
+
+	const float* pin = (const float*)&din->m_samples[0];
+	float* pout = (float*)&cap->m_samples[0];
+	const float* pkernel = &spectrum[0];
+
+	//Full convolution index n corresponds to output sample n - (filterlen-1)
+	auto tails = FFTPlanCache::GetScratchBuffer(nthreads * taillen);
+	float* ptails = &(*tails)[0];
+
+	#pragma omp parallel for
+	for(size_t t=0; t<nthreads; t++)
+	{
+		auto forwardPlan = FFTPlanCache::GetRealPlan(nfft, FFTS_FORWARD);
+		auto reversePlan = FFTPlanCache::GetRealPlan(nfft, FFTS_BACKWARD);
+		auto scratch = FFTPlanCache::GetScratchBuffer(nfft + 2*nouts);
+		float* ptime = &(*scratch)[0];
+		float* pspec = ptime + nfft;
+		float* ptail = ptails + t*taillen;
+		memset(ptail, 0, taillen * sizeof(float));
+
+		size_t firstblock = t * blocksPerThread;
+		size_t lastblock = min(firstblock + blocksPerThread, nblocks);
+		int64_t regionEnd = lastblock * blocklen;
+
+		//Clear the part of the output this thread owns
+		int64_t ostart = max((int64_t)(firstblock * blocklen) - (int64_t)taillen, (int64_t)0);
+		int64_t oend = min(regionEnd - (int64_t)taillen, (int64_t)end);
+		if(oend > ostart)
+			memset(pout + ostart, 0, (oend - ostart) * sizeof(float));
+
+		for(size_t b=firstblock; b<lastblock; b++)
+		{
+			//Zero padded input block
+			size_t istart = b * blocklen;
+			size_t count = min(blocklen, len - istart);
+			memcpy(ptime, pin + istart, count * sizeof(float));
+			memset(ptime + count, 0, (nfft - count) * sizeof(float));
+
+			//Filter it
+			ffts_execute(forwardPlan.get(), ptime, pspec);
+			for(size_t i=0; i<nouts; i++)
+			{
+				float ar = pspec[i*2];
+				float ai = pspec[i*2 + 1];
+				float br = pkernel[i*2];
+				float bi = pkernel[i*2 + 1];
+
+				pspec[i*2]		= ar*br - ai*bi;
+				pspec[i*2 + 1]	= ar*bi + ai*br;
+			}
+			ffts_execute(reversePlan.get(), pspec, ptime);
+
+			//Add to the output, or to our tail if it's past the end of our range
+			size_t nvalid = count + taillen;
+			for(size_t k=0; k<nvalid; k++)
+			{
+				int64_t n = istart + k;
+				if(n >= regionEnd)
+					ptail[n - regionEnd] += ptime[k];
+				else
+				{
+					int64_t i = n - (int64_t)taillen;
+					if( (i >= 0) && (i < (int64_t)end) )
+						pout[i] += ptime[k];
+				}
+			}
+		}
+	}
+
+	//Add each thread's tail to the start of the next thread's range
+	for(size_t t=0; t+1<nthreads; t++)
+	{
+		int64_t base = (t+1) * blocksPerThread * blocklen - taillen;
+		for(size_t k=0; k<taillen; k++)
+		{
+			int64_t i = base + k;
+			if( (i >= 0) && (i < (int64_t)end) )
+				pout[i] += ptails[t*taillen + k];
+		}
+	}
+
+	for(size_t i=0; i<end; i++)
+	{
+		vmin = min(vmin, pout[i]);
+		vmax = max(vmax, pout[i]);
+	}
+}
+
+/**
+	@brief Gets the filter length above which FFT convolution is used
+
+	The crossover depends heavily on which SIMD kernels the CPU has and on core count, so rather than guessing, the
+	first call times both methods on a synthetic waveform at increasing tap counts.
+ */
+size_t FIRFilter::GetFFTCrossover()
+{
+	lock_guard<mutex> lock(m_fftCrossoverMutex);
+	if(m_fftCrossover != 0)
+		return m_fftCrossover;
+
+	const size_t len = 262144;
+	AnalogWaveform din;
+	AnalogWaveform cap;
+	din.Resize(len);
+	cap.Resize(len);
+	for(size_t i=0; i<len; i++)
+		din.m_samples[i] = sinf(i * 0.01f) + ((i * 7919) % 13) / 13.0f;
+
+	vector<float, AlignedAllocator<float, 64> > spectrum;
+	const size_t maxTaps = 4095;
+	m_fftCrossover = maxTaps;
+	for(size_t filterlen = 15; filterlen <= maxTaps; filterlen = filterlen*2 + 1)
+	{
+		vector<float> coeffs(filterlen, 1.0f / filterlen);
+		float vmin = FLT_MAX;
+		float vmax = -FLT_MAX;
+
+		double start = GetTime();
+		DoFilterKernelDirect(coeffs, &din, &cap, vmin, vmax);
+		double tdirect = GetTime() - start;
+
+		start = GetTime();
+		size_t nfft = GetFFTSize(filterlen, len);
+		CalculateKernelSpectrum(coeffs, nfft, spectrum);
+		DoFilterKernelFFT(spectrum, nfft, filterlen, &din, &cap, vmin, vmax);
+		double tfft = GetTime() - start;
+
+		if(tfft < tdirect)
+		{
+			m_fftCrossover = filterlen / 2;
+			break;
+		}
+	}
+
+	LogTrace("FIRFilter: using FFT convolution above %zu taps\n", m_fftCrossover);
+	return m_fftCrossover;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Filter design
+
 /**
 	@brief Calculates FIR coefficients
 
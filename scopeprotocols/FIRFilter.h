@@ -116,6 +116,49 @@ protected:
 		float& vmin,
 		float& vmax);
 
+	void DoFilterKernelDirect(
+		std::vector<float>& coefficients,
+		AnalogWaveform* din,
+		AnalogWaveform* cap,
+		float& vmin,
+		float& vmax);
+
+	static size_t GetFFTSize(size_t filterlen, size_t len);
+
+	static void CalculateKernelSpectrum(
+		const std::vector<float>& coefficients,
+		size_t nfft,
+		std::vector<float, AlignedAllocator<float, 64> >& spectrum);
+
+	static void DoFilterKernelFFT(
+		const std::vector<float, AlignedAllocator<float, 64> >& spectrum,
+		size_t nfft,
+		size_t filterlen,
+		AnalogWaveform* din,
+		AnalogWaveform* cap,
+		float& vmin,
+		float& vmax);
+
+	size_t GetFFTCrossover();
+
+	///@brief Tap count above which FFT convolution beats the direct kernels on this machine (0 if not yet measured)
+	static size_t m_fftCrossover;
+	static std::mutex m_fftCrossoverMutex;
+
+	//Cached filter design, and the parameters it was designed for
+	std::vector<float> m_coefficients;
+	FilterType m_cachedType;
+	float m_cachedFreqLow;
+	float m_cachedFreqHigh;
+	float m_cachedAtten;
+	float m_cachedSampleRate;
+
+	///@brief FFT of the time reversed coefficients, for fast convolution
+	std::vector<float, AlignedAllocator<float, 64> > m_kernelSpectrum;
+
+	///@brief FFT size m_kernelSpectrum was calculated for (0 if invalid)
+	size_t m_kernelSpectrumSize;
+
 	float m_min;
 	float m_max;
 	float m_range;
@@ -198,6 +198,7 @@ void HistogramFilter::Refresh()
 	//Generate output
 	for(size_t i=0; i<bins; i++)
 		cap->m_samples[i] 	= m_histogram[i];
+	cap->MarkModified();
 
 	vmax *= 1.05;
 	m_range = vmax + 2;
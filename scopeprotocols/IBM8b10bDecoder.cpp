@@ -119,212 +119,48 @@ void IBM8b10bDecoder::Refresh()
 
 	//Record the value of the data stream at each clock edge
 	//TODO: allow single rate clocks too?
-	DigitalWaveform data;
-	SampleOnAnyEdges(din, clkin, data);
-
-	//Look for commas in the data stream
-	//TODO: make this more efficient?
-	size_t max_commas = 0;
-	size_t max_offset = 0;
-	for(size_t offset=0; offset < 10; offset ++)
+	auto data = SampleBitstream(din, clkin);
+	size_t len = data->size();
+	if(len < 21)
 	{
-		size_t num_commas = 0;
-		size_t dlen = data.m_samples.size() - 20;
-		for(size_t i=0; i<dlen; i += 10)
-		{
-			/*
-			//Check if we have a comma (five identical bits) anywhere in the data stream
-			//Commas are always at positions 2...6 within the symbol (left-right bit ordering)
-			bool comma = true;
-			for(int j=3; j<=6; j++)
-			{
-				if(data.m_samples[i+offset+j] != data.m_samples[i+offset+2])
-				{
-					comma = false;
-					break;
-				}
-			}
-			*/
-
-			//Look for K28.5 symbols only.
-			bool comma = false;
-			if(	!data.m_samples[i+offset+0] &&
-				!data.m_samples[i+offset+1] &&
-				data.m_samples[i+offset+2] &&
-				data.m_samples[i+offset+3] &&
-				data.m_samples[i+offset+4] &&
-				data.m_samples[i+offset+5] &&
-				data.m_samples[i+offset+6] &&
-				!data.m_samples[i+offset+7] &&
-				data.m_samples[i+offset+8] &&
-				!data.m_samples[i+offset+9])
-			{
-				comma = true;
-			}
-			if(	data.m_samples[i+offset+0] &&
-				data.m_samples[i+offset+1] &&
-				!data.m_samples[i+offset+2] &&
-				!data.m_samples[i+offset+3] &&
-				!data.m_samples[i+offset+4] &&
-				!data.m_samples[i+offset+5] &&
-				!data.m_samples[i+offset+6] &&
-				data.m_samples[i+offset+7] &&
-				!data.m_samples[i+offset+8] &&
-				data.m_samples[i+offset+9])
-			{
-				comma = true;
-			}
-
-			if(comma)
-				num_commas ++;
-		}
-		if(num_commas > max_commas)
-		{
-			max_commas = num_commas;
-			max_offset = offset;
-		}
-		//LogTrace("Found %zu commas at offset %zu\n", num_commas, offset);
+		SetData(cap, 0);
+		return;
 	}
 
-	//Decode the actual data
-	bool first = true;
-	int last_disp = -1;
-	size_t dlen = data.m_samples.size() - 11;
-	for(size_t i=max_offset; i<dlen; i+= 10)
-	{
-		//5b/6b decode
-
-		uint8_t code6 =
-			(data.m_samples[i+0] ? 32 : 0) |
-			(data.m_samples[i+1] ? 16 : 0) |
-			(data.m_samples[i+2] ? 8 : 0) |
-			(data.m_samples[i+3] ? 4 : 0) |
-			(data.m_samples[i+4] ? 2 : 0) |
-			(data.m_samples[i+5] ? 1 : 0);
-
-		static const int code5_table[64] =
-		{
-			 0,  0,  0,  0,  0, 23,  8,  7,	//00-07
-			 0, 27,  4, 20, 24, 12, 28, 28, //08-0f
-			 0, 29,  2, 18, 31, 10, 26, 15, //10-17
-			 0,  6, 22, 16, 14,  1, 30,  0,	//18-1f
-			 0, 30, 1,  17, 16,  9, 25,  0,	//20-27
-			15,  5, 21, 31, 13,  2, 29,  0,	//28-2f
-			28,  3, 19, 24, 11,  4, 27,  0,	//30-37
-			 7,  8, 23,  0,  0,  0,  0,  0  //38-3f
-		};
+	//Look for K28.5 commas in the data stream to find the symbol alignment
+	size_t max_offset = FindSymbolAlignment(data.get(), GetCommaTable());
 
-		static const int disp5_table[64] =
-		{
-			 0,  0,  0, 0,  0, -2, -2, 0,	//00-07
-			 0, -2, -2, 0, -2,  0,  0, 2,	//08-0f
-			 0, -2, -2, 0, -2,  0,  0, 2,	//10-17
-			-2,  0,  0, 2,  0,  2,  2, 0,	//18-1f
-			 0, -2, -2, 0, -2,  0,  0, 2,	//20-27
-			-2,  0,  0, 2,  0,  2,  2, 0,	//28-2f
-			-2,  0,  0, 2,  0,  2,  2, 0,	//30-37
-			 0,  2,  2, 0,  0,  0,  0, 0 	//38-3f
-		};
+	//Decode the actual data. Each code group is independent, so do this in parallel with table lookups.
+	size_t dlen = len - 11;
+	size_t nsymbols = 0;
+	if(dlen > max_offset)
+		nsymbols = (dlen - max_offset + 9) / 10;
+	cap->Resize(nsymbols);
+	auto table = GetDecodeTable();
 
-		static const bool err5_table[64] =
-		{
-			 true,  true,  true,  true,  true, false, false, false,	//00-07
-			 true, false, false, false, false, false, false, false, //08-0f
-			 true, false, false, false, false, false, false, false, //10-17
-			false, false, false, false, false, false, false,  true,	//18-1f
-			 true, false, false, false, false, false, false, false,	//20-27
-			false, false, false, false, false, false, false,  true,	//28-2f
-			false, false, false, false, false, false, false,  true,	//30-37
-			false, false, false,  true,  true,  true,  true,  true  //38-3f
-		};
-
-		static const bool ctl5_table[64] =
-		{
-			false, false, false, false, false, false, false, false,	//00-07
-			false, false, false, false, false, false, false, true,  //08-0f
-			false, false, false, false, false, false, false, false, //10-17
-			false, false, false, false, false, false, false, false,	//18-1f
-			false, false, false, false, false, false, false, false,	//20-27
-			false, false, false, false, false, false, false, false,	//28-2f
-			true,  false, false, false, false, false, false, false,	//30-37
-			false, false, false, false, false, false, false, false  //38-3f
-		};
-
-		int code5 = code5_table[code6];
-		int disp5 = disp5_table[code6];
-		bool err5 = err5_table[code6];
-		bool ctl5 = ctl5_table[code6];
-
-		//3b/4b decode
-		uint8_t code4 =
-			(data.m_samples[i+6] ? 8 : 0) |
-			(data.m_samples[i+7] ? 4 : 0) |
-			(data.m_samples[i+8] ? 2 : 0) |
-			(data.m_samples[i+9] ? 1 : 0);
-
-		static const bool err3_ctl_table[16] =
-		{
-			 true,  true, false, false, false, false, false, false,
-			false, false, false, false, false, false,  true,  true
-		};
-
-		static const int code3_pos_ctl_table[16] =	//if disp5 positive
-		{
-			0, 0, 4, 3, 0, 2, 6, 7,
-			7, 1, 5, 0, 3, 4, 0, 0,
-		};
-
-		static const int code3_neg_ctl_table[16] =	//if disp5 negative
-		{
-			0, 0, 4, 3, 0, 5, 1, 7,
-			7, 6, 2, 0, 3, 4, 0, 0
-		};
-
-		static const bool err3_table[16] =
-		{
-			 true,  false, false, false, false, false, false, false,
-			false, false, false, false, false, false, false,  true
-		};
-
-		static const int code3_table[16] =
-		{
-			0, 7, 4, 3, 0, 2, 6, 7,
-			7, 1, 5, 0, 3, 4, 7, 0
-		};
-
-		static const int disp3_table[16] =
-		{
-			 0, -2, -2, 0, -2, 0, 0, 2,
-			-2, 0,  0, 2,  0, 2, 2, 0
-		};
+	#pragma omp parallel for
+	for(size_t n=0; n<nsymbols; n++)
+	{
+		size_t i = max_offset + n*10;
+		auto& e = table[data->ExtractBits(i, 10)];
 
-		//true only for Dx.A7
-		const bool alt3_table[16] =
-		{
-			0, 0, 0, 0, 0, 0, 0, 1,
-			1, 0, 0, 0, 0, 0, 0, 0
-		};
+		//Horizontally shift the decoded symbol back by half a UI
+		//since the recovered clock edge is in the middle of the UI.
+		//We want the decoded signal boundaries to line up with the data edge, not the middle of the UI.
+		cap->m_offsets[n] = data->m_offsets[i] - data->m_durations[i]/2;
+		cap->m_durations[n] = data->m_offsets[i+10] - data->m_offsets[i];
 
-		int code3 = false;
-		int disp3 = 0;
-		int err3 = false;
-		if(ctl5)
-		{
-			if(disp5 >= 0)
-				code3 = code3_pos_ctl_table[code4];
-			else
-				code3 = code3_neg_ctl_table[code4];
-			err3 = err3_ctl_table[code4];
-		}
-		else
-		{
-			code3 = code3_table[code4];
-			err3 = err3_table[code4];
-		}
-		disp3 = disp3_table[code4];
+		//Disparity of the code group for now, replaced by the running disparity below
+		cap->m_samples[n] = IBM8b10bSymbol(e.m_control, e.m_error, e.m_data, e.m_disparity);
+	}
 
-		//Disparity tracking
-		int total_disp = disp3 + disp5;
+	//Running disparity depends on every previous symbol, so it has to be tracked serially
+	bool first = true;
+	int last_disp = -1;
+	for(size_t n=0; n<nsymbols; n++)
+	{
+		auto& sym = cap->m_samples[n];
+		int total_disp = sym.m_disparity;
 		if(first)
 		{
 			if(total_disp < 0)
@@ -335,7 +171,6 @@ void IBM8b10bDecoder::Refresh()
 		}
 
 		bool disperr = false;
-		//int old_disp = last_disp;
 		if(total_disp > 0 && last_disp > 0)
 		{
 			disperr = true;
@@ -349,44 +184,202 @@ void IBM8b10bDecoder::Refresh()
 		else
 			last_disp += total_disp;
 
-		//Special processing for a few control codes that use the .A7 format
-		bool alt = alt3_table[code4];
-		if(alt)
-		{
-			if( (code5 == 23) || (code5 == 27) || (code5 == 29) || (code5 == 30) )
-				ctl5 = true;
-		}
+		sym.m_error |= disperr;
+		sym.m_disparity = last_disp;
+	}
 
-		//Horizontally shift the decoded symbol back by half a UI
-		//since the recovered clock edge is in the middle of the UI.
-		//We want the decoded signal boundaries to line up with the data edge, not the middle of the UI.
-		cap->m_offsets.push_back(data.m_offsets[i] - data.m_durations[i]/2);
+	SetData(cap, 0);
+}
 
-		cap->m_durations.push_back(data.m_offsets[i+10] - data.m_offsets[i]);
-		cap->m_samples.push_back(IBM8b10bSymbol(ctl5, err5 || err3 || disperr, (code3 << 5) | code5, last_disp));
+/**
+	@brief Gets a table of K28.5 comma symbols, indexed by 10-bit code group with the first bit in the LSB
+ */
+const uint8_t* IBM8b10bDecoder::GetCommaTable()
+{
+	static const vector<uint8_t> table = []()
+	{
+		//Left-right bit ordering, as transmitted
+		static const bool commas[2][10] =
+		{
+			{ 0, 0, 1, 1, 1, 1, 1, 0, 1, 0 },
+			{ 1, 1, 0, 0, 0, 0, 0, 1, 0, 1 }
+		};
 
-		if(err5 || err3 || disperr)
+		vector<uint8_t> ret(1024, 0);
+		for(auto& comma : commas)
 		{
-			/*LogDebug(
-				"Symbol %zu (ctl5 = %d, err5 = %d, err3=%d, disperr=%d, code3=%d, code5=%d, "
-					"old_disp = %d, total_disp = %d, disp3 = %d, disp5 = %d)\n",
-				i,
-				ctl5, err5, err3, disperr, code3, code5, old_disp, total_disp, disp3, disp5);*/
+			uint16_t code10 = 0;
+			for(size_t k=0; k<10; k++)
+				code10 |= comma[k] << k;
+			ret[code10] = 1;
 		}
-		/*
+		return ret;
+	}();
+
+	return &table[0];
+}
+
+/**
+	@brief Gets a table of decoded symbols, indexed by 10-bit code group with the first bit in the LSB
+ */
+const IBM8b10bDecoder::DecodeEntry* IBM8b10bDecoder::GetDecodeTable()
+{
+	static const vector<DecodeEntry> table = []()
+	{
+		vector<DecodeEntry> ret(1024);
+		for(uint16_t code10=0; code10<1024; code10++)
+			ret[code10] = DecodeSymbol(code10);
+		return ret;
+	}();
+
+	return &table[0];
+}
+
+/**
+	@brief Decodes a single 10-bit code group, ignoring running disparity
+
+	@param code10	The code group, with the first bit (a) in the LSB
+ */
+IBM8b10bDecoder::DecodeEntry IBM8b10bDecoder::DecodeSymbol(uint16_t code10)
+{
+	//5b/6b decode (abcdei, a is the MSB)
+	uint8_t code6 = 0;
+	for(size_t k=0; k<6; k++)
+		code6 |= ((code10 >> k) & 1) << (5-k);
+
+	static const int code5_table[64] =
+	{
+		 0,  0,  0,  0,  0, 23,  8,  7,	//00-07
+		 0, 27,  4, 20, 24, 12, 28, 28, //08-0f
+		 0, 29,  2, 18, 31, 10, 26, 15, //10-17
+		 0,  6, 22, 16, 14,  1, 30,  0,	//18-1f
+		 0, 30, 1,  17, 16,  9, 25,  0,	//20-27
+		15,  5, 21, 31, 13,  2, 29,  0,	//28-2f
+		28,  3, 19, 24, 11,  4, 27,  0,	//30-37
+		 7,  8, 23,  0,  0,  0,  0,  0  //38-3f
+	};
+
+	static const int disp5_table[64] =
+	{
+		 0,  0,  0, 0,  0, -2, -2, 0,	//00-07
+		 0, -2, -2, 0, -2,  0,  0, 2,	//08-0f
+		 0, -2, -2, 0, -2,  0,  0, 2,	//10-17
+		-2,  0,  0, 2,  0,  2,  2, 0,	//18-1f
+		 0, -2, -2, 0, -2,  0,  0, 2,	//20-27
+		-2,  0,  0, 2,  0,  2,  2, 0,	//28-2f
+		-2,  0,  0, 2,  0,  2,  2, 0,	//30-37
+		 0,  2,  2, 0,  0,  0,  0, 0 	//38-3f
+	};
+
+	static const bool err5_table[64] =
+	{
+		 true,  true,  true,  true,  true, false, false, false,	//00-07
+		 true, false, false, false, false, false, false, false, //08-0f
+		 true, false, false, false, false, false, false, false, //10-17
+		false, false, false, false, false, false, false,  true,	//18-1f
+		 true, false, false, false, false, false, false, false,	//20-27
+		false, false, false, false, false, false, false,  true,	//28-2f
+		false, false, false, false, false, false, false,  true,	//30-37
+		false, false, false,  true,  true,  true,  true,  true  //38-3f
+	};
+
+	static const bool ctl5_table[64] =
+	{
+		false, false, false, false, false, false, false, false,	//00-07
+		false, false, false, false, false, false, false, true,  //08-0f
+		false, false, false, false, false, false, false, false, //10-17
+		false, false, false, false, false, false, false, false,	//18-1f
+		false, false, false, false, false, false, false, false,	//20-27
+		false, false, false, false, false, false, false, false,	//28-2f
+		true,  false, false, false, false, false, false, false,	//30-37
+		false, false, false, false, false, false, false, false  //38-3f
+	};
+
+	int code5 = code5_table[code6];
+	int disp5 = disp5_table[code6];
+	bool err5 = err5_table[code6];
+	bool ctl5 = ctl5_table[code6];
+
+	//3b/4b decode (fghj, f is the MSB)
+	uint8_t code4 = 0;
+	for(size_t k=0; k<4; k++)
+		code4 |= ((code10 >> (6+k)) & 1) << (3-k);
+
+	static const bool err3_ctl_table[16] =
+	{
+		 true,  true, false, false, false, false, false, false,
+		false, false, false, false, false, false,  true,  true
+	};
+
+	static const int code3_pos_ctl_table[16] =	//if disp5 positive
+	{
+		0, 0, 4, 3, 0, 2, 6, 7,
+		7, 1, 5, 0, 3, 4, 0, 0,
+	};
+
+	static const int code3_neg_ctl_table[16] =	//if disp5 negative
+	{
+		0, 0, 4, 3, 0, 5, 1, 7,
+		7, 6, 2, 0, 3, 4, 0, 0
+	};
+
+	static const bool err3_table[16] =
+	{
+		 true,  false, false, false, false, false, false, false,
+		false, false, false, false, false, false, false,  true
+	};
+
+	static const int code3_table[16] =
+	{
+		0, 7, 4, 3, 0, 2, 6, 7,
+		7, 1, 5, 0, 3, 4, 7, 0
+	};
+
+	static const int disp3_table[16] =
+	{
+		 0, -2, -2, 0, -2, 0, 0, 2,
+		-2, 0,  0, 2,  0, 2, 2, 0
+	};
+
+	//true only for Dx.A7
+	const bool alt3_table[16] =
+	{
+		0, 0, 0, 0, 0, 0, 0, 1,
+		1, 0, 0, 0, 0, 0, 0, 0
+	};
+
+	int code3 = false;
+	int disp3 = 0;
+	int err3 = false;
+	if(ctl5)
+	{
+		if(disp5 >= 0)
+			code3 = code3_pos_ctl_table[code4];
 		else
-		{
-			if(ctl5)
-				LogDebug("K%d.%d, disp=%d (old_disp = %d, disp3=%d, disp5=%d)\n",
-					code5, code3, last_disp, old_disp, disp3, disp5);
-			else
-				LogDebug("D%d.%d, disp=%d (old_disp = %d, disp3=%d, disp5=%d)\n",
-					code5, code3, last_disp, old_disp,disp3, disp5);
-		}
-		*/
+			code3 = code3_neg_ctl_table[code4];
+		err3 = err3_ctl_table[code4];
+	}
+	else
+	{
+		code3 = code3_table[code4];
+		err3 = err3_table[code4];
 	}
+	disp3 = disp3_table[code4];
 
-	SetData(cap, 0);
+	//Special processing for a few control codes that use the .A7 format
+	bool alt = alt3_table[code4];
+	if(alt)
+	{
+		if( (code5 == 23) || (code5 == 27) || (code5 == 29) || (code5 == 30) )
+			ctl5 = true;
+	}
+
+	DecodeEntry ret;
+	ret.m_data = (code3 << 5) | code5;
+	ret.m_control = ctl5;
+	ret.m_error = err5 || err3;
+	ret.m_disparity = disp3 + disp5;
+	return ret;
 }
 
 Gdk::Color IBM8b10bDecoder::GetColor(int i)
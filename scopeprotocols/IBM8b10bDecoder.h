@@ -91,6 +91,22 @@ public:
 
 protected:
 	std::string m_displayformat;
+
+	///@brief Decoded form of one 10-bit code group, ignoring running disparity
+	class DecodeEntry
+	{
+	public:
+		uint8_t m_data;
+		bool m_control;
+		bool m_error;
+
+		///@brief Disparity of the code group (-2, 0, or +2)
+		int8_t m_disparity;
+	};
+
+	static DecodeEntry DecodeSymbol(uint16_t code10);
+	static const DecodeEntry* GetDecodeTable();
+	static const uint8_t* GetCommaTable();
 };
 
 #endif
@@ -205,8 +205,16 @@ void JitterSpectrumFilter::Refresh()
 	LogTrace("Capture is %zu UIs, %s\n", num_uis, Unit(Unit::UNIT_FS).PrettyPrint(capture_duration).c_str());
 	LogTrace("Final UI width estimate: %s\n", Unit(Unit::UNIT_FS).PrettyPrint(ui_width_final).c_str());
 
-	//Round size up to next power of two
+	//Averaged spectrum of shorter segments, if requested
 	const size_t npoints_raw = extended_samples.size();
+	size_t seglen = GetWelchSegmentLength(npoints_raw);
+	if(seglen)
+	{
+		DoRefreshWelch(din, extended_samples, ui_width_final, seglen, false);
+		return;
+	}
+
+	//Round size up to next power of two
 	const size_t npoints = next_pow2(npoints_raw);
 	LogTrace("JitterSpectrumFilter: processing %zu raw points\n", npoints_raw);
 	LogTrace("Rounded to %zu\n", npoints);
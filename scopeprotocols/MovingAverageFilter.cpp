@@ -136,38 +136,77 @@ void MovingAverageFilter::Refresh()
 	m_xAxisUnit = m_inputs[0].m_channel->GetXAxisUnits();
 	m_yAxisUnit = m_inputs[0].m_channel->GetYAxisUnits();
 
-	//Do the average
-	auto cap = new AnalogWaveform;
+	//Output sample i is the average of input samples i ... i+depth-1, and lines up with the middle of that window
 	size_t nsamples = len - depth;
 	size_t off = depth/2;
-	cap->Resize(nsamples);
+	auto cap = SetupOutputWaveform(din, 0, off, depth - off);
+	if(cap->m_densePacked)
+		cap->m_triggerPhase = din->m_triggerPhase + off*din->m_timescale;
+
+	//Blocks are independent since each one sums its first window from scratch
+	size_t numblocks = GetParallelBlockCount(nsamples);
+	vector<float> blockmin(numblocks);
+	vector<float> blockmax(numblocks);
+
+	const float* in = (const float*)&din->m_samples[0];
+	float* out = (float*)&cap->m_samples[0];
+
+	ForEachParallelBlock(nsamples, numblocks, 1, [&](size_t i, size_t istart, size_t iend)
+		{ AverageBlock(in, out, istart, iend, depth, blockmin[i], blockmax[i]); });
+
 	float vmin = FLT_MAX;
 	float vmax = -FLT_MAX;
-	//#pragma omp parallel for
-	for(size_t i=0; i<nsamples; i++)
+	for(size_t i=0; i<numblocks; i++)
 	{
-		float v = 0;
-		for(size_t j=0; j<depth; j++)
-			v += din->m_samples[i+j];
-		v /= depth;
-
-		vmin = min(vmin, v);
-		vmax = max(vmax, v);
-
-		cap->m_offsets[i] = din->m_offsets[i+off];
-		cap->m_durations[i] = din->m_durations[i+off];
-		cap->m_samples[i] = v;
+		vmin = min(vmin, blockmin[i]);
+		vmax = max(vmax, blockmax[i]);
 	}
-	SetData(cap, 0);
 
 	//Calculate bounds
 	m_max = max(m_max, vmax);
 	m_min = min(m_min, vmin);
 	m_range = (m_max - m_min) * 1.05;
 	m_offset = -( (m_max - m_min)/2 + m_min );
+}
+
+/**
+	@brief Calculates one block of the moving average with a running sum
+
+	Each output costs one add and one subtract regardless of depth. Every add/subtract pair can leave a little
+	rounding error behind in the sum, even in double precision, so the sum is periodically rebuilt from the input.
+ */
+void MovingAverageFilter::AverageBlock(
+	const float* in,
+	float* out,
+	size_t istart,
+	size_t iend,
+	size_t depth,
+	float& vmin,
+	float& vmax)
+{
+	//Rebuilding the sum costs depth adds. Doing it once per 16 window lengths (at least 64K outputs) adds about 3%
+	//to the sliding cost, while keeping the chain of add/subtract pairs between rebuilds short.
+	size_t resync = max((size_t)65536, depth * 16);
 
-	//Copy our time scales from the input
-	cap->m_timescale = din->m_timescale;
-	cap->m_startTimestamp = din->m_startTimestamp;
-	cap->m_startFemtoseconds = din->m_startFemtoseconds;
+	vmin = FLT_MAX;
+	vmax = -FLT_MAX;
+	for(size_t cstart=istart; cstart<iend; cstart += resync)
+	{
+		size_t cend = min(iend, cstart + resync);
+
+		double sum = 0;
+		for(size_t j=0; j<depth; j++)
+			sum += in[cstart + j];
+
+		for(size_t i=cstart; i<cend; i++)
+		{
+			if(i > cstart)
+				sum += in[i+depth-1] - (double)in[i-1];
+
+			float v = sum / depth;
+			vmin = min(vmin, v);
+			vmax = max(vmax, v);
+			out[i] = v;
+		}
+	}
 }
@@ -57,6 +57,15 @@ public:
 	PROTOCOL_DECODER_INITPROC(MovingAverageFilter)
 
 protected:
+	static void AverageBlock(
+		const float* in,
+		float* out,
+		size_t istart,
+		size_t iend,
+		size_t depth,
+		float& vmin,
+		float& vmax);
+
 	std::string m_depthname;
 
 	float m_min;
@@ -29,6 +29,7 @@
 
 #include "../scopehal/scopehal.h"
 #include <complex>
+#include <omp.h>
 #include "OFDMDemodulator.h"
 
 using namespace std;
@@ -49,7 +50,12 @@ OFDMDemodulator::OFDMDemodulator(const string& color)
 	m_min = FLT_MAX;
 	m_max = -FLT_MAX;
 
-	//TODO: create outputs
+	//Set up outputs
+	ClearStreams();
+	AddStream("Sync");
+	AddStream("I");
+	AddStream("Q");
+	m_yAxisUnit = Unit(Unit::UNIT_COUNTS);
 
 	m_symbolTimeName = "Symbol Time";
 	m_parameters[m_symbolTimeName] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_FS));
@@ -62,23 +68,10 @@ OFDMDemodulator::OFDMDemodulator(const string& color)
 	m_fftSizeName = "FFT Size";
 	m_parameters[m_fftSizeName] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_COUNTS));
 	m_parameters[m_fftSizeName].SetIntVal(64);
-
-	m_cachedFftSize = 0;
-	m_fftPlan = NULL;
-	m_fftInputBuf = NULL;
-	m_fftOutputBuf = NULL;
-
-	//Constant 16 point FFT
-	m_fftPlan16 = ffts_init_1d(16, FFTS_FORWARD);
 }
 
 OFDMDemodulator::~OFDMDemodulator()
 {
-	ffts_free(m_fftPlan);
-	ffts_free(m_fftPlan16);
-
-	m_allocator.deallocate(m_fftInputBuf);
-	m_allocator.deallocate(m_fftOutputBuf);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -149,14 +142,12 @@ void OFDMDemodulator::ClearSweeps()
 
 void OFDMDemodulator::Refresh()
 {
-	//Not implemented, do nothing
-	SetData(NULL, 0);
-	return;
-	/*
 	//Make sure we've got valid inputs
 	if(!VerifyAllInputsOKAndAnalog())
 	{
 		SetData(NULL, 0);
+		SetData(NULL, 1);
+		SetData(NULL, 2);
 		return;
 	}
 
@@ -164,249 +155,349 @@ void OFDMDemodulator::Refresh()
 	auto din_i = GetAnalogInputWaveform(0);
 	auto din_q = GetAnalogInputWaveform(1);
 
-	//Copy the units
-	m_yAxisUnit = m_inputs[0].m_channel->GetYAxisUnits();
-
-	//Convert rates to number of samples
-	int symbol_time_fs = m_parameters[m_symbolTimeName].GetIntVal();
-	size_t symbol_time_samples = symbol_time_ps / din_i->m_timescale;
-	int guard_interval_fs = m_parameters[m_guardIntervalName].GetIntVal();
-	size_t guard_interval_samples = guard_interval_fs / din_i->m_timescale;
+	//Convert times to number of samples
+	size_t symbol_time_samples = m_parameters[m_symbolTimeName].GetIntVal() / din_i->m_timescale;
+	size_t guard_interval_samples = m_parameters[m_guardIntervalName].GetIntVal() / din_i->m_timescale;
+	size_t period_samples = symbol_time_samples + guard_interval_samples;
+	size_t fftsize = m_parameters[m_fftSizeName].GetIntVal();
 
 	//We need meaningful data, bail if it's too short
-	auto len = min(din_i->m_samples.size(), din_q->m_samples.size());
-	if(len < symbol_time_samples)
+	size_t len = min(din_i->m_samples.size(), din_q->m_samples.size());
+	if( (symbol_time_samples == 0) || (guard_interval_samples == 0) || (fftsize == 0) || (len < 2*period_samples) )
 	{
 		SetData(NULL, 0);
+		SetData(NULL, 1);
+		SetData(NULL, 2);
 		return;
 	}
 
-	//Worry about the output later
-
-	//First pass: Find symbol sync (Schmidl-Cox)
-	//TODO: break up multi packet waveforms
-	//TODO: we can get a better idea of sync by looking at the *slope* of the metric, it should be flat topped.
-	//Find the left and right edges then look at the midpoint maybe?
-	size_t period_samples = symbol_time_samples + guard_interval_samples;
-	size_t end = len - 2*period_samples;
-	float max_metric = -FLT_MAX;
-	size_t imax = 0;
-	for(size_t i=0; i < end; i ++)
+	//Cyclic prefix correlation at every offset, then split the capture into packets.
+	//Average the power over a whole symbol period so the peaks and dips within a symbol don't break packets up.
+	float* pi = (float*)&din_i->m_samples[0];
+	float* pq = (float*)&din_q->m_samples[0];
+	vector<float> metric;
+	SlidingCorrelation(pi, pq, len, symbol_time_samples, guard_interval_samples, metric);
+	vector< pair<size_t, size_t> > packets;
+	FindPackets(pi, pq, len, period_samples, 2*period_samples, packets);
+
+	//Sync output: the metric is only meaningful while a packet is on the air, so zero it everywhere else
+	size_t nmetric = metric.size();
+	auto cap = SetupOutputWaveform(din_i, 0, 0, din_i->m_samples.size() - nmetric);
+	size_t j = 0;
+	for(auto& p : packets)
 	{
-		complex<float> total = 0;
-		for(size_t j=0; j<guard_interval_samples; j++)
-		{
-			size_t first = i + j;
-			size_t second = first + period_samples;
-
-			complex<float> a(din_i->m_samples[first], din_q->m_samples[first]);
-			complex<float> b(din_i->m_samples[second], din_q->m_samples[second]);
-
-			total += a*b;
-		}
-
-		float metric = fabs(total);
-
-		if(metric > max_metric)
-		{
-			max_metric = metric;
-			imax = i;
-		}
+		for(; j<p.first; j++)
+			cap->m_samples[j] = 0;
+		for(; j<min(p.second, nmetric); j++)
+			cap->m_samples[j] = metric[j];
 	}
-
-	//Create FFT config and buffers
-	int fftsize = m_parameters[m_fftSizeName].GetIntVal();
-	if(fftsize != m_cachedFftSize)
+	for(; j<nmetric; j++)
+		cap->m_samples[j] = 0;
+
+	//Sync to the first cyclic prefix of each packet and list every complete symbol in it.
+	//Skip the guard interval so the FFT sees only the symbol itself.
+	vector<size_t> symbolStarts;
+	vector<size_t> packetFirstSymbol;
+	for(auto& p : packets)
 	{
-		m_cachedFftSize = fftsize;
-
-		if(m_fftPlan)
-			ffts_free(m_fftPlan);
-		m_fftPlan = ffts_init_1d(fftsize, FFTS_FORWARD);
+		packetFirstSymbol.push_back(symbolStarts.size());
+		size_t sync = FindSymbolSync(metric, p.first, p.first + period_samples);
+		for(size_t i=sync; (i + period_samples <= p.second) && (i + guard_interval_samples + fftsize <= len); i += period_samples)
+			symbolStarts.push_back(i + guard_interval_samples);
+	}
+	packetFirstSymbol.push_back(symbolStarts.size());
+	vector<float, AlignedAllocator<float, 64> > spectra;
+	DemodulateSymbols(pi, pq, symbolStarts, fftsize, spectra);
+
+	//I/Q outputs: one sample per subcarrier per symbol, spread evenly across the symbol time.
+	//No channel estimation yet, so just normalize each packet to unit mean subcarrier magnitude.
+	size_t nout = symbolStarts.size() * fftsize;
+	auto cap_i = new AnalogWaveform;
+	auto cap_q = new AnalogWaveform;
+	cap_i->Resize(nout);
+	cap_q->Resize(nout);
+	int64_t spacing = max(symbol_time_samples / fftsize, (size_t)1);
+	float vmin = 0;
+	float vmax = 1;
+	for(size_t ipack=0; ipack<packets.size(); ipack++)
+	{
+		size_t first = packetFirstSymbol[ipack] * fftsize;
+		size_t last = packetFirstSymbol[ipack+1] * fftsize;
+		if(first == last)
+			continue;
 
-		if(m_fftInputBuf)
-			m_allocator.deallocate(m_fftInputBuf);
-		m_fftInputBuf = m_allocator.allocate(fftsize*2);
+		double sum = 0;
+		for(size_t k=first; k<last; k++)
+			sum += abs(complex<float>(spectra[k*2], spectra[k*2 + 1]));
+		float scale = (sum > 0) ? ( (last - first) / sum ) : 0;
 
-		if(m_fftOutputBuf)
-			m_allocator.deallocate(m_fftOutputBuf);
-		m_fftOutputBuf = m_allocator.allocate(fftsize*2);
+		for(size_t k=first; k<last; k++)
+		{
+			size_t start = symbolStarts[k / fftsize];
+			int64_t timestamp = din_i->m_offsets[start] + (k % fftsize) * spacing;
+			cap_i->m_offsets[k]		= timestamp;
+			cap_q->m_offsets[k]		= timestamp;
+			cap_i->m_durations[k]	= spacing;
+			cap_q->m_durations[k]	= spacing;
+
+			float vi = spectra[k*2] * scale;
+			float vq = spectra[k*2 + 1] * scale;
+			cap_i->m_samples[k]		= vi;
+			cap_q->m_samples[k]		= vq;
+			vmin = min(vmin, min(vi, vq));
+			vmax = max(vmax, max(vi, vq));
+		}
 	}
+	SetData(cap_i, 1);
+	SetData(cap_q, 2);
+
+	//Copy our time scales from the input
+	cap_i->m_timescale 			= din_i->m_timescale;
+	cap_q->m_timescale 			= din_i->m_timescale;
+	cap_i->m_startTimestamp 	= din_i->m_startTimestamp;
+	cap_q->m_startTimestamp 	= din_i->m_startTimestamp;
+	cap_i->m_startFemtoseconds	= din_i->m_startFemtoseconds;
+	cap_q->m_startFemtoseconds	= din_i->m_startFemtoseconds;
+	cap_i->m_triggerPhase		= din_i->m_triggerPhase;
+	cap_q->m_triggerPhase		= din_i->m_triggerPhase;
+
+	//Calculate bounds. The sync metric is always in [0, 1] so it fits in the same range.
+	m_max = max(m_max, vmax);
+	m_min = min(m_min, vmin);
+	m_range = (m_max - m_min) * 1.05;
+	m_offset = (m_max - m_min)/2 + m_min;
+}
 
-	//everything after here is probably 802.11n specific for now?
-	if(fftsize != 64)
-	{
-		SetData(NULL, 0);
+/**
+	@brief Calculates the cyclic prefix correlation metric at every offset
+
+	The guard interval of each OFDM symbol is a copy of the last part of the symbol, "lag" samples later. At offset i
+	the metric is |sum(conj(x[k]) * x[k+lag])| / sum((|x[k]|^2 + |x[k+lag]|^2) / 2) over k = i ... i+window-1, which is
+	close to 1 when i is the start of a guard interval and much lower elsewhere.
+
+	Rather than re-summing the whole window at every offset, the sums slide along: one product is added and one
+	removed per sample. The output is split into blocks which start from an exact sum, so rounding error can't build
+	up over long captures, and the blocks are spread across threads.
+
+	@param pi		In-phase samples
+	@param pq		Quadrature samples
+	@param len		Number of samples
+	@param lag		Distance between the guard interval and the samples it was copied from (FFT size, in samples)
+	@param window	Length of the guard interval
+	@param metric	Output, len - lag - window + 1 values
+ */
+void OFDMDemodulator::SlidingCorrelation(
+	const float* pi,
+	const float* pq,
+	size_t len,
+	size_t lag,
+	size_t window,
+	vector<float>& metric)
+{
+	metric.clear();
+	if( (window == 0) || (len < lag + window) )
 		return;
-	}
+	size_t nout = len - lag - window + 1;
+	metric.resize(nout);
 
-	//DEBUG: rely on scope trigger for initial sync
-	imax = 0;
+	size_t blocksize = max((size_t)65536, 16*window);
+	size_t nblocks = (nout + blocksize - 1) / blocksize;
 
-	//Print header
-	static bool first = true;
-	if(first)
+	#pragma omp parallel for
+	for(size_t b=0; b<nblocks; b++)
 	{
-		first = false;
-		LogDebug("symbol,");
-		for(int i=0; i<fftsize; i++)
-			LogDebug("i%d,q%d,", i, i);
-		LogDebug("\n");
-	}
+		size_t start = b*blocksize;
+		size_t end = min(start + blocksize, nout);
 
-	//Read the short preamble. Ten blocks of 800ns symbols with no guard interval.
-	//We're sampling at 50ns per sample so this is 16 samples.
-	//Maybe we should do a 16 point FFT on each?
-	float preambleAmplitudes[12] = {0};
-	float initialPreamblePhases[12] = {0};
-	int preambleToneBins[12] = {1, 2, 3, 4, 5, 6, 10, 11, 12, 13, 14, 15};
-	size_t unstableCount	= 0;	//number of preamble samples we consider unstable
-									//(ESP32s etc transmit early before full PLL lock!)
-	float phaseDriftPerCarrier[12] = {0};
-	for(size_t block=0; block<10; block ++)
-	{
-		//Copy I/Q sample data
-		size_t ibase = imax + 16*block;
-		for(int j=0; j<16; j++)
+		double sumReal = 0;
+		double sumImag = 0;
+		double energy = 0;
+		for(size_t k=start; k<start+window; k++)
 		{
-			m_fftInputBuf[j*2] = din_i->m_samples[ibase + j];
-			m_fftInputBuf[j*2 + 1] = din_q->m_samples[ibase + j];
+			float ar = pi[k];
+			float ai = pq[k];
+			float br = pi[k+lag];
+			float bi = pq[k+lag];
+			sumReal += ar*br + ai*bi;
+			sumImag += ar*bi - ai*br;
+			energy += 0.5f * (ar*ar + ai*ai + br*br + bi*bi);
 		}
 
-		//Do the FFT
-		ffts_execute(m_fftPlan16, m_fftInputBuf, m_fftOutputBuf);
-
-		//Process each symbol
-		for(size_t i=0; i<12; i++)
+		for(size_t i=start; i<end; i++)
 		{
-			//Average the amplitudes
-			int bin = preambleToneBins[i];
-			complex<float> c(m_fftOutputBuf[bin*2], m_fftOutputBuf[bin*2 + 1]);
-			preambleAmplitudes[i] += abs(c);
-
-			//Calculate inital phase
-			if(block == unstableCount)
-				initialPreamblePhases[i] = arg(c);
-			else if(block > unstableCount)
+			if(i > start)
 			{
-				complex<float> d = polar(1.0f, arg(c) - initialPreamblePhases[i]);
-				if(block == 9)
-				{
-					phaseDriftPerCarrier[i] = arg(d) / (9 - unstableCount);
-					preambleAmplitudes[i] /= 10;
-
-					//New phase starts here
-					initialPreamblePhases[i] = arg(c);
-				}
+				//Drop the product leaving the window
+				size_t k = i - 1;
+				float ar = pi[k];
+				float ai = pq[k];
+				float br = pi[k+lag];
+				float bi = pq[k+lag];
+				sumReal -= ar*br + ai*bi;
+				sumImag -= ar*bi - ai*br;
+				energy -= 0.5f * (ar*ar + ai*ai + br*br + bi*bi);
+
+				//and add the one entering it
+				k = i + window - 1;
+				ar = pi[k];
+				ai = pq[k];
+				br = pi[k+lag];
+				bi = pq[k+lag];
+				sumReal += ar*br + ai*bi;
+				sumImag += ar*bi - ai*br;
+				energy += 0.5f * (ar*ar + ai*ai + br*br + bi*bi);
 			}
+
+			if(energy > 0)
+				metric[i] = sqrt(sumReal*sumReal + sumImag*sumImag) / energy;
+			else
+				metric[i] = 0;
 		}
 	}
+}
 
-	LogDebug("0,");
-	for(size_t i=0; i<12; i++)
-		LogDebug("%12f,", phaseDriftPerCarrier[i]);
-	LogDebug("\n");
+/**
+	@brief Splits a capture into packets separated by idle time
+
+	A packet is a run of samples where the average power over the last "window" samples is at least a tenth of the
+	peak. Runs shorter than minlen samples are ignored.
+
+	@param packets	Output, half-open [start, end) sample ranges
+ */
+void OFDMDemodulator::FindPackets(
+	const float* pi,
+	const float* pq,
+	size_t len,
+	size_t window,
+	size_t minlen,
+	vector< pair<size_t, size_t> >& packets)
+{
+	packets.clear();
+	window = max(window, (size_t)1);
+	if(len < window)
+		return;
 
-	//Skip the short preamble
-	imax += 160;
-	float startingPhase = initialPreamblePhases[0];
+	//Sliding power, in the same blocked form as SlidingCorrelation()
+	size_t nout = len - window + 1;
+	vector<float> power(nout);
+	size_t blocksize = max((size_t)65536, 16*window);
+	size_t nblocks = (nout + blocksize - 1) / blocksize;
+	vector<float> blockmax(nblocks);
 
-	//Calculate average drift across all preamble symbols
-	float driftPer800ns = 0;
-	float ampScale = 0;
-	for(size_t i=0; i<12; i++)
+	#pragma omp parallel for
+	for(size_t b=0; b<nblocks; b++)
 	{
-		driftPer800ns += phaseDriftPerCarrier[i];
-		ampScale += preambleAmplitudes[i];
-	}
-	driftPer800ns /= 12;
-	ampScale /= 12;
+		size_t start = b*blocksize;
+		size_t end = min(start + blocksize, nout);
 
-	float driftPerSymbol = 5 * driftPer800ns;
+		double sum = 0;
+		for(size_t k=start; k<start+window; k++)
+			sum += pi[k]*pi[k] + pq[k]*pq[k];
 
-	//Skip 1.6us (32 sample) guard interval
-	imax += 32;
-	startingPhase += 2*driftPer800ns;
-	*/
-
-	//We should now have two OFDM BPSK training symbols with no guard interval
-	//Carrier in columns 8, 12, 16, 20, 24, 40, 44, 48, 52, 56, 60??
-	/*
-	for(size_t i=0; i<2; i++)
-	{
-		//Copy I/Q sample data
-		size_t ibase = imax + symbol_time_samples*i;
-		for(int j=0; j<fftsize; j++)
+		float vmax = 0;
+		for(size_t i=start; i<end; i++)
 		{
-			m_fftInputBuf[j*2] = din_i->m_samples[ibase + j];
-			m_fftInputBuf[j*2 + 1] = din_q->m_samples[ibase + j];
+			if(i > start)
+			{
+				size_t k = i - 1;
+				sum -= pi[k]*pi[k] + pq[k]*pq[k];
+				k = i + window - 1;
+				sum += pi[k]*pi[k] + pq[k]*pq[k];
+			}
+			power[i] = sum;
+			vmax = max(vmax, power[i]);
 		}
+		blockmax[b] = vmax;
+	}
 
-		//Run the FFT
-		ffts_execute(m_fftPlan, m_fftInputBuf, m_fftOutputBuf);
+	float peak = 0;
+	for(auto v : blockmax)
+		peak = max(peak, v);
+	float threshold = peak / 10;
 
-		//Grab each output
-		LogDebug("%zu,", i);
-		for(int j=0; j<fftsize; j++)
+	//Find the runs above threshold
+	bool inPacket = false;
+	size_t start = 0;
+	for(size_t i=0; i<nout; i++)
+	{
+		bool active = (power[i] >= threshold) && (peak > 0);
+		if(active && !inPacket)
 		{
-			//Rotate by the calculated drift
-			complex<float> c(m_fftOutputBuf[j*2], m_fftOutputBuf[j*2 + 1]);
-
-			float phase = startingPhase + (4*driftPer800ns*i);
-			c *= polar(1.0f, -phase);
-			c /= ampScale;
-
-			LogDebug("%12f,%12f,", c.real(), c.imag());
+			start = i;
+			inPacket = true;
 		}
-		LogDebug("\n");
-	}*/
-
-	//Skip these training symbols
-	//imax += 128;
-	//startingPhase += 8*driftPer800ns;
+		else if(!active && inPacket)
+		{
+			size_t end = i + window - 1;
+			if(end - start >= minlen)
+				packets.push_back(pair<size_t, size_t>(start, end));
+			inPacket = false;
+		}
+	}
+	if(inPacket && (len - start >= minlen) )
+		packets.push_back(pair<size_t, size_t>(start, len));
+}
 
-	//Actual symbol data
-	/*
-	size_t iblock = 0;
-	for(size_t i=imax; i<end; i += period_samples)
+/**
+	@brief Finds the best symbol alignment, the peak of the correlation metric, in [start, end)
+ */
+size_t OFDMDemodulator::FindSymbolSync(const vector<float>& metric, size_t start, size_t end)
+{
+	end = min(end, metric.size());
+	float max_metric = -FLT_MAX;
+	size_t imax = start;
+	for(size_t i=start; i<end; i++)
 	{
-		//Copy I/Q sample data
-		//Initial sync point is the first symbol's cyclic prefix.
-		//Skip the guard interval when copying the actual samples.
-		size_t ibase = i + guard_interval_samples;
-		for(int j=0; j<fftsize; j++)
+		if(metric[i] > max_metric)
 		{
-			m_fftInputBuf[j*2] = din_i->m_samples[ibase + j];
-			m_fftInputBuf[j*2 + 1] = din_q->m_samples[ibase + j];
+			max_metric = metric[i];
+			imax = i;
 		}
+	}
+	return imax;
+}
 
-		//Run the FFT
-		ffts_execute(m_fftPlan, m_fftInputBuf, m_fftOutputBuf);
-
-		LogDebug("%5zu,", iblock);
-
-		//Phase correction
-		for(size_t j=0; j<64; j++)
-		{
-			complex<float> c(m_fftOutputBuf[j*2], m_fftOutputBuf[j*2 + 1]);
+/**
+	@brief Transforms a list of symbols to the frequency domain
+
+	Symbols are independent, so they're divided among threads, each with its own FFT plan.
+
+	@param starts	Index of the first sample of each symbol (after the guard interval)
+	@param fftsize	Number of samples per symbol
+	@param spectra	Output, fftsize interleaved complex bins per symbol
+ */
+void OFDMDemodulator::DemodulateSymbols(
+	const float* pi,
+	const float* pq,
+	const vector<size_t>& starts,
+	size_t fftsize,
+	vector<float, AlignedAllocator<float, 64> >& spectra)
+{
+	size_t nsymbols = starts.size();
+	spectra.resize(nsymbols * fftsize * 2);
+	if(nsymbols == 0)
+		return;
 
-			//Track pilot tone in bin 7
-			//complex<float> pilot(m_fftOutputBuf[7*2], m_fftOutputBuf[7*2 + 1]);
-			//float phase = arg(pilot);
+	size_t nthreads = min((size_t)omp_get_max_threads(), nsymbols);
+	size_t perThread = (nsymbols + nthreads - 1) / nthreads;
 
-			float phase = startingPhase + driftPerSymbol*iblock;
-			c *= polar(1.0f, -phase);
-			c /= ampScale;
+	#pragma omp parallel for
+	for(size_t t=0; t<nthreads; t++)
+	{
+		auto plan = FFTPlanCache::GetComplexPlan(fftsize, FFTS_FORWARD);
+		auto scratch = FFTPlanCache::GetScratchBuffer(fftsize * 2);
+		float* in = &(*scratch)[0];
 
-			LogDebug("%12f,%12f,", c.real(), c.imag());
+		size_t last = min(nsymbols, (t+1) * perThread);
+		for(size_t sym = t*perThread; sym < last; sym++)
+		{
+			size_t base = starts[sym];
+			for(size_t j=0; j<fftsize; j++)
+			{
+				in[j*2] = pi[base + j];
+				in[j*2 + 1] = pq[base + j];
+			}
+			ffts_execute(plan.get(), in, &spectra[sym * fftsize * 2]);
 		}
-		LogDebug("\n");
-
-		iblock ++;
-		break;
-	}*/
-
-	//TODO
-	SetData(NULL, 0);
-	return;
+	}
 }
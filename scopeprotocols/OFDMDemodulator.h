@@ -59,20 +59,37 @@ public:
 
 	PROTOCOL_DECODER_INITPROC(OFDMDemodulator)
 
+	static void SlidingCorrelation(
+		const float* pi,
+		const float* pq,
+		size_t len,
+		size_t lag,
+		size_t window,
+		std::vector<float>& metric);
+
+	static void FindPackets(
+		const float* pi,
+		const float* pq,
+		size_t len,
+		size_t window,
+		size_t minlen,
+		std::vector< std::pair<size_t, size_t> >& packets);
+
+	static size_t FindSymbolSync(const std::vector<float>& metric, size_t start, size_t end);
+
+	static void DemodulateSymbols(
+		const float* pi,
+		const float* pq,
+		const std::vector<size_t>& starts,
+		size_t fftsize,
+		std::vector<float, AlignedAllocator<float, 64> >& spectra);
+
 protected:
 	double	m_range;
 	double	m_offset;
 	float m_min;
 	float m_max;
 
-	ffts_plan_t* m_fftPlan;
-	ffts_plan_t* m_fftPlan16;
-	float* m_fftInputBuf;
-	float* m_fftOutputBuf;
-	int m_cachedFftSize;
-
-	AlignedAllocator<float, 64> m_allocator;
-
 	std::string m_symbolTimeName;
 	std::string m_guardIntervalName;
 	std::string m_fftSizeName;
@@ -611,21 +611,7 @@ void PCIeDataLinkDecoder::Refresh()
 uint16_t PCIeDataLinkDecoder::CalculateDllpCRC(uint8_t type, uint8_t* data)
 {
 	uint8_t crc_in[4] = { type, data[0], data[1], data[2] };
-
-	uint16_t poly = 0xd008;
-	uint16_t crc = 0xffff;
-
-	for(int n=0; n<4; n++)
-	{
-		uint8_t d = crc_in[n];
-		for(int i=0; i<8; i++)
-		{
-			bool b = ( crc ^ (d >> i) ) & 1;
-			crc >>= 1;
-			if(b)
-				crc ^= poly;
-		}
-	}
+	uint16_t crc = CRC::GetCRC16PCIe().Update(0xffff, crc_in, 4);
 
 	return ~( (crc << 8) | ( (crc >> 8) & 0xff) );
 }
@@ -637,21 +623,7 @@ uint16_t PCIeDataLinkDecoder::CalculateDllpCRC(uint8_t type, uint8_t* data)
  */
 uint32_t PCIeDataLinkDecoder::CalculateTlpCRC(Packet* pack)
 {
-	uint32_t poly = 0xedb88320;
-
-	size_t len = pack->m_data.size();
-	uint32_t crc = 0xffffffff;
-	for(size_t n=0; n<len; n++)
-	{
-		uint8_t d = pack->m_data[n];
-		for(int i=0; i<8; i++)
-		{
-			bool b = ( crc ^ (d >> i) ) & 1;
-			crc >>= 1;
-			if(b)
-				crc ^= poly;
-		}
-	}
+	uint32_t crc = CRC::GetCRC32().Update(0xffffffff, pack->m_data.data(), pack->m_data.size());
 
 	return ~(	((crc & 0x000000ff) << 24) |
 				((crc & 0x0000ff00) << 8) |
@@ -134,14 +134,19 @@ void ParallelBus::Refresh()
 
 	//Merge all of our samples
 	//TODO: handle variable sample rates etc
-	auto cap = new DigitalBusWaveform;
+	auto cap = new DigitalBusWaveform(m_width);
 	cap->Resize(len);
 	cap->CopyTimestamps(inputs[0]);
 	#pragma omp parallel for
 	for(size_t i=0; i<len; i++)
 	{
+		uint64_t value = 0;
 		for(int j=0; j<m_width; j++)
-			cap->m_samples[i].push_back(inputs[j]->m_samples[i]);
+		{
+			if(inputs[j]->m_samples[i])
+				value |= (1ULL << j);
+		}
+		cap->SetSample(i, value);
 	}
 	SetData(cap, 0);
 
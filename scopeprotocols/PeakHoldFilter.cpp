@@ -154,6 +154,9 @@ void PeakHoldFilter::Refresh()
 			cap->m_samples[i] = max((float)cap->m_samples[i], (float)din->m_samples[i]);
 	}
 
+	//Samples were updated in place, so cached statistics of the old contents are stale
+	cap->MarkModified();
+
 	FindPeaks(cap);
 
 	//Copy our time scales from the input
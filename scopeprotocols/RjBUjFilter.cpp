@@ -132,9 +132,8 @@ void RjBUjFilter::Refresh()
 	auto ddj = dynamic_cast<DDJMeasurement*>(GetInput(3).m_channel);
 	float* table = ddj->GetDDJTable();
 
-	//Sample the input data
-	DigitalWaveform samples;
-	SampleOnAnyEdges(thresh, clk, samples);
+	//Sample the input data (shared with any other filter sampling the same signals)
+	auto samples = SampleBitstream(thresh, clk);
 
 	//Set up output waveform
 	auto cap = SetupOutputWaveform(tie, 0, 0, 0);
@@ -143,7 +142,7 @@ void RjBUjFilter::Refresh()
 	uint8_t window = 0;
 
 	size_t tielen = tie->m_samples.size();
-	size_t samplen = samples.m_samples.size();
+	size_t samplen = samples->size();
 
 	size_t itie = 0;
 
@@ -157,7 +156,7 @@ void RjBUjFilter::Refresh()
 	{
 		//Sample the next bit in the thresholded waveform
 		window = (window >> 1);
-		if(samples.m_samples[idata])
+		if(samples->GetSample(idata))
 			window |= 0x80;
 		nbits ++;
 
@@ -166,7 +165,7 @@ void RjBUjFilter::Refresh()
 			continue;
 
 		//If we're still before the first TIE sample, nothing to do
-		int64_t tstart = samples.m_offsets[idata];
+		int64_t tstart = samples->m_offsets[idata];
 		if(tstart < tfirst)
 			continue;
 
@@ -184,7 +183,7 @@ void RjBUjFilter::Refresh()
 
 		//If the TIE sample is after this bit, don't do anything.
 		//We need edges within this UI.
-		int64_t tend = tstart + samples.m_durations[idata];
+		int64_t tend = tstart + samples->m_durations[idata];
 		if(target > tend)
 			continue;
 
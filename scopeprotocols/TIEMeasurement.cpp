@@ -138,8 +138,8 @@ void TIEMeasurement::Refresh()
 	auto cap = new AnalogWaveform;
 
 	//Timestamps of the edges
-	vector<int64_t> edges;
-	FindZeroCrossings(clk, m_parameters[m_threshname].GetFloatVal(), edges);
+	auto pedges = FindZeroCrossings(clk, m_parameters[m_threshname].GetFloatVal());
+	auto& edges = *pedges;
 
 	//Ignore edges before things have stabilized
 	int64_t skip_time = m_parameters[m_skipname].GetIntVal();
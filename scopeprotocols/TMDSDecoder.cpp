@@ -94,6 +94,20 @@ void TMDSDecoder::SetDefaultName()
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Actual decoder logic
 
+/*
+	Control symbols (HDMI 1.4 spec section 5.4.2), used as preambles to synchronize.
+
+	TMDS sends the LSB first.
+	Since element 0 of a C++ array is leftmost, this table has bit ordering mirrored from the spec.
+ */
+static const bool g_tmdsControlCodes[4][10] =
+{
+	{ 0, 0, 1, 0, 1, 0, 1, 0, 1, 1 },
+	{ 1, 1, 0, 1, 0, 1, 0, 1, 0, 0 },
+	{ 0, 0, 1, 0, 1, 0, 1, 0, 1, 0 },
+	{ 1, 1, 0, 1, 0, 1, 0, 1, 0, 1 }
+};
+
 void TMDSDecoder::Refresh()
 {
 	if(!VerifyAllInputsOK())
@@ -113,57 +127,17 @@ void TMDSDecoder::Refresh()
 	cap->m_startFemtoseconds = din->m_startFemtoseconds;
 
 	//Record the value of the data stream at each clock edge
-	DigitalWaveform sampdata;
-	SampleOnAnyEdges(din, clkin, sampdata);
-
-	/*
-		Look for preamble data. We need this to synchronize. (HDMI 1.4 spec section 5.4.2)
-
-		TMDS sends the LSB first.
-		Since element 0 of a C++ array is leftmost, this table has bit ordering mirrored from the spec.
-	 */
-	static const bool control_codes[4][10] =
+	auto sampdata = SampleBitstream(din, clkin);
+	size_t len = sampdata->size();
+	if(len < 21)
 	{
-		{ 0, 0, 1, 0, 1, 0, 1, 0, 1, 1 },
-		{ 1, 1, 0, 1, 0, 1, 0, 1, 0, 0 },
-		{ 0, 0, 1, 0, 1, 0, 1, 0, 1, 0 },
-		{ 1, 1, 0, 1, 0, 1, 0, 1, 0, 1 }
-	};
-
-	size_t max_preambles = 0;
-	size_t max_offset = 0;
-	for(size_t offset=0; offset < 10; offset ++)
-	{
-		size_t num_preambles[4] = {0};
-		for(size_t i=0; i<sampdata.m_samples.size() - 20; i += 10)
-		{
-			//Look for control code "j" at phase "offset", position "i" within the data stream
-			for(size_t j=0; j<4; j++)
-			{
-				bool match = true;
-				for(size_t k=0; k<10; k++)
-				{
-					if(sampdata.m_samples[i+offset+k] != control_codes[j][k])
-						match = false;
-				}
-				if(match)
-				{
-					num_preambles[j] ++;
-					break;
-				}
-			}
-		}
-
-		for(size_t j=0; j<4; j++)
-		{
-			if(num_preambles[j] > max_preambles)
-			{
-				max_preambles = num_preambles[j];
-				max_offset = offset;
-			}
-		}
+		SetData(cap, 0);
+		return;
 	}
 
+	//Look for preamble data. We need this to synchronize.
+	size_t max_offset = FindSymbolAlignment(sampdata.get(), GetControlTable());
+
 	int lane = m_parameters[m_lanename].GetIntVal();
 
 	//HDMI Video guard band (HDMI 1.4 spec 5.2.2.1)
@@ -173,97 +147,109 @@ void TMDSDecoder::Refresh()
 		{ 1, 1, 0, 0, 1, 1, 0, 0, 1, 0 },		//also used for data guard band, 5.2.3.3
 		{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 1 },
 	};
+	uint16_t guard = GetCodeGroup(video_guard[lane]);
 
 	//TODO: TERC4 (5.4.3)
 
+	//Decode the actual data. Control codes and video data don't depend on context, so do them in parallel.
+	size_t sampmax = len - 11;
+	size_t nsymbols = 0;
+	if(sampmax > max_offset)
+		nsymbols = (sampmax - max_offset + 9) / 10;
+	cap->Resize(nsymbols);
+	auto table = GetDecodeTable();
+
+	#pragma omp parallel for
+	for(size_t n=0; n<nsymbols; n++)
+	{
+		size_t i = max_offset + n*10;
+		cap->m_offsets[n] = sampdata->m_offsets[i];
+		cap->m_durations[n] = sampdata->m_offsets[i+10] - sampdata->m_offsets[i];
+		cap->m_samples[n] = table[sampdata->ExtractBits(i, 10)];
+	}
+
+	//Guard bands look like video data, and are only valid after a preamble, so find them serially
 	enum
 	{
 		TYPE_DATA,
-		TYPE_PREAMBLE,
-		TYPE_GUARD
+		TYPE_PREAMBLE
 	} last_symbol_type = TYPE_DATA;
 
-	//Decode the actual data
-	size_t sampmax = sampdata.m_samples.size()-11;
-	for(size_t i=max_offset; i<sampmax; i+= 10)
+	for(size_t n=0; n<nsymbols; n++)
 	{
-		bool match = true;
+		auto& sym = cap->m_samples[n];
+		if(sym.m_type == TMDSSymbol::TMDS_TYPE_CONTROL)
+			last_symbol_type = TYPE_PREAMBLE;
+		else if( (last_symbol_type == TYPE_PREAMBLE) && (sampdata->ExtractBits(max_offset + n*10, 10) == guard) )
+			sym = TMDSSymbol(TMDSSymbol::TMDS_TYPE_GUARD, 0);
+		else
+			last_symbol_type = TYPE_DATA;
+	}
 
-		//Check for control codes at any point in the sequence
-		for(size_t j=0; j<4; j++)
-		{
-			match = true;
-			for(size_t k=0; k<10; k++)
-			{
-				if(sampdata.m_samples[i+k] != control_codes[j][k])
-					match = false;
-			}
-
-			if(match)
-			{
-				cap->m_offsets.push_back(sampdata.m_offsets[i]);
-				cap->m_durations.push_back(sampdata.m_offsets[i+10] - sampdata.m_offsets[i]);
-				cap->m_samples.push_back(TMDSSymbol(TMDSSymbol::TMDS_TYPE_CONTROL, j));
-
-				last_symbol_type = TYPE_PREAMBLE;
-				break;
-			}
-		}
+	SetData(cap, 0);
+}
 
-		if(match)
-			continue;
+/**
+	@brief Converts a 10-bit code group from array form (earliest bit first) to an integer with the earliest bit in the LSB
+ */
+uint16_t TMDSDecoder::GetCodeGroup(const bool* bits)
+{
+	uint16_t code10 = 0;
+	for(size_t k=0; k<10; k++)
+		code10 |= bits[k] << k;
+	return code10;
+}
 
-		//Check for HDMI video/control leading guard band
-		if( (last_symbol_type == TYPE_PREAMBLE) || (last_symbol_type == TYPE_GUARD) )
-		{
-			match = true;
-			for(size_t k=0; k<10; k++)
-			{
-				if(sampdata.m_samples[i+k] != video_guard[lane][k])
-					match = false;
-			}
-
-			if(match)
-			{
-				cap->m_offsets.push_back(sampdata.m_offsets[i]);
-				cap->m_durations.push_back(sampdata.m_offsets[i+10] - sampdata.m_offsets[i]);
-				cap->m_samples.push_back(TMDSSymbol(TMDSSymbol::TMDS_TYPE_GUARD, 0));
-				//last_symbol_type = TYPE_GUARD;
-				break;
-			}
-		}
+/**
+	@brief Gets a table of control symbols, indexed by 10-bit code group with the first bit in the LSB
+ */
+const uint8_t* TMDSDecoder::GetControlTable()
+{
+	static const vector<uint8_t> table = []()
+	{
+		vector<uint8_t> ret(1024, 0);
+		for(auto& code : g_tmdsControlCodes)
+			ret[GetCodeGroup(code)] = 1;
+		return ret;
+	}();
+
+	return &table[0];
+}
 
-		if(match)
-			continue;
+/**
+	@brief Gets a table of decoded control and video data symbols, indexed by 10-bit code group with the first bit
+	in the LSB
+ */
+const TMDSSymbol* TMDSDecoder::GetDecodeTable()
+{
+	static const vector<TMDSSymbol> table = []()
+	{
+		vector<TMDSSymbol> ret(1024);
+		for(uint16_t code10=0; code10<1024; code10++)
+		{
+			//Whatever isn't a control code is assumed to be video data
+			bool d9 = (code10 >> 9) & 1;
+			bool d8 = (code10 >> 8) & 1;
+			uint8_t d = code10 & 0xff;
 
-		//Whatever is left is assumed to be video data
-		bool d9 = sampdata.m_samples[i+9];
-		bool d8 = sampdata.m_samples[i+8];
+			if(d9)
+				d ^= 0xff;
 
-		uint8_t d = sampdata.m_samples[i+0] |
-					(sampdata.m_samples[i+1] << 1) |
-					(sampdata.m_samples[i+2] << 2) |
-					(sampdata.m_samples[i+3] << 3) |
-					(sampdata.m_samples[i+4] << 4) |
-					(sampdata.m_samples[i+5] << 5) |
-					(sampdata.m_samples[i+6] << 6) |
-					(sampdata.m_samples[i+7] << 7);
+			if(d8)
+				d ^= (d << 1);
+			else
+				d ^= (d << 1) ^ 0xfe;
 
-		if(d9)
-			d ^= 0xff;
+			ret[code10] = TMDSSymbol(TMDSSymbol::TMDS_TYPE_DATA, d);
+		}
 
-		if(d8)
-			d ^= (d << 1);
-		else
-			d ^= (d << 1) ^ 0xfe;
+		for(uint8_t j=0; j<4; j++)
+			ret[GetCodeGroup(g_tmdsControlCodes[j])] = TMDSSymbol(TMDSSymbol::TMDS_TYPE_CONTROL, j);
 
-		cap->m_offsets.push_back(sampdata.m_offsets[i]);
-		cap->m_durations.push_back(sampdata.m_offsets[i+10] - sampdata.m_offsets[i]);
-		cap->m_samples.push_back(TMDSSymbol(TMDSSymbol::TMDS_TYPE_DATA, d));
-		last_symbol_type = TYPE_DATA;
-	}
+		return ret;
+	}();
 
-	SetData(cap, 0);
+	return &table[0];
 }
 
 Gdk::Color TMDSDecoder::GetColor(int i)
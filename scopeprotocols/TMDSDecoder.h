@@ -87,6 +87,10 @@ public:
 
 protected:
 	std::string m_lanename;
+
+	static const TMDSSymbol* GetDecodeTable();
+	static const uint8_t* GetControlTable();
+	static uint16_t GetCodeGroup(const bool* bits);
 };
 
 #endif
@@ -113,10 +113,10 @@ void TopMeasurement::Refresh()
 	size_t len = din->m_samples.size();
 
 	//Make a histogram of the waveform
-	float min = GetMinVoltage(din);
-	float max = GetMaxVoltage(din);
 	size_t nbins = 64;
-	vector<size_t> hist = MakeHistogram(din, min, max, nbins);
+	auto stats = WaveformStatistics::Get(din, nbins);
+	float min = stats->m_min;
+	float max = stats->m_max;
 
 	//Set temporary midpoint and range
 	m_range = (max - min);
@@ -124,18 +124,7 @@ void TopMeasurement::Refresh()
 
 	//Find the highest peak in the last quarter of the histogram
 	//This is the peak for the entire waveform
-	size_t binval = 0;
-	size_t idx = 0;
-	for(size_t i=(nbins*3/4); i<nbins; i++)
-	{
-		if(hist[i] > binval)
-		{
-			binval = hist[i];
-			idx = i;
-		}
-	}
-	float fbin = (idx + 0.5f)/nbins;
-	float global_top = fbin*m_range + min;
+	float global_top = stats->GetMostProbableVoltage(nbins*3/4, nbins);
 
 	//Create the output
 	auto cap = new AnalogWaveform;
@@ -123,7 +123,7 @@ void UARTDecoder::Refresh()
 	int64_t scaledbitper = ibitper / din->m_timescale;
 
 	//UART processing
-	auto cap = new AsciiWaveform;
+	auto cap = WaveformPool::Allocate<AsciiWaveform>(0);
 	cap->m_timescale = din->m_timescale;
 	cap->m_startTimestamp = din->m_startTimestamp;
 	cap->m_startFemtoseconds = din->m_startFemtoseconds;
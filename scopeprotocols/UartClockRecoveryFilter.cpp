@@ -124,12 +124,10 @@ void UartClockRecoveryFilter::Refresh()
 	cap->m_triggerPhase = 0;
 	cap->m_timescale = 1;		//recovered clock time scale is single femtoseconds
 
-	//Timestamps of the edges
-	vector<int64_t> edges;
-
 	//Find times of the zero crossings
 	const float threshold = m_parameters[m_threshname].GetFloatVal();
-	FindZeroCrossings(din, threshold, edges);
+	auto pedges = FindZeroCrossings(din, threshold);
+	auto& edges = *pedges;
 
 	//Actual DLL logic
 	size_t nedge = 0;
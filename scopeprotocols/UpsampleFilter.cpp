@@ -34,6 +34,7 @@
 
 #include "../scopehal/scopehal.h"
 #include "UpsampleFilter.h"
+#include <immintrin.h>
 
 using namespace std;
 
@@ -72,6 +73,15 @@ UpsampleFilter::UpsampleFilter(const string& color)
 	m_factorname = "Upsample factor";
 	m_parameters[m_factorname] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_SAMPLEDEPTH));
 	m_parameters[m_factorname].SetIntVal(10);
+
+	m_downfactorname = "Downsample factor";
+	m_parameters[m_downfactorname] = FilterParameter(FilterParameter::TYPE_INT, Unit(Unit::UNIT_SAMPLEDEPTH));
+	m_parameters[m_downfactorname].SetIntVal(1);
+
+	m_window = 5;
+	m_cachedUpsampleFactor = 0;
+	m_cachedDownsampleFactor = 0;
+	m_chunkInputStride = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -148,67 +158,254 @@ void UpsampleFilter::Refresh()
 	//Get the input data
 	auto din = GetAnalogInputWaveform(0);
 
-	//Configuration parameters that eventually have to be user specified
+	//Reduce the resampling ratio to lowest terms
 	size_t upsample_factor = m_parameters[m_factorname].GetIntVal();
-	size_t window = 5;
-	size_t kernel = window*upsample_factor;
+	size_t downsample_factor = m_parameters[m_downfactorname].GetIntVal();
+	if( (upsample_factor == 0) || (downsample_factor == 0) )
+	{
+		SetData(NULL, 0);
+		return;
+	}
+	size_t a = upsample_factor;
+	size_t b = downsample_factor;
+	while(b != 0)
+	{
+		size_t t = a % b;
+		a = b;
+		b = t;
+	}
+	upsample_factor /= a;
+	downsample_factor /= a;
+
+	if( (upsample_factor != m_cachedUpsampleFactor) || (downsample_factor != m_cachedDownsampleFactor) )
+		UpdateKernel(upsample_factor, downsample_factor);
+
+	//Get the input as evenly spaced samples
+	size_t len;
+	int64_t start;
+	int64_t step;
+	const float* in = GetUniformSamples(din, len, start, step);
+	if( (in == NULL) || (len <= m_window) )
+	{
+		SetData(NULL, 0);
+		return;
+	}
+
+	//Only output samples whose whole window of input is valid
+	size_t nout = ((len - m_window) * upsample_factor) / downsample_factor;
+
+	//Create the output and configure it
+	auto cap = dynamic_cast<AnalogWaveform*>(GetDataImplicit(0));
+	if(cap == NULL)
+	{
+		cap = WaveformPool::Allocate<AnalogWaveform>(nout);
+		SetData(cap, 0);
+	}
+	cap->ResizeImplicit(nout);
+
+	//Copy our time scales from the input, and correct for the resampling
+	cap->m_timescale = din->m_timescale * step * downsample_factor / upsample_factor;
+	cap->m_startTimestamp = din->m_startTimestamp;
+	cap->m_startFemtoseconds = din->m_startFemtoseconds;
+	cap->m_triggerPhase = din->m_triggerPhase + start * din->m_timescale;
+
+	//Split into blocks for multithreading. Blocks are whole numbers of chunks so the vector loop doesn't have to
+	//deal with partial ones, which means there can't be more blocks than chunks.
+	size_t chunk = m_chunkTapOffsets.size();
+	size_t numblocks = min(GetParallelBlockCount(nout), max<size_t>(nout / chunk, 1));
+
+	float* out = (float*)&cap->m_samples[0];
+	ForEachParallelBlock(nout, numblocks, chunk, [&](size_t /*i*/, size_t mstart, size_t mend)
+		{
+			if(g_hasAvx2)
+				InterpolateBlockAVX2(in, out, mstart, mend);
+			else
+				InterpolateBlock(in, out, mstart, mend);
+		});
+}
 
-	//Create the interpolation filter
+/**
+	@brief Rebuilds the polyphase filter bank and per-chunk lookup tables for a new resampling ratio
+
+	Logically, we upsample by inserting zeroes, then convolve with the sinc filter, then keep every Mth sample. Output
+	sample m sits at index n = m*M of the zero-stuffed signal, and only every Lth tap of the filter lines up with a
+	nonzero sample, so each output is a short dot product of m_window input samples with one phase (a subset of taps
+	starting at some offset p) of the filter. Precompute which phase and which input sample each output starts at.
+ */
+void UpsampleFilter::UpdateKernel(size_t upsample_factor, size_t downsample_factor)
+{
+	m_cachedUpsampleFactor = upsample_factor;
+	m_cachedDownsampleFactor = downsample_factor;
+
+	//The lowpass cutoff has to be below both the input and the output Nyquist frequency. When decimating (M > L), the
+	//output's is lower, so stretch the sinc by M/L (scaling it down to keep unity gain) and widen the window to match.
+	//When upsampling the scale is exactly 1 and the filter is the same as for a pure interpolator.
+	size_t ratio = max(upsample_factor, downsample_factor);
+	float scale = ratio * 1.0f / upsample_factor;
+	m_window = (5*ratio + upsample_factor - 1) / upsample_factor;
+
+	//Create the interpolation filter, with the taps for each phase next to each other
+	size_t kernel = m_window * upsample_factor;
 	float frac_kernel = kernel * 1.0f / upsample_factor;
-	vector<float> filter;
-	for(size_t i=0; i<kernel; i++)
+	m_coefficients.resize(kernel);
+	for(size_t p=0; p<upsample_factor; p++)
 	{
-		float frac = i*1.0f / upsample_factor;
-		filter.push_back(sinc(frac, frac_kernel) * blackman(frac, frac_kernel));
+		for(size_t t=0; t<m_window; t++)
+		{
+			float frac = (p + t*upsample_factor) * 1.0f / upsample_factor;
+			m_coefficients[p*m_window + t] =
+				sinc(frac / scale, frac_kernel / scale) / scale * blackman(frac, frac_kernel);
+		}
 	}
 
-	//Create the output and configure it
-	auto cap = new AnalogWaveform;
+	//With the ratio in lowest terms, the phase of output sample m repeats every L outputs.
+	//Round that up to a multiple of the vector width to get the chunk size.
+	size_t rep = 1;
+	while( (upsample_factor * rep) % 8 != 0)
+		rep *= 2;
+	size_t chunk = upsample_factor * rep;
+	m_chunkInputStride = downsample_factor * rep;
+
+	m_chunkTapOffsets.resize(chunk);
+	m_chunkInputOffsets.resize(chunk);
+	for(size_t r=0; r<chunk; r++)
+	{
+		size_t n = r * downsample_factor;
+		size_t p = (upsample_factor - (n % upsample_factor)) % upsample_factor;
+		m_chunkTapOffsets[r] = p * m_window;
+		m_chunkInputOffsets[r] = (n + p) / upsample_factor;
+	}
+}
 
-	//TODO: make this work on not-dense-packed waveforms
+/**
+	@brief Gets the input samples at a uniform sample rate
 
-	//Fill out the input with samples
-	size_t len = din->m_samples.size();
-	for(size_t i=0; i < len; i++)
+	Dense packed waveforms, or sparse ones which happen to be evenly spaced, are used as is. Anything else (e.g. RLE
+	compressed captures) is expanded by sample-and-hold on a grid at the shortest sample duration.
+
+	@param din		The input waveform
+	@param len		Number of uniformly spaced samples
+	@param start	Time of the first sample, in input timebase units
+	@param step		Time between samples, in input timebase units
+
+	@return Pointer to the samples, or NULL if the input can't be resampled
+ */
+const float* UpsampleFilter::GetUniformSamples(AnalogWaveform* din, size_t& len, int64_t& start, int64_t& step)
+{
+	len = din->m_samples.size();
+	start = 0;
+	step = 1;
+	if(din->m_densePacked)
+		return (const float*)&din->m_samples[0];
+	if(len < 2)
+		return NULL;
+
+	//See if the samples are evenly spaced anyway
+	start = din->m_offsets[0];
+	step = din->m_offsets[1] - din->m_offsets[0];
+	bool uniform = (step > 0);
+	for(size_t i=2; uniform && (i<len); i++)
+	{
+		if(din->m_offsets[i] != start + (int64_t)i*step)
+			uniform = false;
+	}
+	if(uniform)
+		return (const float*)&din->m_samples[0];
+
+	//Nope, expand to a uniform grid at the shortest sample duration
+	step = INT64_MAX;
+	for(size_t i=0; i<len; i++)
+	{
+		if(din->m_durations[i] > 0)
+			step = min(step, (int64_t)din->m_durations[i]);
+	}
+	if(step == INT64_MAX)
+		return NULL;
+
+	int64_t tend = din->m_offsets[len-1] + din->m_durations[len-1];
+	size_t nuniform = (tend - start) / step;
+	if(nuniform > 256*1024*1024)
+	{
+		LogWarning("UpsampleFilter: input is too sparse to resample\n");
+		return NULL;
+	}
+
+	m_uniformBuf.resize(nuniform);
+	size_t isample = 0;
+	for(size_t i=0; i<nuniform; i++)
 	{
-		for(size_t j=0; j<upsample_factor; j++)
+		int64_t t = start + (int64_t)i*step;
+		while( (isample+1 < len) && (din->m_offsets[isample+1] <= t) )
+			isample ++;
+		m_uniformBuf[i] = din->m_samples[isample];
+	}
+
+	len = nuniform;
+	return &m_uniformBuf[0];
+}
+
+/**
+	@brief Calculates output samples mstart ... mend-1 (mstart must be at the start of a chunk)
+ */
+void UpsampleFilter::InterpolateBlock(const float* in, float* out, size_t mstart, size_t mend)
+{
+	size_t chunk = m_chunkTapOffsets.size();
+	const float* coeffs = &m_coefficients[0];
+
+	for(size_t cstart=mstart; cstart<mend; cstart += chunk)
+	{
+		const float* base = in + (cstart / chunk) * m_chunkInputStride;
+		size_t cend = min(mend, cstart + chunk);
+		for(size_t m=cstart; m<cend; m++)
 		{
-			cap->m_offsets.push_back(i * upsample_factor + j);
-			cap->m_durations.push_back(1);
-			cap->m_samples.push_back(0);
+			size_t r = m - cstart;
+			const float* taps = coeffs + m_chunkTapOffsets[r];
+			const float* x = base + m_chunkInputOffsets[r];
+
+			float f = 0;
+			for(size_t t=0; t<m_window; t++)
+				f += taps[t] * x[t];
+			out[m] = f;
 		}
 	}
+}
+
+/**
+	@brief AVX2 version of InterpolateBlock(), calculating 8 output samples at a time
+ */
+__attribute__((target("avx2")))
+void UpsampleFilter::InterpolateBlockAVX2(const float* in, float* out, size_t mstart, size_t mend)
+{
+	size_t chunk = m_chunkTapOffsets.size();
+	const float* coeffs = &m_coefficients[0];
 
-	//Logically, we upsample by inserting zeroes, then convolve with the sinc filter.
-	//Optimization: don't actually waste time multiplying by zero
-	//TODO: vectorize this instead of multithreading
-	size_t imax = len - window;
-	#pragma omp parallel for
-	for(size_t i=0; i < imax; i++)
+	//Full chunks are vectorized
+	size_t vend = mstart + ((mend - mstart) / chunk) * chunk;
+	for(size_t cstart=mstart; cstart<vend; cstart += chunk)
 	{
-		size_t offset = i * upsample_factor;
-		for(size_t j=0; j<upsample_factor; j++)
+		const float* base = in + (cstart / chunk) * m_chunkInputStride;
+		for(size_t r=0; r<chunk; r += 8)
 		{
-			size_t start = 0;
-			size_t sstart = 0;
-			if(j > 0)
+			__m256i taps = _mm256_load_si256((__m256i*)&m_chunkTapOffsets[r]);
+			__m256i xoff = _mm256_load_si256((__m256i*)&m_chunkInputOffsets[r]);
+			__m256i one = _mm256_set1_epi32(1);
+
+			__m256 f = _mm256_setzero_ps();
+			for(size_t t=0; t<m_window; t++)
 			{
-				sstart = 1;
-				start = upsample_factor - j;
-			}
+				__m256 c = _mm256_i32gather_ps(coeffs, taps, 4);
+				__m256 x = _mm256_i32gather_ps(base, xoff, 4);
+				f = _mm256_add_ps(f, _mm256_mul_ps(c, x));
 
-			float f = 0;
-			for(size_t k = start; k<kernel; k += upsample_factor, sstart ++)
-				f += filter[k] * din->m_samples[i + sstart];
+				taps = _mm256_add_epi32(taps, one);
+				xoff = _mm256_add_epi32(xoff, one);
+			}
 
-			cap->m_samples[offset + j] = f;
+			_mm256_storeu_ps(out + cstart + r, f);
 		}
 	}
 
-	//Copy our time scales from the input, and correct for the upsampling
-	cap->m_timescale = din->m_timescale / upsample_factor;
-	cap->m_startTimestamp = din->m_startTimestamp;
-	cap->m_startFemtoseconds = din->m_startFemtoseconds;
-
-	SetData(cap, 0);
+	//Do the partial chunk at the end, if any
+	if(vend < mend)
+		InterpolateBlock(in, out, vend, mend);
 }
@@ -56,7 +56,44 @@ public:
 	PROTOCOL_DECODER_INITPROC(UpsampleFilter)
 
 protected:
+	void UpdateKernel(size_t upsample_factor, size_t downsample_factor);
+
+	const float* GetUniformSamples(AnalogWaveform* din, size_t& len, int64_t& start, int64_t& step);
+
+	void InterpolateBlock(const float* in, float* out, size_t mstart, size_t mend);
+	void InterpolateBlockAVX2(const float* in, float* out, size_t mstart, size_t mend);
+
 	std::string m_factorname;
+	std::string m_downfactorname;
+
+	///@brief Number of input samples each output sample depends on (more than 5 when decimating, see UpdateKernel())
+	size_t m_window;
+
+	///@brief Interpolation factor the polyphase tables were built for (reduced to lowest terms)
+	size_t m_cachedUpsampleFactor;
+
+	///@brief Decimation factor the polyphase tables were built for (reduced to lowest terms)
+	size_t m_cachedDownsampleFactor;
+
+	///@brief Filter taps, one row of m_window taps per phase
+	std::vector<float, AlignedAllocator<float, 64> > m_coefficients;
+
+	/**
+		@brief Offset of the first tap (into m_coefficients) for each output sample in a chunk.
+
+		The phase of output samples repeats with a period of m_cachedUpsampleFactor samples. A chunk is that period
+		rounded up to a multiple of 8 samples, so each chunk can be processed with whole vectors.
+	 */
+	std::vector<int32_t, AlignedAllocator<int32_t, 64> > m_chunkTapOffsets;
+
+	///@brief Index of the first input sample, relative to the chunk's first, for each output sample in a chunk
+	std::vector<int32_t, AlignedAllocator<int32_t, 64> > m_chunkInputOffsets;
+
+	///@brief Number of input samples between the start of consecutive chunks
+	size_t m_chunkInputStride;
+
+	///@brief Sample-and-hold expansion of non-uniformly sampled input
+	std::vector<float, AlignedAllocator<float, 64> > m_uniformBuf;
 };
 
 #endif
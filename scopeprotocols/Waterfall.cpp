@@ -39,6 +39,7 @@ using namespace std;
 WaterfallWaveform::WaterfallWaveform(size_t width, size_t height)
 	: m_width(width)
 	, m_height(height)
+	, m_head(0)
 {
 	size_t npix = width*height;
 	m_outdata = new float[npix];
@@ -52,6 +53,37 @@ WaterfallWaveform::~WaterfallWaveform()
 	m_outdata = NULL;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Accessors
+
+/**
+	@brief Gets the image as a flat array, oldest row first
+
+	If rows have been added since the last call, the ring is rotated into place first. That costs a full image copy, so
+	consumers which are called for every new row should use GetRow() or GetRawData() / GetHeadRow() instead.
+ */
+float* WaterfallWaveform::GetData()
+{
+	if(m_head != 0)
+	{
+		rotate(m_outdata, m_outdata + m_head*m_width, m_outdata + m_height*m_width);
+		m_head = 0;
+	}
+	return m_outdata;
+}
+
+/**
+	@brief Scrolls the image up by one row, discarding the oldest
+
+	@return Pointer to the new bottom row, which still contains stale data from the row it replaced
+ */
+float* WaterfallWaveform::AddRow()
+{
+	float* row = m_outdata + m_head*m_width;
+	m_head = (m_head + 1) % m_height;
+	return row;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
@@ -147,14 +179,9 @@ void Waterfall::Refresh()
 	if(cap == NULL)
 		cap = new WaterfallWaveform(m_width, m_height);
 	cap->m_timescale = din->m_timescale;
-	float* data = cap->GetData();
 
-	//Move the whole waterfall down by one row
-	for(size_t y=0; y < m_height-1 ; y++)
-	{
-		for(size_t x=0; x<m_width; x++)
-			data[y*m_width + x] = data[(y+1)*m_width + x];
-	}
+	//Scroll the waterfall by one row, reusing the oldest row for the new data
+	float* row = cap->AddRow();
 
 	//Add the new data
 	double hz_per_bin = din->m_timescale;
@@ -180,7 +207,7 @@ void Waterfall::Refresh()
 		if(value < vmin)
 			value = vmin;
 
-		data[(m_height-1)*m_width + x] = value;
+		row[x] = value;
 	}
 
 	SetData(cap, 0);
@@ -35,6 +35,12 @@
 #ifndef Waterfall_h
 #define Waterfall_h
 
+/**
+	@brief A scrolling spectrogram image
+
+	Rows are stored in a ring buffer so adding a new spectrum only touches one row. Row 0 is the oldest (top of the
+	display) and row m_height-1 the newest. Physical row GetHeadRow() of the raw buffer holds logical row 0.
+ */
 class WaterfallWaveform : public WaveformBase
 {
 public:
@@ -45,13 +51,39 @@ public:
 	WaterfallWaveform(const WaterfallWaveform&) =delete;
 	WaterfallWaveform& operator=(const WaterfallWaveform&) =delete;
 
-	float* GetData()
+	float* GetData();
+
+	/**
+		@brief Gets the raw ring buffer, without rotating it into display order
+
+		Logical row y is at physical row (GetHeadRow() + y) % GetHeight().
+	 */
+	float* GetRawData()
 	{ return m_outdata; }
 
+	///@brief Gets the physical row index of the oldest (top) row
+	size_t GetHeadRow()
+	{ return m_head; }
+
+	///@brief Gets a pointer to logical row y (0 is the oldest)
+	float* GetRow(size_t y)
+	{ return m_outdata + ((m_head + y) % m_height) * m_width; }
+
+	size_t GetWidth()
+	{ return m_width; }
+
+	size_t GetHeight()
+	{ return m_height; }
+
+	float* AddRow();
+
 protected:
 	size_t m_width;
 	size_t m_height;
 
+	///@brief Physical row holding the oldest line of the image
+	size_t m_head;
+
 	float* m_outdata;
 };
 
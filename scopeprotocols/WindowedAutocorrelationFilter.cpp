@@ -150,7 +150,7 @@ void WindowedAutocorrelationFilter::Refresh()
 
 	//We need meaningful data, bail if it's too short
 	auto len = min(din_i->m_samples.size(), din_q->m_samples.size());
-	if(len < period_samples)
+	if( (len <= 2*period_samples) || (window_samples == 0) )
 	{
 		SetData(NULL, 0);
 		return;
@@ -160,27 +160,28 @@ void WindowedAutocorrelationFilter::Refresh()
 	auto cap = SetupOutputWaveform(din_i, 0, 0, 2*period_samples);
 
 	size_t end = len - 2*period_samples;
-	float vmax = -FLT_MAX;
-	float vmin = FLT_MAX;
-	for(size_t i=0; i < end; i ++)
-	{
-		complex<float> total = 0;
-		for(size_t j=0; j<window_samples; j++)
-		{
-			size_t first = i + j;
-			size_t second = first + period_samples;
 
-			complex<float> a(din_i->m_samples[first], din_q->m_samples[first]);
-			complex<float> b(din_i->m_samples[second], din_q->m_samples[second]);
+	//Each block primes its own running correlation sums over the first window, so blocks are independent
+	size_t numblocks = GetParallelBlockCount(end);
+	vector<float> blockmin(numblocks);
+	vector<float> blockmax(numblocks);
 
-			total += a*b;
-		}
+	const float* pi = (const float*)&din_i->m_samples[0];
+	const float* pq = (const float*)&din_q->m_samples[0];
+	float* out = (float*)&cap->m_samples[0];
 
-		float v = abs(total) / window_samples;
-		vmax = max(vmax, v);
-		vmin = min(vmin, v);
+	ForEachParallelBlock(end, numblocks, 1, [&](size_t i, size_t istart, size_t iend)
+		{
+			CorrelateBlock(
+				pi, pq, out, istart, iend, window_samples, period_samples, blockmin[i], blockmax[i]);
+		});
 
-		cap->m_samples[i] = v;
+	float vmax = -FLT_MAX;
+	float vmin = FLT_MAX;
+	for(size_t i=0; i<numblocks; i++)
+	{
+		vmin = min(vmin, blockmin[i]);
+		vmax = max(vmax, blockmax[i]);
 	}
 
 	//Calculate bounds
@@ -189,3 +190,62 @@ void WindowedAutocorrelationFilter::Refresh()
 	m_range = (m_max - m_min) * 1.05;
 	m_offset = ( (m_max - m_min)/2 + m_min );
 }
+
+/**
+	@brief Calculates one block of the windowed autocorrelation with a running sum
+
+	Each output is the sum of a[k] * a[k + period] over a window of k, so moving the window along by one sample just
+	adds the product entering the window and subtracts the one leaving. A strong carrier makes those products large
+	compared to the correlation itself, so the complex<double> total is periodically re-primed from the raw products
+	rather than relying on exact cancellation.
+ */
+void WindowedAutocorrelationFilter::CorrelateBlock(
+	const float* pi,
+	const float* pq,
+	float* out,
+	size_t istart,
+	size_t iend,
+	size_t window_samples,
+	size_t period_samples,
+	float& vmin,
+	float& vmax)
+{
+	//Re-priming costs one complex multiply per window sample, versus two per output when sliding. Once per 16 windows
+	//(at least 64K outputs) that's about 3% extra.
+	size_t resync = max((size_t)65536, window_samples * 16);
+
+	vmin = FLT_MAX;
+	vmax = -FLT_MAX;
+	for(size_t cstart=istart; cstart<iend; cstart += resync)
+	{
+		size_t cend = min(iend, cstart + resync);
+
+		complex<double> total = 0;
+		for(size_t k=cstart; k<cstart + window_samples; k++)
+		{
+			complex<double> a(pi[k], pq[k]);
+			complex<double> b(pi[k + period_samples], pq[k + period_samples]);
+			total += a*b;
+		}
+
+		for(size_t i=cstart; i<cend; i++)
+		{
+			if(i > cstart)
+			{
+				size_t kin = i + window_samples - 1;
+				size_t kout = i - 1;
+
+				complex<double> ain(pi[kin], pq[kin]);
+				complex<double> bin(pi[kin + period_samples], pq[kin + period_samples]);
+				complex<double> aout(pi[kout], pq[kout]);
+				complex<double> bout(pi[kout + period_samples], pq[kout + period_samples]);
+				total += ain*bin - aout*bout;
+			}
+
+			float v = abs(total) / window_samples;
+			vmin = min(vmin, v);
+			vmax = max(vmax, v);
+			out[i] = v;
+		}
+	}
+}
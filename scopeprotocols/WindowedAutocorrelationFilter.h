@@ -57,6 +57,17 @@ public:
 	PROTOCOL_DECODER_INITPROC(WindowedAutocorrelationFilter)
 
 protected:
+	static void CorrelateBlock(
+		const float* pi,
+		const float* pq,
+		float* out,
+		size_t istart,
+		size_t iend,
+		size_t window_samples,
+		size_t period_samples,
+		float& vmin,
+		float& vmax);
+
 	double	m_range;
 	double	m_offset;
 	float m_min;